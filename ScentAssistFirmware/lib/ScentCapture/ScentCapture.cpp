@@ -0,0 +1,198 @@
+/*******************************************************************************
+ * ScentAssist - Serial Sample Capture Stream
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "ScentCapture.h"
+
+/********************************* CHECKSUM ***********************************/
+static inline void fletcher(uint16_t &sum1, uint16_t &sum2, uint8_t byte) {
+  sum1 += byte;
+  if (sum1 >= 255) sum1 -= 255;
+  sum2 += sum1;
+  if (sum2 >= 255) sum2 -= 255;
+}
+
+/********************************* ENCODING ***********************************/
+void captureBegin(CaptureEncoder &enc, uint16_t periodUs) {
+  memset(&enc, 0, sizeof(enc));
+  enc.periodUs = periodUs;
+}
+
+static inline void putNibble(CaptureEncoder &enc, uint8_t code) {
+  uint8_t *frame = enc.frames[enc.fill];
+  if (!enc.lowNibble) {
+    frame[enc.length++] = uint8_t(code << 4);
+    enc.lowNibble = true;
+  } else {
+    frame[enc.length - 1] |= code;
+    fletcher(enc.sum1, enc.sum2, frame[enc.length - 1]);
+    enc.lowNibble = false;
+  }
+}
+
+void capturePush(CaptureEncoder &enc, uint16_t sample, uint32_t timestampUs) {
+  /*******         Encode one sample; at most four nibble writes.       *******/
+  uint8_t *frame = enc.frames[enc.fill];
+  sample &= 0x0FFF;
+
+  if (enc.count == 0) {
+    // Start a Frame
+    frame[0] = CAPTURE_SYNC_0;
+    frame[1] = CAPTURE_SYNC_1;
+    frame[2] = enc.sequence;
+    frame[5] = uint8_t(enc.periodUs);
+    frame[6] = uint8_t(enc.periodUs >> 8);
+    frame[7] = uint8_t(timestampUs);
+    frame[8] = uint8_t(timestampUs >> 8);
+    frame[9] = uint8_t(timestampUs >> 16);
+    frame[10] = uint8_t(timestampUs >> 24);
+    frame[11] = uint8_t(sample);
+    frame[12] = uint8_t(sample >> 8);
+    enc.length = CAPTURE_HEADER_BYTES;
+    enc.lowNibble = false;
+    enc.sum1 = 0;
+    enc.sum2 = 0;
+  } else {
+    int16_t delta = int16_t(sample - enc.previous);
+    if ((delta >= -7) && (delta <= 7)) {
+      putNibble(enc, uint8_t(delta) & 0x0F);
+    } else {
+      putNibble(enc, CAPTURE_ESCAPE);
+      putNibble(enc, uint8_t(sample >> 8) & 0x0F);
+      putNibble(enc, uint8_t(sample >> 4) & 0x0F);
+      putNibble(enc, uint8_t(sample) & 0x0F);
+    }
+  }
+
+  enc.previous = sample;
+  if (++enc.count == CAPTURE_FRAME_SAMPLES) {
+    captureFlush(enc);
+  }
+}
+
+void captureFlush(CaptureEncoder &enc) {
+  /*******     Seal the frame being built and queue it for sending.     *******/
+  uint8_t *frame = enc.frames[enc.fill];
+  if (enc.count == 0) return;
+
+  if (enc.lowNibble) {
+    fletcher(enc.sum1, enc.sum2, frame[enc.length - 1]); // Padded byte
+  }
+  frame[3] = enc.count;
+  frame[4] = uint8_t(enc.length - CAPTURE_HEADER_BYTES);
+  for (uint8_t i = 2; i < CAPTURE_HEADER_BYTES; i++) {
+    fletcher(enc.sum1, enc.sum2, frame[i]);
+  }
+  frame[enc.length++] = uint8_t(enc.sum1);
+  frame[enc.length++] = uint8_t(enc.sum2);
+
+  if (enc.sent < enc.sendLength) {
+    // Link still busy with the previous frame; drop this one.
+    enc.dropped++;
+  } else {
+    enc.sendLength = enc.length;
+    enc.sent = 0;
+    enc.fill ^= 1;
+  }
+  enc.sequence++;
+  enc.count = 0;
+  enc.length = 0;
+}
+
+uint8_t capturePending(const CaptureEncoder &enc, const uint8_t **data) {
+  *data = enc.frames[enc.fill ^ 1] + enc.sent;
+  return uint8_t(enc.sendLength - enc.sent);
+}
+
+void captureConsume(CaptureEncoder &enc, uint8_t n) {
+  enc.sent += n;
+}
+
+/********************************* DECODING ***********************************/
+static bool decodeFrame(const uint8_t *f, CaptureFrame &frame) {
+  uint8_t count = f[3];
+  uint8_t payload = f[4];
+  uint16_t sum1 = 0, sum2 = 0;
+  const uint8_t *p = f + CAPTURE_HEADER_BYTES;
+
+  // Checksum: payload, then header after the marker.
+  for (uint8_t i = 0; i < payload; i++) fletcher(sum1, sum2, p[i]);
+  for (uint8_t i = 2; i < CAPTURE_HEADER_BYTES; i++) fletcher(sum1, sum2, f[i]);
+  if (p[payload] != sum1 || p[payload + 1] != sum2) return false;
+
+  frame.sequence = f[2];
+  frame.count = count;
+  frame.periodUs = uint16_t(f[5] | (f[6] << 8));
+  frame.timestampUs = uint32_t(f[7]) | (uint32_t(f[8]) << 8) |
+                      (uint32_t(f[9]) << 16) | (uint32_t(f[10]) << 24);
+  frame.samples[0] = uint16_t(f[11] | (f[12] << 8));
+  if (frame.samples[0] > 0x0FFF) return false;
+
+  // Walk the nibble codes
+  uint16_t nibble = 0, nibbles = uint16_t(payload) * 2;
+  int16_t value = int16_t(frame.samples[0]);
+  for (uint8_t n = 1; n < count; n++) {
+    if (nibble >= nibbles) return false;
+    uint8_t code = (p[nibble >> 1] >> ((nibble & 1) ? 0 : 4)) & 0x0F;
+    nibble++;
+    if (code == CAPTURE_ESCAPE) {
+      if (nibble + 3 > nibbles) return false;
+      value = 0;
+      for (uint8_t k = 0; k < 3; k++, nibble++) {
+        value = int16_t((value << 4) |
+                        ((p[nibble >> 1] >> ((nibble & 1) ? 0 : 4)) & 0x0F));
+      }
+    } else {
+      value = int16_t(value + ((code & 0x08) ? int16_t(code) - 16 : code));
+      if (value < 0 || value > 0x0FFF) return false;
+    }
+    frame.samples[n] = uint16_t(value);
+  }
+
+  // Payload must be exactly the codes plus at most one pad nibble.
+  return (nibble + 1) / 2 == payload;
+}
+
+bool captureParse(const uint8_t *data, uint32_t length, uint32_t &consumed,
+                  CaptureFrame &frame, CaptureStats &stats) {
+  uint32_t i = 0;
+
+  while (i + 1 < length) {
+    if (data[i] != CAPTURE_SYNC_0 || data[i + 1] != CAPTURE_SYNC_1) {
+      i++;
+      continue;
+    }
+    if (length - i < CAPTURE_HEADER_BYTES) break;
+
+    const uint8_t *f = data + i;
+    uint32_t total = CAPTURE_HEADER_BYTES + f[4] + 2;
+    if (f[3] == 0 || f[3] > CAPTURE_FRAME_SAMPLES ||
+        f[4] > CAPTURE_PAYLOAD_MAX_BYTES) {
+      stats.rejected++;
+      i++;
+      continue;
+    }
+    if (length - i < total) break;
+
+    if (decodeFrame(f, frame)) {
+      stats.skipped += i;
+      stats.frames++;
+      consumed = i + total;
+      return true;
+    }
+    stats.rejected++;
+    i++;
+  }
+
+  // Keep a possible partial marker at the end.
+  if (i + 1 == length && data[i] != CAPTURE_SYNC_0) i++;
+  stats.skipped += i;
+  consumed = i;
+  return false;
+}
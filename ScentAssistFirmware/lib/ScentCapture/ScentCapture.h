@@ -0,0 +1,89 @@
+/*******************************************************************************
+ * ScentAssist - Serial Sample Capture Stream
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Compact framing for streaming raw motion sensor samples over the
+ *        serial port at full ADC rate. The device side packs each sample in
+ *        a bounded number of steps; the host side resynchronizes on the
+ *        frame marker and reconstructs the stream bit-exactly.
+ *
+ *        FRAME   0xA5 0x5A | sequence u8 | count u8 | payload bytes u8 |
+ *                periodUs u16 | timestampUs u32 | first sample u16 |
+ *                payload | Fletcher-16 u16
+ *
+ *        Multi-byte fields are little-endian. The payload holds one 4-bit
+ *        code per remaining sample (high nibble first): a delta of -7..+7
+ *        from the previous sample, or the escape nibble 0x8 followed by the
+ *        absolute sample in three nibbles. The checksum runs over the
+ *        payload followed by the header bytes after the marker.
+ ******************************************************************************/
+
+#ifndef SCENTCAPTURE_H
+#define SCENTCAPTURE_H
+
+#include <stdint.h>
+
+#define CAPTURE_SYNC_0 0xA5
+#define CAPTURE_SYNC_1 0x5A
+#define CAPTURE_HEADER_BYTES 13
+#define CAPTURE_FRAME_SAMPLES 64
+#define CAPTURE_PAYLOAD_MAX_BYTES (2 * (CAPTURE_FRAME_SAMPLES - 1))
+#define CAPTURE_FRAME_MAX_BYTES \
+  (CAPTURE_HEADER_BYTES + CAPTURE_PAYLOAD_MAX_BYTES + 2)
+#define CAPTURE_ESCAPE 0x8
+
+/********************************* ENCODING ***********************************/
+struct CaptureEncoder {
+  uint8_t frames[2][CAPTURE_FRAME_MAX_BYTES]; // Building / sending.
+  uint8_t fill;         // Index of the frame being built.
+  uint8_t length;       // Bytes used in the frame being built.
+  uint8_t count;        // Samples in the frame being built.
+  bool lowNibble;       // Next code goes in the low half of the last byte.
+  uint16_t previous;    // Last sample encoded.
+  uint16_t sum1, sum2;  // Running Fletcher-16 over the payload.
+  uint8_t sequence;     // Sequence number of the next frame.
+  uint16_t periodUs;    // Nominal sample spacing.
+  uint8_t sendLength;   // Bytes in the frame being sent.
+  uint8_t sent;         // Bytes of it already handed to the UART.
+  uint16_t dropped;     // Frames lost because the link was still busy.
+};
+
+void captureBegin(CaptureEncoder &enc, uint16_t periodUs);
+
+// Add one sample taken at timestampUs (only used for a frame's first sample).
+void capturePush(CaptureEncoder &enc, uint16_t sample, uint32_t timestampUs);
+
+// Close the frame being built early, e.g. when samples were skipped.
+void captureFlush(CaptureEncoder &enc);
+
+// Bytes waiting to be sent; *data points at the first of them.
+uint8_t capturePending(const CaptureEncoder &enc, const uint8_t **data);
+
+// Mark `n` pending bytes as handed to the UART.
+void captureConsume(CaptureEncoder &enc, uint8_t n);
+
+/********************************* DECODING ***********************************/
+struct CaptureFrame {
+  uint8_t sequence;
+  uint8_t count;
+  uint16_t periodUs;
+  uint32_t timestampUs;
+  uint16_t samples[CAPTURE_FRAME_SAMPLES];
+};
+
+struct CaptureStats {
+  uint32_t frames;      // Valid frames decoded.
+  uint32_t rejected;    // Candidate frames failing validation.
+  uint32_t skipped;     // Bytes discarded outside of valid frames.
+};
+
+// Scan `length` received bytes for the next valid frame. Returns true when
+// `frame` was filled. Either way the first `consumed` bytes are finished
+// with; the rest must be presented again once more data has arrived.
+bool captureParse(const uint8_t *data, uint32_t length, uint32_t &consumed,
+                  CaptureFrame &frame, CaptureStats &stats);
+
+#endif // SCENTCAPTURE_H
@@ -0,0 +1,853 @@
+/*******************************************************************************
+ * ScentAssist - Core Control Logic
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ ******************************************************************************/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "ScentCore.h"
+
+const ControllerProfile c_FACTORY_PROFILES[PROFILE_COUNT] = {
+  {"Default", c_DELAY_S, c_RUN_S, c_BLOCK_DETECTION_MS, c_BLOCK_MOTION_MS,
+   c_FILTER_PARAMS, c_DETECTOR_PARAMS, c_PRESENCE_PARAMS},
+  {"Multi", TicksOf<SecondTicks, (30_s).us>::value,
+   TicksOf<SecondTicks, (12_min).us>::value, c_BLOCK_DETECTION_MS,
+   c_BLOCK_MOTION_MS, c_FILTER_PARAMS, c_DETECTOR_PARAMS,
+   {TicksOf<SecondTicks, (20_s).us>::value,
+    TicksOf<SecondTicks, (30_min).us>::value}},
+  {"Kitten", c_DELAY_S, TicksOf<SecondTicks, (6_min).us>::value,
+   c_BLOCK_DETECTION_MS, c_BLOCK_MOTION_MS,
+   {c_IIR_COEF_Q8, 14, 3, false},
+   {2, TicksOf<MilliTicks, (500_ms).us>::value, c_MOTION_HOLD_MS},
+   c_PRESENCE_PARAMS},
+  {"Senior", TicksOf<SecondTicks, (2_min).us>::value,
+   TicksOf<SecondTicks, (10_min).us>::value, c_BLOCK_DETECTION_MS,
+   c_BLOCK_MOTION_MS, {c_IIR_COEF_Q8, MIN_THRESHOLD, 3, false},
+   {2, c_MOTION_QUALIFY_MS, TicksOf<MilliTicks, (2_s).us>::value},
+   {TicksOf<SecondTicks, (45_s).us>::value,
+    TicksOf<SecondTicks, (30_min).us>::value}},
+};
+
+void controllerInit(ControllerState &ctrl, uint32_t now) {
+  /*******       Place the controller in its power-on condition.        *******/
+  memset(&ctrl, 0, sizeof(ctrl));
+  ctrl.state = controlState::IDLE;
+  ctrl.profile = &c_FACTORY_PROFILES[0];
+  learnDefaults(ctrl.learn, ctrl.profile->filter);
+  rateReset(ctrl.motionRate, {MOTION_BURST, ctrl.profile->blockDetectionMs});
+  rateReset(ctrl.manualRate, c_MANUAL_RATE_PARAMS);
+  tickBegin(ctrl.clock, now);
+}
+
+void controllerSetProfile(ControllerState &ctrl,
+                          const ControllerProfile *profile) {
+  /*******  Swap settings in place; learning restarts from the new ones. *******/
+  ctrl.profile = profile;
+  learnDefaults(ctrl.learn, profile->filter);
+}
+
+void tickBegin(TickClock &clock, uint32_t now) {
+  /*******          Start counting ticks from this snapshot.            *******/
+  clock.lastUSec = now;
+  clock.subMs = 0;
+  clock.subSecond = 0;
+}
+
+TickElapsed tickAdvance(TickClock &clock, uint32_t now) {
+  /*******   Whole ms and s elapsed; fractions carry to the next call.  *******/
+  TickElapsed elapsed = {0, 0};
+  uint32_t us = uint32_t(now - clock.lastUSec) + clock.subMs;
+  uint32_t ms;
+
+  clock.lastUSec = now;
+  if (us < 1000) {
+    // Most scans are shorter than a tick: no division at all.
+    clock.subMs = uint16_t(us);
+    return elapsed;
+  }
+
+  ms = us / 1000;
+  clock.subMs = uint16_t(us - (ms * 1000));
+  elapsed.ms = (ms > 0xFFFF) ? 0xFFFF : uint16_t(ms);
+
+  ms += clock.subSecond;
+  if (ms >= 1000) {
+    uint32_t s = ms / 1000;
+    ms -= s * 1000;
+    elapsed.s = uint16_t(s);
+  }
+  clock.subSecond = uint16_t(ms);
+
+  return elapsed;
+}
+
+uint16_t timepassed(uint16_t timeLeft, uint16_t elapsed) {
+  /*******   Evaluate the difference, do not allow negative-overflow.   *******/
+  // Evaluate Time Remaining, 0 as an absolute minimum.
+  if (elapsed < timeLeft) {
+    timeLeft -= elapsed;
+  } else {
+    timeLeft = 0;
+  }
+
+  return timeLeft;
+}
+
+bool qualifyAnalog(FilterState &filter, uint16_t reading) {
+  /*******   Qualify analog input to determine motion sensor pickup.    *******/
+  return qualifyAnalog(filter, c_FILTER_PARAMS, reading);
+}
+
+bool qualifyAnalog(FilterState &filter, const FilterParams &params,
+                   uint16_t reading) {
+  /*******     Fixed-point reference for the motion qualifying filter.  *******/
+  // Collect This Sample (past the median prefilter, if enabled)
+  uint8_t sample = uint8_t(medianPush(filter.median, reading));
+  uint8_t average = 0;
+  uint8_t floor;
+  bool detect;
+
+  // Evaluate Average
+  if (params.averaging) {
+    average = uint8_t(filter.total / FILTER_LENGTH);
+  }
+
+  // Run Sample through Filter
+  sample = uint8_t(
+    ((uint16_t(average) * params.iirCoef) +
+     (uint16_t(sample) * (256 - params.iirCoef))) >> 8
+  );
+
+  // Load the Most Recent Sample
+  filter.total -= filter.readings[filter.readingIndex];
+  filter.total += sample;
+  filter.readings[filter.readingIndex] = sample;
+
+  // Update Index
+  if (filter.readingIndex >= (FILTER_LENGTH - 1)) {
+    filter.readingIndex = 0;
+  } else {
+    filter.readingIndex++;
+  }
+
+  // Compare Sample to Average - If Sample is > N*average: Spike Detected
+  floor = (average > params.minThreshold) ? average : params.minThreshold;
+  detect = sample > (uint16_t(params.multiplier) * floor);
+
+  filter.average = average;
+  filter.sample = sample;
+  filter.floor = floor;
+
+  return detect;
+}
+
+static inline uint16_t tickUp(uint16_t time, uint16_t elapsed) {
+  return (elapsed < uint16_t(0xFFFF - time)) ? time + elapsed : 0xFFFF;
+}
+
+motionEvent qualifyMotion(DetectorState &det, const DetectorParams &params,
+                          const FilterState &filter, bool detect,
+                          uint16_t elapsedMs) {
+  /*******   Turn per-sample detections into motion start/end edges.    *******/
+  bool above;
+
+  // Assert on the spike threshold, sustain on the lower release threshold.
+  if (det.active) {
+    above = filter.sample > (uint16_t(params.releaseMultiplier) * filter.floor);
+  } else {
+    above = detect;
+  }
+
+  if (above) {
+    det.active = true;
+    det.activeMs = tickUp(det.activeMs, elapsedMs);
+    det.quietMs = 0;
+  } else if (det.active) {
+    // Hold through short drop-outs
+    det.quietMs = tickUp(det.quietMs, elapsedMs);
+    if (det.quietMs >= params.holdMs) {
+      det.active = false;
+      det.activeMs = 0;
+      det.quietMs = 0;
+    }
+  }
+
+  // Report Edges
+  if (!det.motion && det.active && (det.activeMs >= params.qualifyMs)) {
+    det.motion = true;
+    return motionEvent::MOTION_START;
+  }
+  if (det.motion && !det.active) {
+    det.motion = false;
+    return motionEvent::MOTION_END;
+  }
+  return motionEvent::MOTION_NONE;
+}
+
+presenceEvent trackPresence(PresenceState &pres, const PresenceParams &params,
+                            motionEvent motion, uint16_t elapsedS) {
+  /*******   Hold the box occupied until activity has been quiet.      *******/
+  bool left = false;
+
+  if (motion == motionEvent::MOTION_START) {
+    pres.vacantIn = 0; // Activity resumed; not leaving after all.
+    if (!pres.occupied) {
+      pres.occupied = true;
+      pres.occupancyLeft = params.maxOccupiedS;
+      return presenceEvent::PRESENCE_ARRIVED;
+    }
+    return presenceEvent::PRESENCE_NONE;
+  }
+  if (!pres.occupied) {
+    return presenceEvent::PRESENCE_NONE;
+  }
+
+  // Count the Quiet Period once Motion Ends
+  if (motion == motionEvent::MOTION_END) {
+    pres.vacantIn = params.vacantS;
+    left = (pres.vacantIn == 0);
+  } else if (pres.vacantIn > 0) {
+    pres.vacantIn = timepassed(pres.vacantIn, elapsedS);
+    left = (pres.vacantIn == 0);
+  }
+
+  // Never Wait Forever
+  pres.occupancyLeft = timepassed(pres.occupancyLeft, elapsedS);
+  if (left || (pres.occupancyLeft == 0)) {
+    pres.occupied = false;
+    pres.vacantIn = 0;
+    pres.occupancyLeft = 0;
+    return presenceEvent::PRESENCE_LEFT;
+  }
+  return presenceEvent::PRESENCE_NONE;
+}
+
+bool blink(BlinkState &blinker, uint16_t blinkPeriodMs, uint16_t elapsedMs) {
+  /*******   Blink the LED at a specified period of milliseconds.       *******/
+  return blink(blinker, c_BLINK_ON_MS, blinkPeriodMs, elapsedMs);
+}
+
+bool blink(BlinkState &blinker, uint16_t onMs, uint16_t offMs,
+           uint16_t elapsedMs) {
+  /*******     Blink the LED with the given on and off times.          *******/
+  // Deduct the time that has passed since last scan.
+  blinker.msRemaining = timepassed(blinker.msRemaining, elapsedMs);
+
+  if (blinker.msRemaining == 0) {
+    // Change State of LED
+    if (!blinker.ledOn) {
+      blinker.ledOn = true;
+
+      // Short Period
+      blinker.msRemaining = onMs;
+    } else {
+      blinker.ledOn = false;
+
+      // Reset/Update Blink Frequency
+      blinker.msRemaining = offMs;
+    }
+  }
+
+  return blinker.ledOn;
+}
+
+void rateReset(RateLimiter &rate, const RateParams &params) {
+  /*******     Fill the bucket; the suppressed count is left alone.     *******/
+  rate.tokens = params.burst;
+  rate.refillIn = 0;
+  rate.refused = false;
+}
+
+void rateTick(RateLimiter &rate, const RateParams &params, uint16_t elapsedMs) {
+  /*******    Earn tokens back for the time passed, in constant time.   *******/
+  if ((rate.tokens >= params.burst) || (params.refillMs == 0)) {
+    rate.tokens = params.burst; // Full (or the burst was lowered).
+    rate.refillIn = 0;
+    return;
+  }
+  if (elapsedMs < rate.refillIn) {
+    // Most scans fall between tokens.
+    rate.refillIn -= elapsedMs;
+    return;
+  }
+
+  uint16_t over = elapsedMs - rate.refillIn; // Into the next period.
+  uint16_t earned = 1;
+  if (over >= params.refillMs) {
+    // Only after a scan longer than a whole period.
+    earned += over / params.refillMs;
+    over %= params.refillMs;
+  }
+  if (earned >= uint16_t(params.burst - rate.tokens)) {
+    rate.tokens = params.burst;
+    rate.refillIn = 0;
+  } else {
+    rate.tokens += uint8_t(earned);
+    rate.refillIn = params.refillMs - over;
+  }
+}
+
+bool rateTake(RateLimiter &rate, const RateParams &params, bool want) {
+  /*******  Spend a token on a wanted event, or count it as suppressed. *******/
+  // An event held over several scans (a pressed button) counts once.
+  if (!want) {
+    rate.refused = false;
+    return false;
+  }
+  if (params.refillMs == 0) {
+    return true;
+  }
+  if (rate.tokens > 0) {
+    if (rate.tokens >= params.burst) {
+      rate.refillIn = params.refillMs; // Full buckets start refilling now.
+    }
+    rate.tokens--;
+    rate.refused = false;
+    return true;
+  }
+  if (!rate.refused) {
+    rate.refused = true;
+    if (rate.suppressed < 0xFFFF) {
+      rate.suppressed++;
+    }
+  }
+  return false;
+}
+
+uint16_t rateHoldOff(const RateLimiter &rate) {
+  /*******        Time before an event could pass again (ms).           *******/
+  return (rate.tokens > 0) ? 0 : rate.refillIn;
+}
+
+bool healthCheck(HealthState &health, const HealthParams &params,
+                 const uint16_t *samples, uint8_t count, TickElapsed elapsed) {
+  /*******   Incremental sensor checks; true when the faults change.    *******/
+  bool same = health.primed; // Every sample equal to the one before.
+  bool rail = true;          // Every sample at a rail.
+  uint8_t conditions = 0;
+  uint8_t faults = health.faults;
+
+  for (uint8_t n = 0; n < count; n++) {
+    uint16_t sample = samples[n];
+    if (health.primed) {
+      uint16_t step = (sample > health.last) ? sample - health.last :
+                                               health.last - sample;
+      if (step != 0) {
+        same = false;
+      }
+      if ((step > params.maxStep) && (health.steps < 0xFF)) {
+        health.steps++;
+      }
+      // Running mean of small steps (1/16 per sample); large ones clip.
+      int16_t target = int16_t(((step < 63) ? step : 63) << 8);
+      health.meanStepQ8 = uint16_t(int16_t(health.meanStepQ8) +
+                                   ((target - int16_t(health.meanStepQ8)) >> 4));
+    }
+    if ((sample >= params.railLow) && (sample <= params.railHigh)) {
+      rail = false;
+    }
+    health.last = sample;
+    health.primed = true;
+  }
+
+  // Conditions Must Persist (time-based, independent of the sample rate)
+  health.stuckS = same ? tickUp(health.stuckS, elapsed.s) : 0;
+  health.railMs = (rail && count) ? tickUp(health.railMs, elapsed.ms) : 0;
+  health.flatS = (health.meanStepQ8 < params.flatQ8) ?
+                 tickUp(health.flatS, elapsed.s) : 0;
+  health.steps = (elapsed.s < health.steps) ? health.steps - elapsed.s : 0;
+
+  if (health.stuckS >= params.stuckS) conditions |= HEALTH_STUCK;
+  if (health.railMs >= params.railMs) conditions |= HEALTH_RAIL;
+  if (health.flatS >= params.flatS) conditions |= HEALTH_FLAT;
+  if (health.steps >= params.stepLimit) conditions |= HEALTH_STEPS;
+
+  // Raise at once; clear only after a healthy stretch.
+  if (conditions) {
+    faults |= conditions;
+    health.recoverIn = params.recoverS;
+  } else if (faults) {
+    health.recoverIn = timepassed(health.recoverIn, elapsed.s);
+    if (health.recoverIn == 0) {
+      faults = 0;
+    }
+  }
+
+  if (faults == health.faults) {
+    return false;
+  }
+  health.faults = faults;
+  return true;
+}
+
+const char *healthFaultName(healthFault fault) {
+  /*******          Human-readable name of a sensor fault.             *******/
+  switch (fault) {
+    case HEALTH_STUCK: return "STUCK";
+    case HEALTH_RAIL:  return "RAIL";
+    case HEALTH_FLAT:  return "FLAT";
+    case HEALTH_STEPS: return "STEPS";
+  }
+  return "UNKNOWN";
+}
+
+void learnDefaults(LearnState &learn, const FilterParams &home) {
+  /*******       Factory sensitivity; nothing pending, nothing to save. *******/
+  learn.thresholdQ4 = uint16_t(home.minThreshold) * 16;
+  learn.multiplier = home.multiplier;
+  learn.cancelIn = 0;
+  learn.decayIn = 0;
+  learn.saveIn = 0;
+  learn.dirty = false;
+}
+
+bool learnFeedback(LearnState &learn, const LearnParams &params,
+                   learnEvent event) {
+  /*******   Nudge the detection level one step; false if pinned.      *******/
+  uint16_t threshold = learn.thresholdQ4;
+  uint8_t multiplier = learn.multiplier;
+
+  if (event == learnEvent::LEARN_MISSED) {
+    // More sensitive: threshold down first, then the multiplier.
+    if (threshold > params.minThresholdQ4) {
+      threshold = (threshold - params.minThresholdQ4 > params.stepQ4) ?
+                  threshold - params.stepQ4 : params.minThresholdQ4;
+    } else if (multiplier > params.minMultiplier) {
+      multiplier--;
+    }
+  } else if (event == learnEvent::LEARN_FALSE) {
+    // Less sensitive: threshold up first, then the multiplier.
+    if (threshold < params.maxThresholdQ4) {
+      threshold = (params.maxThresholdQ4 - threshold > params.stepQ4) ?
+                  threshold + params.stepQ4 : params.maxThresholdQ4;
+    } else if (multiplier < params.maxMultiplier) {
+      multiplier++;
+    }
+  }
+
+  if ((threshold == learn.thresholdQ4) && (multiplier == learn.multiplier)) {
+    return false;
+  }
+  learn.thresholdQ4 = threshold;
+  learn.multiplier = multiplier;
+  learn.decayIn = params.decayS; // Fresh feedback restarts the decay.
+  learn.saveIn = params.saveS;
+  learn.dirty = true;
+  return true;
+}
+
+bool learnTick(LearnState &learn, const LearnParams &params,
+               const FilterParams &home, uint16_t elapsedS) {
+  /*******  Age feedback windows and decay; true when a save is due.    *******/
+  const uint16_t homeQ4 = uint16_t(home.minThreshold) * 16;
+
+  learn.cancelIn = timepassed(learn.cancelIn, elapsedS);
+
+  // Step back toward the defaults: threshold first, multiplier last.
+  if ((learn.thresholdQ4 != homeQ4) ||
+      (learn.multiplier != home.multiplier)) {
+    if (learn.decayIn == 0) {
+      learn.decayIn = params.decayS;
+    } else {
+      learn.decayIn = timepassed(learn.decayIn, elapsedS);
+      if (learn.decayIn == 0) {
+        if (learn.thresholdQ4 < homeQ4) {
+          learn.thresholdQ4++;
+        } else if (learn.thresholdQ4 > homeQ4) {
+          learn.thresholdQ4--;
+        } else if (learn.multiplier < home.multiplier) {
+          learn.multiplier++;
+        } else {
+          learn.multiplier--;
+        }
+        learn.dirty = true;
+        if (learn.saveIn == 0) {
+          learn.saveIn = params.saveS;
+        }
+      }
+    }
+  } else {
+    learn.decayIn = 0;
+  }
+
+  // Persist once the values have settled for a while.
+  if (learn.saveIn > 0) {
+    learn.saveIn = timepassed(learn.saveIn, elapsedS);
+    if ((learn.saveIn == 0) && learn.dirty) {
+      return true;
+    }
+  }
+  return false;
+}
+
+FilterParams learnedFilter(const LearnState &learn, const FilterParams &base) {
+  /*******      Filter parameters with the learned sensitivity.        *******/
+  FilterParams params = base;
+  params.minThreshold = uint8_t(learn.thresholdQ4 >> 4);
+  params.multiplier = learn.multiplier;
+  return params;
+}
+
+static uint8_t learnCheck(const LearnRecord &record) {
+  return uint8_t(~(record.version ^ uint8_t(record.thresholdQ4) ^
+                   uint8_t(record.thresholdQ4 >> 8) ^ record.multiplier));
+}
+
+void learnStore(LearnState &learn, LearnRecord &record) {
+  /*******      Fill the EEPROM image; the values are saved now.       *******/
+  record.version = LEARN_RECORD_VERSION;
+  record.thresholdQ4 = learn.thresholdQ4;
+  record.multiplier = learn.multiplier;
+  record.check = learnCheck(record);
+  learn.dirty = false;
+}
+
+bool learnRestore(LearnState &learn, const LearnParams &params,
+                  const LearnRecord &record) {
+  /*******  Adopt saved values only if intact and within the bounds.   *******/
+  if ((record.version != LEARN_RECORD_VERSION) ||
+      (record.check != learnCheck(record)) ||
+      (record.thresholdQ4 < params.minThresholdQ4) ||
+      (record.thresholdQ4 > params.maxThresholdQ4) ||
+      (record.multiplier < params.minMultiplier) ||
+      (record.multiplier > params.maxMultiplier)) {
+    return false;
+  }
+  learn.thresholdQ4 = record.thresholdQ4;
+  learn.multiplier = record.multiplier;
+  learn.dirty = false;
+  return true;
+}
+
+bool profileValid(const ControllerProfile &profile, const LearnParams &learn) {
+  /*******  Settings the controller can run on (and learn from) safely. *******/
+  uint16_t thresholdQ4 = uint16_t(profile.filter.minThreshold) * 16;
+  return (profile.delayS > 0) && (profile.runS > 0) &&
+         (profile.filter.iirCoef <= 256) &&
+         (thresholdQ4 >= learn.minThresholdQ4) &&
+         (thresholdQ4 <= learn.maxThresholdQ4) &&
+         (profile.filter.multiplier >= learn.minMultiplier) &&
+         (profile.filter.multiplier <= learn.maxMultiplier) &&
+         (profile.detector.releaseMultiplier > 0) &&
+         (profile.detector.releaseMultiplier <= profile.filter.multiplier) &&
+         (profile.presence.vacantS > 0) &&
+         (profile.presence.maxOccupiedS > profile.presence.vacantS);
+}
+
+static uint8_t recordCheck(const uint8_t *bytes, uint16_t length) {
+  uint8_t check = 0;
+  for (uint16_t n = 0; n < length; n++) {
+    check ^= bytes[n];
+  }
+  return uint8_t(~check);
+}
+
+void profileStore(const ControllerProfile &profile, ProfileRecord &record) {
+  /*******                  Fill the EEPROM image.                     *******/
+  record.version = PROFILE_RECORD_VERSION;
+  record.profile = profile;
+  record.check = recordCheck(reinterpret_cast<const uint8_t *>(&record),
+                             offsetof(ProfileRecord, check));
+}
+
+bool profileRestore(ControllerProfile &profile, const LearnParams &learn,
+                    const ProfileRecord &record) {
+  /*******       Adopt a saved profile only if intact and sane.        *******/
+  if ((record.version != PROFILE_RECORD_VERSION) ||
+      (record.check != recordCheck(reinterpret_cast<const uint8_t *>(&record),
+                                   offsetof(ProfileRecord, check))) ||
+      !profileValid(record.profile, learn)) {
+    return false;
+  }
+  profile = record.profile;
+  return true;
+}
+
+void snapshotStore(const ControllerState &ctrl, uint8_t profileIndex,
+                   ControllerSnapshot &snap) {
+  /*******          Copy out every byte of controller state.            *******/
+  memset(&snap, 0, sizeof(snap));
+  snap.version = SNAPSHOT_RECORD_VERSION;
+  snap.stateBytes = sizeof(ControllerState);
+  snap.profileIndex = profileIndex;
+  snap.profile = *ctrl.profile;
+  memcpy(&snap.ctrl, &ctrl, sizeof(ctrl));
+  snap.ctrl.profile = nullptr;
+  snap.check = recordCheck(reinterpret_cast<const uint8_t *>(&snap),
+                           offsetof(ControllerSnapshot, check));
+}
+
+static bool rawAtMost(const void *field, uint8_t size, uint32_t most) {
+  /*******   A field's stored value in range, read as plain bytes.     *******/
+  uint32_t value = 0; // Both targets are little-endian.
+  memcpy(&value, field, size);
+  return value <= most;
+}
+
+static bool snapshotSane(const ControllerSnapshot &snap) {
+  /*******   Every bool, enum and bit set holds a value it can take.   *******/
+  const ControllerState &c = snap.ctrl;
+  const bool *flags[] = {
+    &snap.profile.filter.averaging, &c.motionRate.refused,
+    &c.manualRate.refused, &c.detector.active, &c.detector.motion,
+    &c.motionPending, &c.manualPending, &c.presence.occupied, &c.fanRunning, &c.learn.dirty,
+    &c.health.primed, &c.blink.ledOn
+  };
+  for (const bool *flag : flags) {
+    if (!rawAtMost(flag, sizeof(bool), 1)) {
+      return false;
+    }
+  }
+  return rawAtMost(&c.state, sizeof(c.state), controlState::RESET) &&
+         (c.health.faults <= 2 * HEALTH_STEPS - 1) &&
+         (c.filter.readingIndex < FILTER_LENGTH) &&
+         (c.filter.median.index < MEDIAN_TAPS);
+}
+
+bool snapshotRestore(ControllerState &ctrl,
+                     ControllerProfile (&profiles)[PROFILE_COUNT],
+                     const LearnParams &learn, const ControllerSnapshot &snap,
+                     uint32_t now) {
+  /*******   Adopt a snapshot only if intact, from this build and sane. *******/
+  if ((snap.version != SNAPSHOT_RECORD_VERSION) ||
+      (snap.stateBytes != sizeof(ControllerState)) ||
+      (snap.check != recordCheck(reinterpret_cast<const uint8_t *>(&snap),
+                                 offsetof(ControllerSnapshot, check))) ||
+      (snap.profileIndex >= PROFILE_COUNT) ||
+      !snapshotSane(snap) || !profileValid(snap.profile, learn)) {
+    return false;
+  }
+  profiles[snap.profileIndex] = snap.profile;
+  ctrl = snap.ctrl;
+  ctrl.profile = &profiles[snap.profileIndex];
+  ctrl.clock.lastUSec = now; // Its clock was another unit's.
+  ctrl.learn.dirty = false;  // So are its learned values: never save them.
+  ctrl.learn.saveIn = 0;
+  return true;
+}
+
+void controllerScan(ControllerState &ctrl, const ScanInputs &in,
+                    ScanOutputs &out) {
+  /*******      Evaluate one scan of the fan control state machine.     *******/
+  controlState nextState = ctrl.state; // Next state system will operate in.
+  motionEvent motion = motionEvent::MOTION_NONE; // Detector edge.
+  presenceEvent presence; // Visit edge.
+  bool detect = false; // Instantaneous Motion detection.
+  learnEvent feedback = learnEvent::LEARN_NONE; // Button as ground truth.
+  TickElapsed elapsed = tickAdvance(ctrl.clock, in.now); // Time since last.
+  const ControllerProfile &profile = *ctrl.profile; // Settings this scan.
+  const RateParams motionBudget = {MOTION_BURST, profile.blockDetectionMs};
+
+  out.delayMs = 0;
+  out.handled = ctrl.state;
+
+  // Check the Sensor Itself; a Fault Replaces Detection with Timed Runs
+  bool wasHealthy = (ctrl.health.faults == 0);
+  out.faultsChanged = healthCheck(ctrl.health, c_HEALTH_PARAMS, in.samples,
+                                  SAMPLE_BLOCK, elapsed);
+  out.faults = ctrl.health.faults;
+  if (wasHealthy && ctrl.health.faults) {
+    // Forget any visit in progress; the sensor can no longer end it.
+    if (ctrl.detector.motion) {
+      motion = motionEvent::MOTION_END; // Close the edge pair.
+    }
+    memset(&ctrl.detector, 0, sizeof(ctrl.detector));
+    memset(&ctrl.presence, 0, sizeof(ctrl.presence));
+    ctrl.motionPending = false;
+    ctrl.timeRemaining = 0;
+    ctrl.fallbackIn = c_FALLBACK_S;
+  }
+
+  // Read and Qualify Motion Input (at the learned sensitivity)
+  if ((ctrl.blockMotionIn == 0) && (ctrl.health.faults == 0)) {
+    FilterParams params = learnedFilter(ctrl.learn, profile.filter);
+    detect = qualifyAnalogBlock<SAMPLE_BLOCK>(ctrl.filter, params,
+                                              in.samples) > 0;
+    motion = qualifyMotion(ctrl.detector, profile.detector, ctrl.filter,
+                           detect, elapsed.ms);
+  }
+  out.detect = detect;
+  out.motion = motion;
+  if (motion == motionEvent::MOTION_START) {
+    // Held for IDLE: an edge seen by a transient state is not lost.
+    ctrl.motionPending = true;
+  }
+  if (in.manualActivate) {
+    // Likewise a button press, whatever state it arrives in.
+    ctrl.manualPending = true;
+  }
+
+  // Decrement timers as needed.
+  if (ctrl.timeRemaining > 0) {
+    // Subtract the Time-Delta, Ensuring 0 is the minimum viable time value.
+    ctrl.timeRemaining = timepassed(ctrl.timeRemaining, elapsed.s);
+
+    // Monitor for Timer Elapse
+    if (ctrl.timeRemaining == 0) {
+      // Move to Activate Fan, Immediately
+      nextState = controlState::ACTIVATE;
+      ctrl.learn.cancelIn = c_LEARN_PARAMS.cancelS; // Automatic start.
+    }
+  }
+  rateTick(ctrl.motionRate, motionBudget, elapsed.ms);
+  rateTick(ctrl.manualRate, c_MANUAL_RATE_PARAMS, elapsed.ms);
+  if (ctrl.blockMotionIn > 0) {
+    ctrl.blockMotionIn = timepassed(ctrl.blockMotionIn, elapsed.ms);
+  }
+  if (ctrl.fanTimeRemain > 0) {
+    ctrl.fanTimeRemain = timepassed(ctrl.fanTimeRemain, elapsed.s);
+  }
+  out.saveLearned = learnTick(ctrl.learn, c_LEARN_PARAMS, profile.filter,
+                              elapsed.s);
+  if (ctrl.health.faults) {
+    ctrl.fallbackIn = timepassed(ctrl.fallbackIn, elapsed.s);
+    if (ctrl.fallbackIn == 0) {
+      // Timed Run in Place of Detection
+      ctrl.fallbackIn = c_FALLBACK_S;
+      if (!ctrl.fanRunning) {
+        nextState = controlState::ACTIVATE;
+      }
+    }
+  } else {
+    ctrl.fallbackIn = 0;
+  }
+
+  // Track Visits; the Countdown Waits until the Box is Empty
+  presence = trackPresence(ctrl.presence, profile.presence, motion,
+                           elapsed.s);
+  out.presence = presence;
+  if (presence == presenceEvent::PRESENCE_LEFT) {
+    if (ctrl.fanRunning) {
+      ctrl.fanTimeRemain = profile.runS; // Full run after this visit
+    } else {
+      ctrl.timeRemaining = profile.delayS;
+    }
+  }
+  if (ctrl.presence.occupied) {
+    ctrl.timeRemaining = 0;
+  }
+
+  // Control Blinking Behavior
+  if (ctrl.health.faults) {
+    // Sensor Fault Pattern (overrides the fan indication)
+    blink(ctrl.blink, c_FAULT_BLINK_MS, c_FAULT_BLINK_MS, elapsed.ms);
+  } else if ((!ctrl.fanRunning) && (ctrl.timeRemaining == 0) &&
+      (!ctrl.presence.occupied)) {
+    // Perform Heartbeat Blink
+    blink(ctrl.blink, c_HEARTBEAT_BLINK_MS, elapsed.ms);
+  } else if (!ctrl.fanRunning) {
+    // Perform Waiting Blink
+    blink(ctrl.blink, c_WAITING_BLINK_MS, elapsed.ms);
+  }
+
+  /************************** FINITE STATE MACHINE ****************************/
+  switch (ctrl.state) {
+    case controlState::IDLE: {
+      /**********************      IDLE STATE      ****************************/
+      // Events past their budget are ignored (and counted).
+      bool started = ctrl.motionPending;
+      ctrl.motionPending = false;
+      if (rateTake(ctrl.motionRate, motionBudget, started)) {
+        // Move to the Detected State (a held press waits for the next IDLE)
+        nextState = controlState::DETECTED;
+        break;
+      }
+      bool pressed = ctrl.manualPending;
+      ctrl.manualPending = false;
+      if (rateTake(ctrl.manualRate, c_MANUAL_RATE_PARAMS, pressed)) {
+        if (ctrl.fanRunning) {
+          // Deactivate Fan; right after an automatic start it was false.
+          nextState = controlState::RESET;
+          out.delayMs = profile.blockDetectionMs; // Debounce
+          if (ctrl.learn.cancelIn > 0) {
+            feedback = learnEvent::LEARN_FALSE;
+          }
+        } else {
+          // Move to Activate Fan, Immediately; a visit went unnoticed
+          // unless one is already under way or counting down.
+          nextState = controlState::ACTIVATE;
+          if (!ctrl.presence.occupied && (ctrl.timeRemaining == 0)) {
+            feedback = learnEvent::LEARN_MISSED;
+          }
+        }
+      } else if ((ctrl.fanTimeRemain == 0) && ctrl.fanRunning) {
+        // Move to Deactivate Fan
+        nextState = controlState::RESET;
+      }
+      break;
+      /**********************    END IDLE STATE    ****************************/
+    }
+    case controlState::DETECTED: {
+      /**********************    DETECTED STATE    ****************************/
+      if (ctrl.fanRunning) {
+        // If already running, just move to reset timer for fan runtime
+        nextState = controlState::ACTIVATE;
+      } else if (nextState != controlState::ACTIVATE) {
+        // Otherwise wait for the visit to end (see trackPresence()), unless
+        // a countdown ran out on this very scan.
+        nextState = controlState::IDLE;
+      }
+      break;
+      /**********************  END DETECTED STATE  ****************************/
+    }
+    case controlState::ACTIVATE: {
+      /**********************    ACTIVATE STATE    ****************************/
+      ctrl.fanRunning = true;
+      ctrl.fanTimeRemain = profile.runS; // Set fan runtime to maximum
+      ctrl.blink.ledOn = true;
+
+      // Reset Time Remaining (in case of manual activation)
+      ctrl.timeRemaining = 0;
+
+      nextState = controlState::IDLE;
+      out.delayMs = c_ACTIVATE_DEBOUNCE_MS; // Debounce
+      break;
+      /**********************  END ACTIVATE STATE  ****************************/
+    }
+    case controlState::RESET: {
+      /**********************     RESET STATE      ****************************/
+      ctrl.fanRunning = false;
+      ctrl.fanTimeRemain = 0;
+      ctrl.timeRemaining = 0;
+      ctrl.blockMotionIn = profile.blockMotionMs; // Block Motion Input.
+      ctrl.presence.occupied = false; // Forget the Present Visit
+      ctrl.presence.vacantIn = 0;
+      ctrl.presence.occupancyLeft = 0;
+      ctrl.learn.cancelIn = 0;
+      ctrl.blink.ledOn = false;
+
+      nextState = controlState::IDLE;
+      break;
+      /**********************   END RESET STATE    ****************************/
+    }
+  }
+  /************************ END FINITE STATE MACHINE **************************/
+
+  // Apply Button Feedback to the Learned Sensitivity
+  out.learned = learnEvent::LEARN_NONE;
+  if ((feedback != learnEvent::LEARN_NONE) &&
+      learnFeedback(ctrl.learn, c_LEARN_PARAMS, feedback)) {
+    out.learned = feedback;
+  }
+
+  out.relay = ctrl.fanRunning;
+  out.led = ctrl.blink.ledOn;
+
+  // Move to Next State
+  ctrl.state = nextState;
+}
+
+const char *stateName(controlState state) {
+  /*******          Human-readable name of a controller state.          *******/
+  switch (state) {
+    case controlState::IDLE:     return "IDLE";
+    case controlState::DETECTED: return "DETECTED";
+    case controlState::ACTIVATE: return "ACTIVATE";
+    case controlState::RESET:    return "RESET";
+  }
+  return "UNKNOWN";
+}
@@ -0,0 +1,680 @@
+/*******************************************************************************
+ * ScentAssist - Core Control Logic
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Hardware-independent motion qualification and fan control state
+ *        machine. The firmware feeds each scan's inputs through here and
+ *        applies the resulting outputs to the pins; host tools (simulators,
+ *        analysis) link the very same code so their results carry over.
+ ******************************************************************************/
+
+#ifndef SCENTCORE_H
+#define SCENTCORE_H
+
+#include <stdint.h>
+
+#include "ScentTime.h"
+
+/*************************** GENERAL CONSTANTS ********************************/
+#define FILTER_LENGTH 10 // Seemed Reasonable
+#define MIN_THRESHOLD 20 // Determined by Experimentation
+
+// Motion sensor samples taken and qualified per scan (override per build).
+#ifndef SAMPLE_BLOCK
+#define SAMPLE_BLOCK 1
+#endif
+
+// Median prefilter length ahead of the IIR: 1 (off), 3, 5 or 7 samples.
+#ifndef MEDIAN_TAPS
+#define MEDIAN_TAPS 1
+#endif
+
+// Sensor health levels (override per sensor). A quiet sensor may idle at 0,
+// so by default only the top code counts as a rail; one dead at 0 is stuck.
+#ifndef HEALTH_RAIL_LOW
+#define HEALTH_RAIL_LOW 0     // Readings below this are at the bottom rail.
+#endif
+#ifndef HEALTH_RAIL_HIGH
+#define HEALTH_RAIL_HIGH 1022 // Readings above this are at the top rail.
+#endif
+#ifndef HEALTH_FLAT_Q8
+#define HEALTH_FLAT_Q8 32     // Mean |step| (Q8 LSB) below this is flat.
+#endif
+#ifndef HEALTH_MAX_STEP
+#define HEALTH_MAX_STEP 512   // A larger step between samples is implausible.
+#endif
+#ifndef HEALTH_STEP_LIMIT
+#define HEALTH_STEP_LIMIT 20  // Implausible steps (leaking 1/s) for a fault.
+#endif
+
+/***************************** TIME CONSTANTS *********************************/
+constexpr Duration c_DELAY_TIME = 1_min;         // After the box is vacated.
+constexpr Duration c_RUN_TIME = 8_min;
+constexpr Duration c_VACANT_TIME = 30_s;         // Quiet before box is empty.
+constexpr Duration c_MAX_OCCUPIED_TIME = 20_min; // Stop waiting on a visit.
+constexpr Duration c_HEARTBEAT_BLINK_TIME = 5_s;
+constexpr Duration c_BLOCK_DETECTION_DELAY = 3_s;
+constexpr Duration c_BLOCK_MOTION_TIME = 5 * c_BLOCK_DETECTION_DELAY;
+constexpr Duration c_WAITING_BLINK_TIME = 100_ms;
+constexpr Duration c_MOTION_QUALIFY_TIME = 700_ms;
+constexpr Duration c_MOTION_HOLD_TIME = 1_s;
+constexpr Duration c_BLINK_ON_TIME = 100_ms;
+constexpr Duration c_ACTIVATE_DEBOUNCE = 350_ms;
+constexpr Duration c_LEARN_CANCEL_TIME = 2_min;  // Cancel = false trigger.
+constexpr Duration c_LEARN_DECAY_TIME = 1_h;     // Per step back to defaults.
+constexpr Duration c_LEARN_SAVE_TIME = 10_min;   // Settle before EEPROM write.
+constexpr Duration c_STUCK_TIME = 10_min;        // Identical samples.
+constexpr Duration c_RAIL_TIME = 5_s;            // Samples pinned at a rail.
+constexpr Duration c_FLAT_TIME = 30_min;         // Noise gone from the signal.
+constexpr Duration c_HEALTH_RECOVER_TIME = 30_s; // Healthy before fault clears.
+constexpr Duration c_FALLBACK_PERIOD = 4_h;      // Timed runs without a sensor.
+constexpr Duration c_FAULT_BLINK_TIME = 1_s;     // Fault pattern on and off.
+constexpr Duration c_MANUAL_REFILL_TIME = 5_s;   // Per button event earned.
+const uint16_t c_IIR_COEF_Q8 = 102;              // 0.40 (Q8, 256 = 1.0)
+
+/*************************** TIMER RELOAD VALUES ******************************/
+// Each timer counts in the coarsest timebase that resolves what it measures.
+const uint16_t c_DELAY_S = TicksOf<SecondTicks, c_DELAY_TIME.us>::value;
+const uint16_t c_RUN_S = TicksOf<SecondTicks, c_RUN_TIME.us>::value;
+const uint16_t c_VACANT_S = TicksOf<SecondTicks, c_VACANT_TIME.us>::value;
+const uint16_t c_MAX_OCCUPIED_S =
+  TicksOf<SecondTicks, c_MAX_OCCUPIED_TIME.us>::value;
+const uint16_t c_HEARTBEAT_BLINK_MS =
+  TicksOf<MilliTicks, c_HEARTBEAT_BLINK_TIME.us>::value;
+const uint16_t c_BLOCK_DETECTION_MS =
+  TicksOf<MilliTicks, c_BLOCK_DETECTION_DELAY.us>::value;
+const uint16_t c_BLOCK_MOTION_MS =
+  TicksOf<MilliTicks, c_BLOCK_MOTION_TIME.us>::value;
+const uint16_t c_WAITING_BLINK_MS =
+  TicksOf<MilliTicks, c_WAITING_BLINK_TIME.us>::value;
+const uint16_t c_MOTION_QUALIFY_MS =
+  TicksOf<MilliTicks, c_MOTION_QUALIFY_TIME.us>::value;
+const uint16_t c_MOTION_HOLD_MS =
+  TicksOf<MilliTicks, c_MOTION_HOLD_TIME.us>::value;
+const uint16_t c_BLINK_ON_MS = TicksOf<MilliTicks, c_BLINK_ON_TIME.us>::value;
+const uint16_t c_ACTIVATE_DEBOUNCE_MS =
+  TicksOf<MilliTicks, c_ACTIVATE_DEBOUNCE.us>::value;
+const uint16_t c_LEARN_CANCEL_S =
+  TicksOf<SecondTicks, c_LEARN_CANCEL_TIME.us>::value;
+const uint16_t c_LEARN_DECAY_S =
+  TicksOf<SecondTicks, c_LEARN_DECAY_TIME.us>::value;
+const uint16_t c_LEARN_SAVE_S =
+  TicksOf<SecondTicks, c_LEARN_SAVE_TIME.us>::value;
+const uint16_t c_STUCK_S = TicksOf<SecondTicks, c_STUCK_TIME.us>::value;
+const uint16_t c_RAIL_MS = TicksOf<MilliTicks, c_RAIL_TIME.us>::value;
+const uint16_t c_FLAT_S = TicksOf<SecondTicks, c_FLAT_TIME.us>::value;
+const uint16_t c_HEALTH_RECOVER_S =
+  TicksOf<SecondTicks, c_HEALTH_RECOVER_TIME.us>::value;
+const uint16_t c_FALLBACK_S =
+  TicksOf<SecondTicks, c_FALLBACK_PERIOD.us>::value;
+const uint16_t c_FAULT_BLINK_MS =
+  TicksOf<MilliTicks, c_FAULT_BLINK_TIME.us>::value;
+const uint16_t c_MANUAL_REFILL_MS =
+  TicksOf<MilliTicks, c_MANUAL_REFILL_TIME.us>::value;
+
+/*************************** STATE ENUMERATIONS *******************************/
+enum controlState {
+  IDLE = 0,
+  DETECTED,
+  ACTIVATE,
+  RESET
+};
+
+enum motionEvent {
+  MOTION_NONE = 0,
+  MOTION_START,
+  MOTION_END
+};
+
+enum presenceEvent {
+  PRESENCE_NONE = 0,
+  PRESENCE_ARRIVED,
+  PRESENCE_LEFT
+};
+
+enum healthFault {
+  HEALTH_STUCK = 0x01,   // The same value, sample after sample.
+  HEALTH_RAIL = 0x02,    // Pinned at the bottom or top of the ADC range.
+  HEALTH_FLAT = 0x04,    // Too little noise for a live sensor.
+  HEALTH_STEPS = 0x08    // Full-scale jumps too often (loose connection).
+};
+
+enum learnEvent {
+  LEARN_NONE = 0,
+  LEARN_MISSED,        // Fan started by hand with nothing detected.
+  LEARN_FALSE          // Automatic start cancelled by hand right away.
+};
+
+/***************************** FILTER PARAMETERS ******************************/
+struct FilterParams {
+  uint16_t iirCoef;     // Weight of the average in the IIR filter (Q8).
+  uint8_t minThreshold; // Floor applied to the average before scaling.
+  uint8_t multiplier;   // Sample must exceed multiplier * floored average.
+  bool averaging;       // Include the FILTER_LENGTH moving average.
+};
+
+// The original averaging loop never executed (condition and increment were
+// swapped), so MIN_THRESHOLD was tuned with the average held at zero.
+const FilterParams c_FILTER_PARAMS = {c_IIR_COEF_Q8, MIN_THRESHOLD, 4, false};
+
+/**************************** DETECTOR PARAMETERS *****************************/
+// Activity asserts when the filter flags a spike (FilterParams::multiplier)
+// and releases only once the sample has stayed at or below the lower release
+// threshold for the hold time, so samples near either threshold cannot
+// chatter. Motion starts after enough time above the release threshold.
+struct DetectorParams {
+  uint8_t releaseMultiplier; // Activity continues while sample > this * floor.
+  uint16_t qualifyMs;        // Activity required before motion starts.
+  uint16_t holdMs;           // Quiet required before activity ends.
+};
+
+const DetectorParams c_DETECTOR_PARAMS = {
+  2, c_MOTION_QUALIFY_MS, c_MOTION_HOLD_MS
+};
+
+/**************************** PRESENCE PARAMETERS *****************************/
+// The box is occupied from a motion start until activity has stayed quiet
+// for vacantS; only then does the countdown to the fan begin. A visit that
+// never goes quiet (or a sensor stuck active) is ended after maxOccupiedS.
+struct PresenceParams {
+  uint16_t vacantS;          // Quiet period after motion ends.
+  uint16_t maxOccupiedS;     // Longest a single visit may hold off the fan.
+};
+
+const PresenceParams c_PRESENCE_PARAMS = {c_VACANT_S, c_MAX_OCCUPIED_S};
+
+/****************************** HEALTH PARAMETERS *****************************/
+// A dead sensor reads as "no motion", so each sample is also checked for
+// signs of one. Each check is a fault on its own. A live sensor, however
+// quiet, still moves by a code now and then, so the stuck and flat checks
+// wait minutes rather than seconds. Any fault stops motion qualification
+// and starts timed fan runs instead; it clears once no check has fired for
+// recoverS.
+struct HealthParams {
+  uint16_t stuckS;           // Identical samples this long: stuck-at.
+  uint16_t railLow;          // Samples below / above these are at a rail,
+  uint16_t railHigh;         //   and all of them ...
+  uint16_t railMs;           //   ... this long: saturated.
+  uint16_t flatQ8;           // Mean |step| below this (Q8 LSB) ...
+  uint16_t flatS;            //   ... this long: variance collapse.
+  uint16_t maxStep;          // A larger step between samples is implausible.
+  uint8_t stepLimit;         // Implausible steps (leaking 1/s) before a fault.
+  uint16_t recoverS;         // Healthy this long before a fault clears.
+};
+
+const HealthParams c_HEALTH_PARAMS = {
+  c_STUCK_S, HEALTH_RAIL_LOW, HEALTH_RAIL_HIGH, c_RAIL_MS, HEALTH_FLAT_Q8,
+  c_FLAT_S, HEALTH_MAX_STEP, HEALTH_STEP_LIMIT, c_HEALTH_RECOVER_S
+};
+
+/**************************** LEARNING PARAMETERS *****************************/
+// The pushbutton doubles as ground truth. A missed visit lowers the learned
+// threshold a step and a false trigger raises it; once the threshold sits at
+// a bound the multiplier moves instead, so the detection level stays
+// monotonic. Every decay period the values step back toward the factory
+// defaults, so stray feedback fades unless it keeps recurring.
+struct LearnParams {
+  uint16_t minThresholdQ4;   // Bounds of the learned threshold (Q4).
+  uint16_t maxThresholdQ4;
+  uint8_t minMultiplier;     // Bounds of the learned multiplier.
+  uint8_t maxMultiplier;
+  uint16_t stepQ4;           // Threshold change per feedback event.
+  uint16_t decayS;           // Time per Q4 step back toward the defaults.
+  uint16_t cancelS;          // How soon a cancel counts as a false trigger.
+  uint16_t saveS;            // Quiet time before a change is persisted.
+};
+
+const LearnParams c_LEARN_PARAMS = {
+  (MIN_THRESHOLD / 2) * 16, (MIN_THRESHOLD * 2) * 16, 2, 8, 16,
+  c_LEARN_DECAY_S, c_LEARN_CANCEL_S, c_LEARN_SAVE_S
+};
+
+/*************************** RATE LIMIT PARAMETERS ****************************/
+// A token bucket: each accepted event spends a token, one is earned back per
+// refill period and at most `burst` are banked. Motion starts and button
+// presses draw on separate buckets, so a chattering sensor cannot lock out
+// the button (or a held button spend the motion budget). A refill of zero
+// leaves the events unlimited.
+#ifndef MOTION_BURST
+#define MOTION_BURST 1 // One start per hold-off, as stopDetection was.
+#endif
+
+#ifndef MANUAL_BURST
+#define MANUAL_BURST 2 // On and straight back off again.
+#endif
+
+struct RateParams {
+  uint8_t burst;             // Tokens banked when the bucket is full.
+  uint16_t refillMs;         // Time to earn back one token.
+};
+
+// Motion starts refill over the profile's blockDetectionMs instead.
+const RateParams c_MANUAL_RATE_PARAMS = {MANUAL_BURST, c_MANUAL_REFILL_MS};
+
+/**************************** PROFILE PARAMETERS ******************************/
+// Everything a household might want tuned, in one block. The controller
+// reads these through ControllerState::profile, so switching households is
+// a pointer assignment; timers already running finish on the old values.
+#define PROFILE_NAME_LENGTH 8
+#define PROFILE_COUNT 4
+
+struct ControllerProfile {
+  char name[PROFILE_NAME_LENGTH]; // NUL-padded; not always NUL-terminated.
+  uint16_t delayS;           // Countdown to the fan once the box is empty.
+  uint16_t runS;             // Fan run time.
+  uint16_t blockDetectionMs; // Detection ignored after each start.
+  uint16_t blockMotionMs;    // Sensor ignored after the fan stops.
+  FilterParams filter;       // Factory sensitivity (learning starts here).
+  DetectorParams detector;
+  PresenceParams presence;
+};
+
+// One cat, several cats, a kitten (lighter, quicker) and a senior (slower,
+// longer visits). The first is the original fixed configuration.
+extern const ControllerProfile c_FACTORY_PROFILES[PROFILE_COUNT];
+
+// A profile as kept in EEPROM. Erased memory fails the version check.
+struct ProfileRecord {
+  uint8_t version;
+  ControllerProfile profile;
+  uint8_t check;           // Complement of the XOR of the bytes above.
+};
+
+#define PROFILE_RECORD_VERSION 1
+
+/***************************** STATE STRUCTURES *******************************/
+template <uint8_t K>
+struct MedianWindow {
+  uint16_t recent[K];              // Last K raw readings.
+  uint8_t index;                   // Next slot of recent[] to overwrite.
+};
+
+struct FilterState {
+  MedianWindow<MEDIAN_TAPS> median; // Median prefilter history.
+  uint8_t readings[FILTER_LENGTH]; // Filtered sample history.
+  uint8_t readingIndex;            // Next slot to be overwritten.
+  uint16_t total;                  // Running sum of readings[].
+  uint8_t average;                 // Most recent average (for debugging).
+  uint8_t sample;                  // Largest filtered sample of last call.
+  uint8_t floor;                   // Most recent comparison floor.
+};
+
+struct DetectorState {
+  bool active;             // Comparator output, with hysteresis and hold.
+  bool motion;             // Between MOTION_START and MOTION_END.
+  uint16_t activeMs;       // Time above the release threshold while active.
+  uint16_t quietMs;        // Time at or below it while active.
+};
+
+struct PresenceState {
+  bool occupied;           // Between PRESENCE_ARRIVED and PRESENCE_LEFT.
+  uint16_t vacantIn;       // Quiet time left before the box is empty (s).
+  uint16_t occupancyLeft;  // Time left before the visit is ended anyway (s).
+};
+
+struct HealthState {
+  uint16_t last;           // Previous sample.
+  bool primed;             // `last` holds a real sample.
+  uint16_t meanStepQ8;     // Running mean of |step| (Q8, small steps only).
+  uint16_t stuckS;         // Time every sample has equalled the last.
+  uint16_t railMs;         // Time every sample has sat at a rail.
+  uint16_t flatS;          // Time the mean step has been below flatQ8.
+  uint8_t steps;           // Implausible-step score, leaking 1 per second.
+  uint8_t faults;          // healthFault bits being reported.
+  uint16_t recoverIn;      // Healthy time left before faults clear (s).
+};
+
+struct LearnState {
+  uint16_t thresholdQ4;    // Learned FilterParams::minThreshold (Q4).
+  uint8_t multiplier;      // Learned FilterParams::multiplier.
+  uint16_t cancelIn;       // Time left to call an automatic start false (s).
+  uint16_t decayIn;        // Time to the next step toward defaults (s).
+  uint16_t saveIn;         // Time left before a change is persisted (s).
+  bool dirty;              // Learned values differ from the last save.
+};
+
+// Learned values as kept in EEPROM. Erased memory fails the version check.
+struct LearnRecord {
+  uint8_t version;
+  uint16_t thresholdQ4;
+  uint8_t multiplier;
+  uint8_t check;           // Complement of the XOR of the bytes above.
+};
+
+#define LEARN_RECORD_VERSION 1
+
+struct BlinkState {
+  uint16_t msRemaining;    // Time until the LED changes state.
+  bool ledOn;              // Present state of LED_OUTPUT_PIN.
+};
+
+struct RateLimiter {
+  uint8_t tokens;          // Events that may still pass right now.
+  uint16_t refillIn;       // Time to the next token; 0 while full (ms).
+  bool refused;            // The event being asked for was turned away.
+  uint16_t suppressed;     // Events turned away (saturating).
+};
+
+struct TickClock {
+  uint32_t lastUSec;       // Time snapshot of the last advance.
+  uint16_t subMs;          // Microseconds not yet counted as a millisecond.
+  uint16_t subSecond;      // Milliseconds not yet counted as a second.
+};
+
+struct TickElapsed {
+  uint16_t ms;             // Whole milliseconds since the last advance.
+  uint16_t s;              // Whole seconds since the last advance.
+};
+
+struct ControllerState {
+  const ControllerProfile *profile; // Settings in force (never null).
+  controlState state;     // Operating State of System.
+  TickClock clock;        // Converts time snapshots into timer ticks.
+  uint16_t timeRemaining; // Time remaining until fan start (s).
+  RateLimiter motionRate; // Budget of motion starts that reach the FSM.
+  RateLimiter manualRate; // Budget of button presses that reach the FSM.
+  uint16_t fanTimeRemain; // Time remaining of fan run (s).
+  uint16_t blockMotionIn; // Time to block motion sensor input (ms).
+  DetectorState detector; // qualifyMotion() state.
+  bool motionPending;     // A motion start not yet seen by the IDLE state.
+  bool manualPending;     // A button press not yet seen by the IDLE state.
+  PresenceState presence; // trackPresence() state.
+  bool fanRunning;        // Control indicator that fan is running.
+  FilterState filter;     // qualifyAnalog() history.
+  LearnState learn;       // Sensitivity learned from button feedback.
+  HealthState health;     // healthCheck() state.
+  uint16_t fallbackIn;    // Time to the next timed run while faulted (s).
+  BlinkState blink;       // blink() timing.
+};
+
+// Every byte of controller state, to put another unit running the same
+// build (and flags) in exactly this condition. The profile in force goes
+// with it: the state means nothing under other settings.
+struct ControllerSnapshot {
+  uint8_t version;
+  uint16_t stateBytes;     // sizeof(ControllerState) of the build taking it.
+  uint8_t profileIndex;    // Slot the profile was in force from.
+  ControllerProfile profile;
+  ControllerState ctrl;    // The profile pointer is cleared.
+  uint8_t check;           // Complement of the XOR of the bytes above.
+};
+
+#define SNAPSHOT_RECORD_VERSION 3
+
+/****************************** SCAN INTERFACE ********************************/
+struct ScanInputs {
+  uint32_t now;        // Time snapshot (microseconds) taken for this scan.
+  uint16_t samples[SAMPLE_BLOCK]; // Raw motion sensor readings, oldest first.
+  bool manualActivate; // Pushbutton state.
+};
+
+struct ScanOutputs {
+  bool detect;          // Instantaneous motion detection.
+  motionEvent motion;   // Motion edge reported by the detector this scan.
+  presenceEvent presence; // Visit edge reported by the presence tracker.
+  bool relay;           // Fan relay drive.
+  bool led;             // Indicator LED drive.
+  controlState handled; // State the FSM evaluated during this scan.
+  uint16_t delayMs;     // Blocking debounce requested after this scan.
+  learnEvent learned;   // Button feedback applied this scan.
+  bool saveLearned;     // Learned values should be persisted now.
+  uint8_t faults;       // healthFault bits now reported.
+  bool faultsChanged;   // ... which differ from the previous scan.
+};
+
+/***************************** CORE FUNCTIONS *********************************/
+void controllerInit(ControllerState &ctrl, uint32_t now);
+
+void controllerSetProfile(ControllerState &ctrl,
+                          const ControllerProfile *profile);
+
+void tickBegin(TickClock &clock, uint32_t now);
+
+TickElapsed tickAdvance(TickClock &clock, uint32_t now);
+
+uint16_t timepassed(uint16_t timeLeft, uint16_t elapsed);
+
+bool qualifyAnalog(FilterState &filter, uint16_t reading);
+
+bool qualifyAnalog(FilterState &filter, const FilterParams &params,
+                   uint16_t reading);
+
+template <uint8_t N>
+uint8_t qualifyAnalogBlock(FilterState &filter, const FilterParams &params,
+                           const uint16_t *readings);
+
+motionEvent qualifyMotion(DetectorState &det, const DetectorParams &params,
+                          const FilterState &filter, bool detect,
+                          uint16_t elapsedMs);
+
+presenceEvent trackPresence(PresenceState &pres, const PresenceParams &params,
+                            motionEvent motion, uint16_t elapsedS);
+
+bool blink(BlinkState &blinker, uint16_t blinkPeriodMs, uint16_t elapsedMs);
+
+bool blink(BlinkState &blinker, uint16_t onMs, uint16_t offMs,
+           uint16_t elapsedMs);
+
+void rateReset(RateLimiter &rate, const RateParams &params);
+
+void rateTick(RateLimiter &rate, const RateParams &params, uint16_t elapsedMs);
+
+bool rateTake(RateLimiter &rate, const RateParams &params, bool want);
+
+uint16_t rateHoldOff(const RateLimiter &rate);
+
+bool healthCheck(HealthState &health, const HealthParams &params,
+                 const uint16_t *samples, uint8_t count, TickElapsed elapsed);
+
+const char *healthFaultName(healthFault fault);
+
+void learnDefaults(LearnState &learn, const FilterParams &home);
+
+bool learnFeedback(LearnState &learn, const LearnParams &params,
+                   learnEvent event);
+
+bool learnTick(LearnState &learn, const LearnParams &params,
+               const FilterParams &home, uint16_t elapsedS);
+
+FilterParams learnedFilter(const LearnState &learn, const FilterParams &base);
+
+void learnStore(LearnState &learn, LearnRecord &record);
+
+bool learnRestore(LearnState &learn, const LearnParams &params,
+                  const LearnRecord &record);
+
+bool profileValid(const ControllerProfile &profile, const LearnParams &learn);
+
+void profileStore(const ControllerProfile &profile, ProfileRecord &record);
+
+bool profileRestore(ControllerProfile &profile, const LearnParams &learn,
+                    const ProfileRecord &record);
+
+void snapshotStore(const ControllerState &ctrl, uint8_t profileIndex,
+                   ControllerSnapshot &snap);
+
+bool snapshotRestore(ControllerState &ctrl,
+                     ControllerProfile (&profiles)[PROFILE_COUNT],
+                     const LearnParams &learn, const ControllerSnapshot &snap,
+                     uint32_t now);
+
+void controllerScan(ControllerState &ctrl, const ScanInputs &in,
+                    ScanOutputs &out);
+
+const char *stateName(controlState state);
+
+/***************************** MEDIAN PREFILTER *******************************/
+// A single-sample spike cannot pass a median of three or more, so it never
+// reaches the IIR or the moving average. The median is taken with an
+// odd-even transposition network unrolled at compile time: K rounds of
+// branchless compare-exchanges on alternating pairs, so every sample costs
+// the same number of cycles whatever its value.
+static inline void compareSwap(uint16_t &a, uint16_t &b) {
+  uint16_t mask = uint16_t(0) - uint16_t(b < a); // All ones if out of order.
+  uint16_t diff = (a ^ b) & mask;
+  a ^= diff;
+  b ^= diff;
+}
+
+template <uint8_t K, uint8_t I, bool Done = (I + 1 >= K)>
+struct SortPairs {
+  static inline void apply(uint16_t *v) {
+    compareSwap(v[I], v[I + 1]);
+    SortPairs<K, I + 2>::apply(v);
+  }
+};
+
+template <uint8_t K, uint8_t I>
+struct SortPairs<K, I, true> {
+  static inline void apply(uint16_t *) {}
+};
+
+template <uint8_t K, uint8_t Round = 0, bool Done = (Round >= K)>
+struct SortNetwork {
+  static inline void apply(uint16_t *v) {
+    SortPairs<K, Round % 2>::apply(v);
+    SortNetwork<K, Round + 1>::apply(v);
+  }
+};
+
+template <uint8_t K, uint8_t Round>
+struct SortNetwork<K, Round, true> {
+  static inline void apply(uint16_t *) {}
+};
+
+// Push a raw reading and return the median of the last K of them.
+template <uint8_t K>
+inline uint16_t medianPush(MedianWindow<K> &window, uint16_t reading) {
+  static_assert((K % 2 == 1) && (K <= 7), "MEDIAN_TAPS must be 1, 3, 5 or 7");
+  uint16_t v[K];
+
+  window.recent[window.index] = reading;
+  window.index = (window.index >= (K - 1)) ? 0 : window.index + 1;
+  for (uint8_t k = 0; k < K; k++) {
+    v[k] = window.recent[k];
+  }
+  SortNetwork<K>::apply(v);
+  return v[K / 2];
+}
+
+template <>
+inline uint16_t medianPush<1>(MedianWindow<1> &, uint16_t reading) {
+  return reading;
+}
+
+/****************************** CIC DECIMATOR *********************************/
+// Order-ORDER cascaded integrator-comb filter taking RATIO raw ADC readings
+// down to one output. Integrators run at the input rate and combs at the
+// output rate, with nothing but 32-bit adds and subtracts, so it is cheap
+// enough for the ADC interrupt. Modular arithmetic makes the wrapping
+// integrators harmless as long as the gain fits in 32 bits; the output is
+// shifted back to the 10-bit ADC scale so qualifyAnalog() sees the same
+// units either way.
+template <uint8_t ORDER, uint8_t RATIO>
+struct CicDecimator {
+  uint32_t integrator[ORDER];
+  uint32_t comb[ORDER]; // Each comb stage's input one output earlier.
+  uint8_t phase;        // Readings since the last output.
+};
+
+template <uint8_t RATIO>
+struct CicLog2 {
+  static const uint8_t value = 1 + CicLog2<RATIO / 2>::value;
+};
+
+template <>
+struct CicLog2<1> {
+  static const uint8_t value = 0;
+};
+
+// Push a raw reading; true when an output is ready in `output`.
+template <uint8_t ORDER, uint8_t RATIO>
+inline bool cicPush(CicDecimator<ORDER, RATIO> &cic, uint16_t reading,
+                    uint16_t &output) {
+  static_assert((ORDER >= 1) && (ORDER <= 4), "CIC_ORDER must be 1 to 4");
+  static_assert((RATIO >= 2) && ((RATIO & (RATIO - 1)) == 0),
+                "CIC_RATIO must be a power of two");
+  static_assert(10 + ORDER * CicLog2<RATIO>::value <= 32,
+                "CIC gain does not fit the 32-bit stages");
+  uint32_t acc = reading;
+
+  for (uint8_t s = 0; s < ORDER; s++) {
+    cic.integrator[s] += acc;
+    acc = cic.integrator[s];
+  }
+  if (++cic.phase < RATIO) {
+    return false;
+  }
+  cic.phase = 0;
+  for (uint8_t s = 0; s < ORDER; s++) {
+    uint32_t delayed = cic.comb[s];
+    cic.comb[s] = acc;
+    acc -= delayed;
+  }
+  output = uint16_t(acc >> (ORDER * CicLog2<RATIO>::value));
+  return true;
+}
+
+/****************************** BLOCK PROCESSING ******************************/
+// Qualify N readings (oldest first) in one call. Equivalent to N calls of
+// qualifyAnalog(), but the filter state and parameters are loaded once and
+// the averaging choice is made once per block. Returns the number of
+// readings flagged; filter.sample is the largest filtered sample of the
+// block so the detector's release test sees the strongest activity.
+static inline void filterPush(FilterState &filter, uint16_t &total,
+                              uint8_t &index, uint8_t sample) {
+  total -= filter.readings[index];
+  total += sample;
+  filter.readings[index] = sample;
+  index = (index >= (FILTER_LENGTH - 1)) ? 0 : index + 1;
+}
+
+template <uint8_t N>
+uint8_t qualifyAnalogBlock(FilterState &filter, const FilterParams &params,
+                           const uint16_t *readings) {
+  static_assert(N > 0, "sample block must hold at least one reading");
+  uint16_t total = filter.total;
+  uint8_t index = filter.readingIndex;
+  uint8_t average = 0;
+  uint8_t floor = params.minThreshold;
+  uint8_t peak = 0;
+  uint8_t detections = 0;
+  const uint16_t coef = params.iirCoef;
+  const uint16_t coefInv = 256 - params.iirCoef;
+
+  if (!params.averaging) {
+    // Average held at zero: the threshold is fixed for the whole block.
+    const uint16_t limit = uint16_t(params.multiplier) * floor;
+    for (uint8_t n = 0; n < N; n++) {
+      uint8_t raw = uint8_t(medianPush(filter.median, readings[n]));
+      uint8_t sample = uint8_t((uint16_t(raw) * coefInv) >> 8);
+      filterPush(filter, total, index, sample);
+      detections += uint8_t(sample > limit);
+      peak = (sample > peak) ? sample : peak;
+    }
+  } else {
+    for (uint8_t n = 0; n < N; n++) {
+      average = uint8_t(total / FILTER_LENGTH);
+      floor = (average > params.minThreshold) ? average : params.minThreshold;
+      uint8_t raw = uint8_t(medianPush(filter.median, readings[n]));
+      uint8_t sample = uint8_t(
+        ((uint16_t(average) * coef) + (uint16_t(raw) * coefInv)) >> 8
+      );
+      filterPush(filter, total, index, sample);
+      detections += uint8_t(sample > (uint16_t(params.multiplier) * floor));
+      peak = (sample > peak) ? sample : peak;
+    }
+  }
+
+  filter.total = total;
+  filter.readingIndex = index;
+  filter.average = average;
+  filter.sample = peak;
+  filter.floor = floor;
+  return detections;
+}
+
+#endif // SCENTCORE_H
@@ -0,0 +1,71 @@
+/*******************************************************************************
+ * ScentAssist - Compile-Time Time Types
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Durations are written with unit literals (5_min, 350_ms) and exist
+ *        only at compile time. Timers count in a coarse timebase sized for
+ *        what they measure; converting a Duration to ticks of a timebase is
+ *        range-checked by static_assert, so a value that would overflow its
+ *        counter or lose precision fails the build instead of misbehaving.
+ ******************************************************************************/
+
+#ifndef SCENTTIME_H
+#define SCENTTIME_H
+
+#include <stdint.h>
+
+/******************************** DURATIONS ***********************************/
+struct Duration {
+  uint64_t us; // Microseconds; never stored on the target.
+};
+
+constexpr Duration operator"" _us(unsigned long long n) {
+  return Duration{n};
+}
+constexpr Duration operator"" _ms(unsigned long long n) {
+  return Duration{n * 1000ULL};
+}
+constexpr Duration operator"" _s(unsigned long long n) {
+  return Duration{n * 1000000ULL};
+}
+constexpr Duration operator"" _min(unsigned long long n) {
+  return Duration{n * 60000000ULL};
+}
+constexpr Duration operator"" _h(unsigned long long n) {
+  return Duration{n * 3600000000ULL};
+}
+
+constexpr Duration operator*(uint32_t n, Duration d) {
+  return Duration{n * d.us};
+}
+constexpr Duration operator+(Duration a, Duration b) {
+  return Duration{a.us + b.us};
+}
+
+/******************************** TIMEBASES ***********************************/
+template <uint32_t TickUs, typename Rep>
+struct Timebase {
+  typedef Rep rep;
+  static constexpr uint32_t tickUs = TickUs;
+  static constexpr uint64_t maxTicks = uint64_t(Rep(~Rep(0)));
+};
+
+typedef Timebase<1, uint32_t> MicroTicks;        // 1 us, to 71 minutes
+typedef Timebase<1000, uint16_t> MilliTicks;     // 1 ms, to 65 seconds
+typedef Timebase<1000000, uint16_t> SecondTicks; // 1 s, to 18 hours
+
+// Number of TB ticks in a duration of `Us` microseconds, checked at compile
+// time. Use as TicksOf<SecondTicks, c_RUN_TIME.us>::value.
+template <typename TB, uint64_t Us>
+struct TicksOf {
+  static_assert(Us % TB::tickUs == 0,
+                "duration is not a whole number of ticks of this timebase");
+  static_assert(Us / TB::tickUs <= TB::maxTicks,
+                "duration overflows the counter of this timebase");
+  static constexpr typename TB::rep value = typename TB::rep(Us / TB::tickUs);
+};
+
+#endif // SCENTTIME_H
@@ -0,0 +1,73 @@
+/*******************************************************************************
+ * ScentAssist - Fixed-Rate Scan Executive
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "ScentExec.h"
+
+static void windowStart(ScanExecutive &exec) {
+  exec.minSlackUs = exec.periodUs;
+  exec.slackSumUs = 0;
+  exec.windowScans = 0;
+  exec.windowLosses = exec.overruns + exec.missed;
+}
+
+void execBegin(ScanExecutive &exec, uint16_t periodUs, uint8_t releases) {
+  /*******    Start with nothing pending as of the ISR's count now.     *******/
+  memset(&exec, 0, sizeof(exec));
+  exec.periodUs = periodUs;
+  exec.handled = releases;
+  windowStart(exec);
+}
+
+void execStart(ScanExecutive &exec, uint8_t releases) {
+  /*******           Consume every release up to this one.             *******/
+  uint8_t pending = execPending(exec, releases);
+
+  if (pending > 1) {
+    exec.missed += pending - 1;
+  }
+  exec.handled = releases;
+  exec.scans++;
+}
+
+void execFinish(ScanExecutive &exec, uint8_t releases, uint16_t intoPeriodUs) {
+  /*******         Record slack, or an overrun if there was none.       *******/
+  uint16_t slack = 0;
+
+  if (releases != exec.handled) {
+    // The next period began before this scan was done.
+    exec.overruns++;
+    exec.lastOverrun = exec.scans;
+  } else if (intoPeriodUs < exec.periodUs) {
+    slack = exec.periodUs - intoPeriodUs;
+  }
+
+  if (slack < exec.minSlackUs) {
+    exec.minSlackUs = slack;
+  }
+  exec.slackSumUs += slack;
+  exec.windowScans++;
+}
+
+bool execReport(ScanExecutive &exec, uint16_t scans, ExecReport &report) {
+  /*******   Window summary once it holds `scans` scans; then restart.  *******/
+  if (exec.windowScans < scans) {
+    return false;
+  }
+
+  report.minSlackUs = exec.minSlackUs;
+  report.meanSlackUs = uint16_t(exec.slackSumUs / exec.windowScans);
+  report.overruns = exec.overruns;
+  report.missed = exec.missed;
+  report.lastOverrun = exec.lastOverrun;
+  report.newOverruns = (exec.overruns + exec.missed) != exec.windowLosses;
+
+  windowStart(exec);
+  return true;
+}
@@ -0,0 +1,67 @@
+/*******************************************************************************
+ * ScentAssist - Fixed-Rate Scan Executive
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Bookkeeping for running the control scan once per timer period. A
+ *        timer interrupt counts releases; loop() waits for a release, runs
+ *        one scan and reports where in the period it finished. The slack
+ *        left over is tracked, and a scan that is still running when the
+ *        next release arrives is an overrun. Releases that pass with no scan
+ *        at all are counted as missed. The hardware timer stays with the
+ *        firmware, so this part also runs on the host.
+ ******************************************************************************/
+
+#ifndef SCENTEXEC_H
+#define SCENTEXEC_H
+
+#include <stdint.h>
+
+/******************************** EXECUTIVE ***********************************/
+struct ScanExecutive {
+  uint16_t periodUs;     // Length of one scan period.
+  uint8_t handled;       // Releases consumed (wraps with the ISR's count).
+  uint32_t scans;        // Scans run since start.
+  uint32_t overruns;     // Scans still running at the next release.
+  uint32_t missed;       // Releases that passed without a scan.
+  uint32_t lastOverrun;  // Scan number of the most recent overrun.
+  uint16_t minSlackUs;   // Least slack this report window.
+  uint32_t slackSumUs;   // Slack summed over this report window.
+  uint16_t windowScans;  // Scans in this report window.
+  uint32_t windowLosses; // Overruns plus misses when the window began.
+};
+
+struct ExecReport {
+  uint16_t minSlackUs;   // Least slack over the window.
+  uint16_t meanSlackUs;  // Average slack over the window.
+  uint32_t overruns;     // Totals since start.
+  uint32_t missed;
+  uint32_t lastOverrun;
+  bool newOverruns;      // Overruns or misses happened during the window.
+};
+
+void execBegin(ScanExecutive &exec, uint16_t periodUs, uint8_t releases);
+
+// Releases waiting for a scan, given the ISR's release count.
+static inline uint8_t execPending(const ScanExecutive &exec,
+                                  uint8_t releases) {
+  return uint8_t(releases - exec.handled);
+}
+
+// Skip one pending release without scanning (e.g. a requested debounce).
+static inline void execSkip(ScanExecutive &exec) {
+  exec.handled++;
+}
+
+// A scan begins; anything pending beyond one release was missed.
+void execStart(ScanExecutive &exec, uint8_t releases);
+
+// The scan ended `intoPeriodUs` after the latest of `releases` releases.
+void execFinish(ScanExecutive &exec, uint8_t releases, uint16_t intoPeriodUs);
+
+// Summarize and restart the window once `scans` scans have run in it.
+bool execReport(ScanExecutive &exec, uint16_t scans, ExecReport &report);
+
+#endif // SCENTEXEC_H
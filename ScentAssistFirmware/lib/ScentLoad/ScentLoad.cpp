@@ -0,0 +1,81 @@
+/*******************************************************************************
+ * ScentAssist - CPU Load Meter
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "ScentLoad.h"
+
+static void windowStart(LoadMeter &meter, uint32_t now) {
+  meter.idleCount = 0;
+  meter.windowStart = now;
+  meter.mark = now;
+  memset(meter.sectionUs, 0, sizeof(meter.sectionUs));
+}
+
+void loadBegin(LoadMeter &meter, uint32_t windowUs, uint32_t now) {
+  /*******      Start metering with windows of `windowUs` length.       *******/
+  meter.windowUs = windowUs;
+  meter.idleFull = 0;
+  windowStart(meter, now);
+}
+
+void loadCalibrate(LoadMeter &meter, uint32_t now) {
+  /*******  Scale the idle count seen so far to one full, idle window.   *******/
+  uint32_t elapsed = now - meter.windowStart;
+
+  if (elapsed > 0) {
+    meter.idleFull = uint32_t(
+      (uint64_t(meter.idleCount) * meter.windowUs) / elapsed);
+  }
+  windowStart(meter, now);
+}
+
+void loadMark(LoadMeter &meter, loadSection section, uint32_t now) {
+  /*******          Charge the time since the last mark.               *******/
+  meter.sectionUs[section] += now - meter.mark;
+  meter.mark = now;
+}
+
+static uint16_t permille(uint64_t part, uint64_t whole) {
+  if (whole == 0) return 0;
+  return (part >= whole) ? 1000 : uint16_t((part * 1000) / whole);
+}
+
+bool loadReport(LoadMeter &meter, uint32_t now, LoadReport &report) {
+  /*******     Summarize a finished window and begin the next one.      *******/
+  uint32_t elapsed = now - meter.windowStart;
+
+  if (elapsed < meter.windowUs) {
+    return false;
+  }
+
+  // Idle spins expected over this (slightly long) window with no work.
+  uint64_t expected = (uint64_t(meter.idleFull) * elapsed) / meter.windowUs;
+  report.loadPermille = 1000 - permille(meter.idleCount, expected);
+  for (uint8_t s = 0; s < LOAD_SECTIONS; s++) {
+    report.sectionPermille[s] = permille(meter.sectionUs[s], elapsed);
+  }
+  report.idleCount = meter.idleCount;
+  report.windowUs = elapsed;
+
+  windowStart(meter, now);
+  return true;
+}
+
+const char *loadSectionName(loadSection section) {
+  /*******            Short label of a loop() section.                 *******/
+  switch (section) {
+    case LOAD_IDLE:   return "idle";
+    case LOAD_SAMPLE: return "sample";
+    case LOAD_FSM:    return "fsm";
+    case LOAD_OUTPUT: return "output";
+    case LOAD_LOG:    return "log";
+    default:          break;
+  }
+  return "?";
+}
@@ -0,0 +1,69 @@
+/*******************************************************************************
+ * ScentAssist - CPU Load Meter
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Idle-time accounting for a paced loop(). Whatever time is left in a
+ *        scan period is spent spinning loadIdle(); at boot the same spin runs
+ *        for a whole report window with nothing else to do, which gives the
+ *        count an idle CPU reaches. The count seen during operation against
+ *        that figure is the utilization, independent of the timer used.
+ *
+ *        Sections of loop() are timed with loadMark() so the busy share can
+ *        be broken down; the idle spin is a section of its own, so the parts
+ *        add up to the window and check the idle-count figure.
+ ******************************************************************************/
+
+#ifndef SCENTLOAD_H
+#define SCENTLOAD_H
+
+#include <stdint.h>
+
+/******************************** SECTIONS ************************************/
+enum loadSection {
+  LOAD_IDLE = 0,  // Waiting for the next scan period.
+  LOAD_SAMPLE,    // Reading the sensor and pushbutton.
+  LOAD_FSM,       // controllerScan(): filter, detector, timers, blink().
+  LOAD_OUTPUT,    // Driving the relay and LED pins.
+  LOAD_LOG,       // Serial reports.
+  LOAD_SECTIONS
+};
+
+/********************************* METER **************************************/
+struct LoadMeter {
+  uint32_t windowUs;      // Length of a report window.
+  uint32_t idleFull;      // Idle count of a window with no work (0: none).
+  uint32_t idleCount;     // Idle spins so far this window.
+  uint32_t windowStart;   // Timestamp the window began.
+  uint32_t mark;          // End of the last timed section.
+  uint32_t sectionUs[LOAD_SECTIONS]; // Time charged to each section.
+};
+
+struct LoadReport {
+  uint16_t loadPermille;                  // From the idle count.
+  uint16_t sectionPermille[LOAD_SECTIONS]; // From section timing.
+  uint32_t idleCount;                     // Raw count, for calibration.
+  uint32_t windowUs;                      // Actual length of the window.
+};
+
+void loadBegin(LoadMeter &meter, uint32_t windowUs, uint32_t now);
+
+// One pass of the idle spin; keep the spin around it identical everywhere.
+static inline void loadIdle(LoadMeter &meter) {
+  meter.idleCount++;
+}
+
+// Take this window's idle count as the figure for an otherwise idle CPU.
+void loadCalibrate(LoadMeter &meter, uint32_t now);
+
+// Charge the time since the previous mark to `section`.
+void loadMark(LoadMeter &meter, loadSection section, uint32_t now);
+
+// Once a window has elapsed: fill `report`, start a new window, return true.
+bool loadReport(LoadMeter &meter, uint32_t now, LoadReport &report);
+
+const char *loadSectionName(loadSection section);
+
+#endif // SCENTLOAD_H
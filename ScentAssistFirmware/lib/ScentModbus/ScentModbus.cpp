@@ -0,0 +1,322 @@
+/*******************************************************************************
+ * ScentAssist - Modbus RTU Slave
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ ******************************************************************************/
+
+#include <string.h>
+
+#include "ScentModbus.h"
+
+void countersUpdate(UnitCounters &counters, const ScanOutputs &out) {
+  /*******            Tally this scan's events and edges.              *******/
+  if (out.handled == controlState::ACTIVATE) {
+    counters.fanStarts++;
+  }
+  if (out.presence == presenceEvent::PRESENCE_ARRIVED) {
+    counters.visits++;
+  }
+  if (out.motion == motionEvent::MOTION_START) {
+    counters.motionStarts++;
+  }
+  if (out.learned == learnEvent::LEARN_MISSED) {
+    counters.missedVisits++;
+  } else if (out.learned == learnEvent::LEARN_FALSE) {
+    counters.falseTriggers++;
+  }
+  if (out.faultsChanged && out.faults) {
+    counters.faults++;
+  }
+}
+
+uint16_t modbusCrc(const uint8_t *bytes, uint8_t length) {
+  /*******      CRC-16/MODBUS (reflected 0xA001, seeded 0xFFFF).        *******/
+  uint16_t crc = 0xFFFF;
+  for (uint8_t n = 0; n < length; n++) {
+    crc ^= bytes[n];
+    for (uint8_t bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+    }
+  }
+  return crc;
+}
+
+void modbusBegin(ModbusSlave &slave, uint8_t address, uint32_t baud) {
+  /*******  Idle slave; above 19200 baud the spec fixes t3.5 at 1.75 ms *******/
+  memset(&slave, 0, sizeof(slave));
+  slave.address = address;
+  slave.silenceUs = (baud > 19200) ? 1750 : uint16_t((35000000UL / baud) + 1);
+}
+
+void modbusReceive(ModbusSlave &slave, uint8_t byte, uint32_t nowUs) {
+  /*******   Append a byte; a long enough gap before it starts a frame. *******/
+  if ((slave.length > 0) &&
+      (uint32_t(nowUs - slave.lastByteUs) >= slave.silenceUs)) {
+    // The previous frame ended without being polled; it is stale.
+    slave.length = 0;
+    slave.overflow = false;
+  }
+  if (slave.length < MODBUS_FRAME_MAX) {
+    slave.frame[slave.length++] = byte;
+  } else {
+    slave.overflow = true;
+  }
+  slave.lastByteUs = nowUs;
+}
+
+static inline uint16_t getWord(const uint8_t *bytes) {
+  return uint16_t((bytes[0] << 8) | bytes[1]);
+}
+
+static inline void putWord(uint8_t *bytes, uint16_t value) {
+  bytes[0] = uint8_t(value >> 8);
+  bytes[1] = uint8_t(value);
+}
+
+static uint16_t inputRegister(const ModbusSlave &slave, const ModbusMap &map,
+                              uint16_t reg) {
+  /*******            Read-only view of state and counters.            *******/
+  const ControllerState &ctrl = *map.ctrl;
+  const UnitCounters &counters = *map.counters;
+
+  switch (reg) {
+    case 0:  return uint16_t(ctrl.state);
+    case 1:  return uint16_t((ctrl.fanRunning ? 0x01 : 0) |
+                             (ctrl.presence.occupied ? 0x02 : 0) |
+                             (ctrl.detector.motion ? 0x04 : 0) |
+                             (ctrl.detector.active ? 0x08 : 0) |
+                             (ctrl.blink.ledOn ? 0x10 : 0));
+    case 2:  return ctrl.health.faults;
+    case 3:  return ctrl.timeRemaining;
+    case 4:  return ctrl.fanTimeRemain;
+    case 5:  return rateHoldOff(ctrl.motionRate);
+    case 6:  return ctrl.blockMotionIn;
+    case 7:  return ctrl.presence.vacantIn;
+    case 8:  return ctrl.presence.occupancyLeft;
+    case 9:  return ctrl.fallbackIn;
+    case 10: return ctrl.filter.average;
+    case 11: return ctrl.filter.sample;
+    case 12: return ctrl.learn.thresholdQ4;
+    case 13: return ctrl.learn.multiplier;
+    case 14: return map.profileIndex;
+    case 16: return counters.fanStarts;
+    case 17: return counters.visits;
+    case 18: return counters.motionStarts;
+    case 19: return counters.missedVisits;
+    case 20: return counters.falseTriggers;
+    case 21: return counters.faults;
+    case 22: return slave.frames;
+    case 23: return slave.crcErrors;
+    case 24: return slave.exceptions;
+    case 25: return ctrl.motionRate.suppressed;
+    case 26: return ctrl.manualRate.suppressed;
+  }
+  return 0; // Reserved addresses read as zero.
+}
+
+static uint16_t holdingRegister(const ControllerProfile &profile,
+                                uint8_t profileIndex, uint16_t reg) {
+  /*******            Tunables of the profile in force.                *******/
+  switch (reg) {
+    case 0:  return profile.delayS;
+    case 1:  return profile.runS;
+    case 2:  return profile.blockDetectionMs;
+    case 3:  return profile.blockMotionMs;
+    case 4:  return profile.filter.iirCoef;
+    case 5:  return profile.filter.minThreshold;
+    case 6:  return profile.filter.multiplier;
+    case 7:  return profile.filter.averaging;
+    case 8:  return profile.detector.releaseMultiplier;
+    case 9:  return profile.detector.qualifyMs;
+    case 10: return profile.detector.holdMs;
+    case 11: return profile.presence.vacantS;
+    case 12: return profile.presence.maxOccupiedS;
+    case 13: return profileIndex;
+  }
+  uint8_t n = uint8_t(2 * (reg - 14)); // Name, two characters per register.
+  return uint16_t((uint8_t(profile.name[n]) << 8) |
+                  uint8_t(profile.name[n + 1]));
+}
+
+static modbusException holdingWrite(ControllerProfile &profile,
+                                    ModbusActions &actions, uint16_t reg,
+                                    uint16_t value) {
+  /*******    Stage one holding write; ranges are checked as a whole.  *******/
+  bool byteSized = ((reg >= 5) && (reg <= 8));
+  if (byteSized && (value > 0xFF)) {
+    return MODBUS_ILLEGAL_VALUE;
+  }
+  switch (reg) {
+    case 0:  profile.delayS = value; break;
+    case 1:  profile.runS = value; break;
+    case 2:  profile.blockDetectionMs = value; break;
+    case 3:  profile.blockMotionMs = value; break;
+    case 4:  profile.filter.iirCoef = value; break;
+    case 5:  profile.filter.minThreshold = uint8_t(value); break;
+    case 6:  profile.filter.multiplier = uint8_t(value); break;
+    case 7:  profile.filter.averaging = (value != 0); break;
+    case 8:  profile.detector.releaseMultiplier = uint8_t(value); break;
+    case 9:  profile.detector.qualifyMs = value; break;
+    case 10: profile.detector.holdMs = value; break;
+    case 11: profile.presence.vacantS = value; break;
+    case 12: profile.presence.maxOccupiedS = value; break;
+    case 13:
+      if (value >= PROFILE_COUNT) {
+        return MODBUS_ILLEGAL_VALUE;
+      }
+      actions.selectProfile = true;
+      actions.selectIndex = uint8_t(value);
+      break;
+    default: {
+      uint8_t n = uint8_t(2 * (reg - 14));
+      profile.name[n] = char(value >> 8);
+      profile.name[n + 1] = char(value);
+      break;
+    }
+  }
+  return MODBUS_OK;
+}
+
+static modbusException handleRequest(ModbusSlave &slave, uint8_t length,
+                                     const ModbusMap &map,
+                                     ModbusActions &actions) {
+  /*******   Carry out slave.frame, building the reply in slave.reply.  *******/
+  const uint8_t *req = slave.frame;
+  uint8_t function = req[1];
+  uint8_t dataLength = uint8_t(length - 4); // Less address, FC and CRC.
+
+  if ((function == 3) || (function == 4)) {
+    if (dataLength != 4) {
+      return MODBUS_ILLEGAL_VALUE;
+    }
+    uint16_t start = getWord(&req[2]);
+    uint16_t count = getWord(&req[4]);
+    uint16_t limit = (function == 3) ? MODBUS_HOLDING_COUNT :
+                                       MODBUS_INPUT_COUNT;
+    if ((count == 0) || (count > MODBUS_MAX_REGISTERS)) {
+      return MODBUS_ILLEGAL_VALUE;
+    }
+    if ((start >= limit) || (count > limit - start)) {
+      return MODBUS_ILLEGAL_ADDRESS;
+    }
+    slave.reply[2] = uint8_t(2 * count);
+    for (uint16_t n = 0; n < count; n++) {
+      uint16_t value = (function == 3) ?
+        holdingRegister(*map.profile, map.profileIndex, start + n) :
+        inputRegister(slave, map, start + n);
+      putWord(&slave.reply[3 + 2 * n], value);
+    }
+    slave.replyLength = uint8_t(3 + 2 * count);
+    return MODBUS_OK;
+  }
+
+  if ((function == 6) || (function == 16)) {
+    uint16_t start = getWord(&req[2]);
+    uint16_t count = 1;
+    const uint8_t *values = &req[4];
+    if (function == 6) {
+      if (dataLength != 4) {
+        return MODBUS_ILLEGAL_VALUE;
+      }
+    } else {
+      count = getWord(&req[4]);
+      if ((dataLength < 5) || (count == 0) ||
+          (count > MODBUS_MAX_REGISTERS) || (req[6] != 2 * count) ||
+          (dataLength != 5 + 2 * count)) {
+        return MODBUS_ILLEGAL_VALUE;
+      }
+      values = &req[7];
+    }
+    if ((start >= MODBUS_HOLDING_COUNT) ||
+        (count > MODBUS_HOLDING_COUNT - start)) {
+      return MODBUS_ILLEGAL_ADDRESS;
+    }
+
+    // All or nothing: stage on a copy, validate, then commit.
+    ControllerProfile staged = *map.profile;
+    ModbusActions pending = {false, false, false, 0};
+    for (uint16_t n = 0; n < count; n++) {
+      modbusException result = holdingWrite(staged, pending, start + n,
+                                            getWord(&values[2 * n]));
+      if (result != MODBUS_OK) {
+        return result;
+      }
+    }
+    if (!profileValid(staged, c_LEARN_PARAMS)) {
+      return MODBUS_ILLEGAL_VALUE;
+    }
+    if (memcmp(&staged, map.profile, sizeof(staged)) != 0) {
+      actions.filterChanged =
+        (staged.filter.minThreshold != map.profile->filter.minThreshold) ||
+        (staged.filter.multiplier != map.profile->filter.multiplier);
+      *map.profile = staged;
+      actions.profileChanged = true;
+    }
+    if (pending.selectProfile) {
+      actions.selectProfile = true;
+      actions.selectIndex = pending.selectIndex;
+    }
+
+    // Both replies echo the first six bytes of the request.
+    memcpy(&slave.reply[2], &req[2], 4);
+    slave.replyLength = 6;
+    return MODBUS_OK;
+  }
+
+  return MODBUS_ILLEGAL_FUNCTION;
+}
+
+bool modbusPoll(ModbusSlave &slave, uint32_t nowUs, const ModbusMap &map,
+                ModbusActions &actions) {
+  /*******  Act on a request once the line is quiet; never waits.      *******/
+  actions.profileChanged = false;
+  actions.filterChanged = false;
+  actions.selectProfile = false;
+
+  if ((slave.length == 0) || (slave.replyLength > 0) ||
+      (uint32_t(nowUs - slave.lastByteUs) < slave.silenceUs)) {
+    return false;
+  }
+
+  uint8_t length = slave.length;
+  bool overflow = slave.overflow;
+  slave.length = 0;
+  slave.overflow = false;
+  if (overflow || (length < 4)) {
+    return false; // Not a frame any master could have sent us.
+  }
+  uint8_t target = slave.frame[0];
+  if ((target != slave.address) && (target != 0)) {
+    return false; // Another unit's request (its CRC is that unit's problem).
+  }
+  uint16_t crc = modbusCrc(slave.frame, uint8_t(length - 2));
+  if ((slave.frame[length - 2] != uint8_t(crc)) ||
+      (slave.frame[length - 1] != uint8_t(crc >> 8))) {
+    slave.crcErrors++;
+    return false;
+  }
+
+  slave.frames++;
+  slave.reply[0] = slave.address;
+  slave.reply[1] = slave.frame[1];
+  modbusException result = handleRequest(slave, length, map, actions);
+
+  if (target == 0) {
+    // Broadcast: writes have taken effect, but nobody expects an answer.
+    slave.replyLength = 0;
+    return false;
+  }
+  if (result != MODBUS_OK) {
+    slave.reply[1] = uint8_t(slave.frame[1] | 0x80);
+    slave.reply[2] = uint8_t(result);
+    slave.replyLength = 3;
+    slave.exceptions++;
+  }
+  crc = modbusCrc(slave.reply, slave.replyLength);
+  slave.reply[slave.replyLength++] = uint8_t(crc);
+  slave.reply[slave.replyLength++] = uint8_t(crc >> 8);
+  slave.replySent = 0;
+  return true;
+}
@@ -0,0 +1,133 @@
+/*******************************************************************************
+ * ScentAssist - Modbus RTU Slave
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Exposes the controller to a Modbus RTU master (a home hub polling
+ *        several units) over the serial port. Bytes are fed in as they
+ *        arrive and a frame is handled only once the line has been quiet
+ *        for 3.5 characters, so nothing here ever waits; the reply is left
+ *        in a buffer for the caller to drain as the UART has room.
+ *
+ *        FUNCTIONS  03 read holding, 04 read input, 06 write single,
+ *                   16 write multiple. Address 0 is a broadcast: writes
+ *                   apply and no reply is sent.
+ *
+ *        INPUT REGISTERS (read-only)
+ *          0 state          5 motion hold-off ms 10 filter average
+ *          1 flags          6 blockMotionIn ms  11 filter sample
+ *          2 fault bits     7 vacantIn s        12 learned threshold Q4
+ *          3 timeRemaining s 8 occupancyLeft s  13 learned multiplier
+ *          4 fanTimeRemain s 9 fallbackIn s     14 profile index
+ *         16 fan starts    17 visits    18 motion starts  19 missed visits
+ *         20 false triggers  21 sensor faults  22 frames  23 CRC errors
+ *         24 exceptions  25 motion starts suppressed
+ *         26 button presses suppressed
+ *          flags: bit 0 fan, 1 occupied, 2 motion, 3 active, 4 LED.
+ *
+ *        HOLDING REGISTERS (the profile in force)
+ *          0 delayS            5 minThreshold       10 holdMs
+ *          1 runS              6 multiplier         11 vacantS
+ *          2 blockDetectionMs  7 averaging          12 maxOccupiedS
+ *          3 blockMotionMs     8 releaseMultiplier  13 profile select
+ *          4 iirCoef           9 qualifyMs          14-17 name (2 chars)
+ *
+ *        A write is applied to a copy of the profile and kept only if the
+ *        whole copy passes profileValid(); otherwise the master gets an
+ *        illegal-value exception and nothing changes. Detection runs at the
+ *        learned threshold and multiplier, so a write that changes either
+ *        one in the profile asks for learning to restart from it.
+ ******************************************************************************/
+
+#ifndef SCENTMODBUS_H
+#define SCENTMODBUS_H
+
+#include <stdint.h>
+
+#include <ScentCore.h>
+
+#define MODBUS_FRAME_MAX 80     // Longest request or reply kept.
+#define MODBUS_MAX_REGISTERS 32 // Registers per block read or write.
+#define MODBUS_INPUT_COUNT 27
+#define MODBUS_HOLDING_COUNT 18
+
+enum modbusException {
+  MODBUS_OK = 0,
+  MODBUS_ILLEGAL_FUNCTION = 1,
+  MODBUS_ILLEGAL_ADDRESS = 2,
+  MODBUS_ILLEGAL_VALUE = 3
+};
+
+/********************************* COUNTERS ***********************************/
+// Events since power-up, as a hub would chart them. Each wraps at 65535.
+struct UnitCounters {
+  uint16_t fanStarts;      // Scans that handled ACTIVATE.
+  uint16_t visits;         // PRESENCE_ARRIVED edges.
+  uint16_t motionStarts;   // MOTION_START edges.
+  uint16_t missedVisits;   // LEARN_MISSED feedback.
+  uint16_t falseTriggers;  // LEARN_FALSE feedback.
+  uint16_t faults;         // Sensor fault reports (new non-empty sets).
+};
+
+void countersUpdate(UnitCounters &counters, const ScanOutputs &out);
+
+/****************************** SLAVE STATE ***********************************/
+struct ModbusSlave {
+  uint8_t address;          // This unit's slave address (1-247).
+  uint16_t silenceUs;       // 3.5 character times: the end of a frame.
+  uint8_t frame[MODBUS_FRAME_MAX]; // Request being received.
+  uint8_t length;           // Bytes in frame[].
+  bool overflow;            // The request outgrew frame[]; drop it.
+  uint32_t lastByteUs;      // Arrival of the most recent byte.
+  uint8_t reply[MODBUS_FRAME_MAX]; // Response waiting to be sent.
+  uint8_t replyLength;      // Bytes in reply[].
+  uint8_t replySent;        // Bytes of reply[] already handed to the UART.
+  uint16_t frames;          // Requests for this unit handled.
+  uint16_t crcErrors;       // Frames discarded for a bad CRC.
+  uint16_t exceptions;      // Exception replies sent.
+};
+
+// What the register map sees and may change; the caller owns all of it.
+struct ModbusMap {
+  const ControllerState *ctrl;
+  ControllerProfile *profile;     // The profile in force (writable copy).
+  uint8_t profileIndex;           // Its slot, reported in input 14.
+  const UnitCounters *counters;
+};
+
+// Changes the caller has to carry out after a write.
+struct ModbusActions {
+  bool profileChanged;      // *map.profile was rewritten; persist it.
+  bool filterChanged;       // Its detection level moved; relearn from it.
+  bool selectProfile;       // The master asked for another profile ...
+  uint8_t selectIndex;      //   ... this one.
+};
+
+void modbusBegin(ModbusSlave &slave, uint8_t address, uint32_t baud);
+
+// One received byte, stamped with the time it was read.
+void modbusReceive(ModbusSlave &slave, uint8_t byte, uint32_t nowUs);
+
+// Handle a complete request once the line has gone quiet; true when a new
+// reply is waiting in slave.reply. Requests are ignored while one is.
+bool modbusPoll(ModbusSlave &slave, uint32_t nowUs, const ModbusMap &map,
+                ModbusActions &actions);
+
+// Bytes of the reply not yet sent; mark `count` of them as sent.
+static inline uint8_t modbusPending(const ModbusSlave &slave) {
+  return uint8_t(slave.replyLength - slave.replySent);
+}
+
+static inline void modbusSent(ModbusSlave &slave, uint8_t count) {
+  slave.replySent += count;
+  if (slave.replySent >= slave.replyLength) {
+    slave.replyLength = 0;
+    slave.replySent = 0;
+  }
+}
+
+uint16_t modbusCrc(const uint8_t *bytes, uint8_t length);
+
+#endif // SCENTMODBUS_H
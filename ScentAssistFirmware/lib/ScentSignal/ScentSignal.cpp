@@ -0,0 +1,137 @@
+/*******************************************************************************
+ * ScentAssist - Synthetic Sensor Signal
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ ******************************************************************************/
+
+#include "ScentSignal.h"
+
+/******************************* REPLAY TABLE *********************************/
+// A cat settling in, scratching, a pause, a second bout, then a quiet box.
+const SignalSegment c_SIGNAL_REPLAY[] = {
+  {0, 5000}, {180, 900}, {30, 300}, {220, 1800}, {0, 2500}, {160, 1200},
+  {0, 25000},
+};
+const uint8_t c_SIGNAL_REPLAY_LENGTH =
+  sizeof(c_SIGNAL_REPLAY) / sizeof(c_SIGNAL_REPLAY[0]);
+
+/******************************** GENERATOR ***********************************/
+static uint32_t samplesOf(uint16_t ms, uint16_t rateHz) {
+  /*******        Readings in a duration; at least one of them.         *******/
+  uint32_t samples = (uint32_t(ms) * rateHz) / 1000;
+  return (samples > 0) ? samples : 1;
+}
+
+static uint16_t xorshift16(uint16_t &x) {
+  /*******            Next of the 65535-long noise sequence.            *******/
+  x ^= uint16_t(x << 7);
+  x ^= uint16_t(x >> 9);
+  x ^= uint16_t(x << 8);
+  return x;
+}
+
+static void eventBegin(SignalGenerator &gen) {
+  /*******              Time detection latency from here.               *******/
+  gen.events++;
+  gen.sinceEvent = 0;
+}
+
+static void segmentEnter(SignalGenerator &gen, uint8_t segment,
+                         uint16_t lastLevel) {
+  /*******     Hold a replay segment; a rise from zero is an event.     *******/
+  gen.segment = segment;
+  gen.segmentLeft = samplesOf(c_SIGNAL_REPLAY[segment].ms, gen.rateHz);
+  if ((c_SIGNAL_REPLAY[segment].level > 0) && (lastLevel == 0)) {
+    eventBegin(gen);
+  }
+}
+
+void signalBegin(SignalGenerator &gen, signalPattern pattern,
+                 const SignalParams &params, uint16_t rateHz, uint16_t seed) {
+  /*******      Start a pattern from its first reading and this seed.   *******/
+  gen.pattern = pattern;
+  gen.params = params;
+  gen.rateHz = (rateHz > 0) ? rateHz : 1;
+  gen.rng = (seed != 0) ? seed : 1;
+  gen.periodSamples = samplesOf(params.periodMs, gen.rateHz);
+  gen.eventSamples = samplesOf(params.eventMs, gen.rateHz);
+  uint32_t half = (gen.eventSamples > 1) ? gen.eventSamples / 2 : 1;
+  gen.rampStepQ16 = (uint32_t(params.amplitude) << 16) / half;
+  gen.phase = 0;
+  gen.events = 0;
+  gen.sinceEvent = 0;
+  gen.segment = 0;
+  if (pattern == SIGNAL_REPLAY) {
+    segmentEnter(gen, 0, 0);
+  }
+}
+
+uint16_t signalNext(SignalGenerator &gen) {
+  /*******        The next reading: baseline, pattern and noise.        *******/
+  const SignalParams &params = gen.params;
+  uint32_t level = 0; // Above the baseline.
+
+  if ((gen.pattern == SIGNAL_SPIKES) || (gen.pattern == SIGNAL_RAMP)) {
+    if (gen.phase == 0) {
+      eventBegin(gen);
+    }
+    if (gen.phase < gen.eventSamples) {
+      if (gen.pattern == SIGNAL_SPIKES) {
+        level = params.amplitude;
+      } else {
+        // Up for the first half of the event, back down for the second.
+        uint32_t half = gen.eventSamples / 2;
+        uint32_t x = (gen.phase < half) ? gen.phase :
+                     gen.eventSamples - gen.phase;
+        level = (x * gen.rampStepQ16) >> 16;
+        if (level > params.amplitude) {
+          level = params.amplitude;
+        }
+      }
+    }
+    if (++gen.phase >= gen.periodSamples) {
+      gen.phase = 0;
+    }
+  } else if (gen.pattern == SIGNAL_REPLAY) {
+    level = c_SIGNAL_REPLAY[gen.segment].level;
+    if (--gen.segmentLeft == 0) {
+      uint8_t next = gen.segment + 1;
+      segmentEnter(gen, (next < c_SIGNAL_REPLAY_LENGTH) ? next : 0,
+                   uint16_t(level));
+    }
+  }
+  if (gen.sinceEvent < 0xFFFFFFFF) {
+    gen.sinceEvent++;
+  }
+
+  // Noise spread evenly over [-noise, +noise] without a division.
+  uint16_t spread = uint16_t(2 * params.noise + 1);
+  uint16_t draw = uint16_t(xorshift16(gen.rng) & 0xFF) * spread;
+  int16_t noise = int16_t(draw >> 8) - params.noise;
+  int32_t reading = int32_t(params.baseline) + int32_t(level) + noise;
+  if (reading < 0) {
+    return 0;
+  }
+  return (reading > 1023) ? 1023 : uint16_t(reading);
+}
+
+uint32_t signalEventMs(const SignalGenerator &gen) {
+  /*******   Readings since the event began, as time; no overflow.     *******/
+  uint32_t s = gen.sinceEvent / gen.rateHz;
+  uint32_t rest = gen.sinceEvent - s * gen.rateHz;
+  return s * 1000 + (rest * 1000) / gen.rateHz;
+}
+
+const char *signalPatternName(signalPattern pattern) {
+  /*******           Human-readable name of a pattern.                  *******/
+  switch (pattern) {
+    case SIGNAL_NOISE:  return "NOISE";
+    case SIGNAL_SPIKES: return "SPIKES";
+    case SIGNAL_RAMP:   return "RAMP";
+    case SIGNAL_REPLAY: return "REPLAY";
+    case SIGNAL_PATTERNS: break;
+  }
+  return "UNKNOWN";
+}
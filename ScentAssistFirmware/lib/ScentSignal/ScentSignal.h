@@ -0,0 +1,93 @@
+/*******************************************************************************
+ * ScentAssist - Synthetic Sensor Signal
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Stands in for the motion sensor on a bare board. Each call gives
+ *        the next raw reading, which goes through controllerScan() exactly
+ *        as an ADC reading would, so detection latency and scan cost can be
+ *        measured on the target itself.
+ *
+ *        Every pattern is baseline noise plus one of:
+ *          SIGNAL_NOISE   nothing; nothing should ever be detected
+ *          SIGNAL_SPIKES  a burst at the amplitude, once every period
+ *          SIGNAL_RAMP    a rise to the amplitude and back, once every period
+ *          SIGNAL_REPLAY  the segments of c_SIGNAL_REPLAY, over and over
+ *
+ *        The output depends only on the seed and how many readings have
+ *        been taken, never on time, so a paced executive sees the same
+ *        samples on every run. Noise is a 16-bit xorshift; each reading
+ *        costs a few shifts and one multiply.
+ *
+ *        The replay table is const data, which the ATmega4809 keeps in
+ *        flash and reads in place; it does not occupy RAM.
+ *
+ * USAGE: signalBegin(gen, SIGNAL_SPIKES, c_SIGNAL_PARAMS, samplesPerS, 1);
+ *        uint16_t reading = signalNext(gen);
+ ******************************************************************************/
+
+#ifndef SCENTSIGNAL_H
+#define SCENTSIGNAL_H
+
+#include <stdint.h>
+
+/******************************** PATTERNS ************************************/
+enum signalPattern {
+  SIGNAL_NOISE = 0,
+  SIGNAL_SPIKES,
+  SIGNAL_RAMP,
+  SIGNAL_REPLAY,
+  SIGNAL_PATTERNS
+};
+
+struct SignalParams {
+  uint16_t baseline;       // Quiet level (ADC counts).
+  uint8_t noise;           // Noise peak either side of the baseline.
+  uint16_t amplitude;      // Height of a burst or ramp above the baseline.
+  uint16_t periodMs;       // From the start of one event to the next.
+  uint16_t eventMs;        // Length of a burst or ramp.
+};
+
+// A visit's worth of sensor activity every 20 s against a quiet floor. The
+// filter keeps 8 bits of each reading: stay below 256 all told.
+const SignalParams c_SIGNAL_PARAMS = {10, 4, 200, 20000, 2000};
+
+// One step of a replayed pattern: a level above the baseline, held.
+struct SignalSegment {
+  uint16_t level;
+  uint16_t ms;
+};
+
+// An event begins wherever a non-zero level follows a zero one.
+extern const SignalSegment c_SIGNAL_REPLAY[];
+extern const uint8_t c_SIGNAL_REPLAY_LENGTH;
+
+/******************************** GENERATOR ***********************************/
+struct SignalGenerator {
+  signalPattern pattern;
+  SignalParams params;
+  uint16_t rateHz;         // Readings taken per second.
+  uint16_t rng;            // xorshift16 state (never zero).
+  uint32_t periodSamples;  // Params converted to readings.
+  uint32_t eventSamples;
+  uint32_t phase;          // Readings into the present period.
+  uint32_t rampStepQ16;    // Ramp rise per reading (Q16).
+  uint8_t segment;         // Replay segment being held.
+  uint32_t segmentLeft;    // Readings left of it.
+  uint16_t events;         // Events begun so far (wraps).
+  uint32_t sinceEvent;     // Readings since the last one began.
+};
+
+void signalBegin(SignalGenerator &gen, signalPattern pattern,
+                 const SignalParams &params, uint16_t rateHz, uint16_t seed);
+
+uint16_t signalNext(SignalGenerator &gen);
+
+// Time since the present event began (ms).
+uint32_t signalEventMs(const SignalGenerator &gen);
+
+const char *signalPatternName(signalPattern pattern);
+
+#endif // SCENTSIGNAL_H
@@ -0,0 +1,30 @@
+/*******************************************************************************
+ * ScentAssist - Free-Running Timebase
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ ******************************************************************************/
+
+#include "ScentTimebase.h"
+
+#ifdef ARDUINO
+volatile uint16_t timebaseHigh;
+
+ISR(TCB0_INT_vect) {
+  TCB0.INTFLAGS = TCB_CAPT_bm;
+  timebaseHigh++;
+}
+
+void timebaseBegin() {
+  /*******   TCB0 wraps at 0xFFFF; each wrap is one high-word count.    *******/
+  TCB0.CTRLA = 0;
+  TCB0.CTRLB = TCB_CNTMODE_INT_gc;
+  TCB0.CCMP = 0xFFFF;
+  TCB0.CNT = 0;
+  timebaseHigh = 0;
+  TCB0.INTFLAGS = TCB_CAPT_bm;
+  TCB0.INTCTRL = TCB_CAPT_bm;
+  TCB0.CTRLA = TCB_CLKSEL_CLKDIV2_gc | TCB_ENABLE_bm;
+}
+#endif
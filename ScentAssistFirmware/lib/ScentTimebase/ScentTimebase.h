@@ -0,0 +1,104 @@
+/*******************************************************************************
+ * ScentAssist - Free-Running Timebase
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: A cheaper clock than micros(). TCB0 counts the CPU clock divided by
+ *        two and never stops; its overflow interrupt only bumps the high
+ *        word. The low 16 bits are read straight from the counter (the
+ *        timer latches the high byte itself), good for intervals up to
+ *        8 ms; the full 32-bit count takes a few cycles with interrupts held
+ *        off and wraps after about 9 minutes.
+ *
+ *        Ticks are converted to time explicitly: timebaseAdvance() turns the
+ *        ticks since its last call into microseconds on a 32-bit clock that
+ *        wraps like micros(), carrying the fraction in its own reference, so
+ *        the conversion is a shift and never drifts. Take one snapshot per
+ *        scan and hand the same value to everything timed by that scan.
+ *
+ * USAGE: timebaseBegin();
+ *        uint32_t now = timebaseAdvance(clock, timebaseRead());
+ ******************************************************************************/
+
+#ifndef SCENTTIMEBASE_H
+#define SCENTTIMEBASE_H
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#define TIMEBASE_CPU_CYCLES 2 // CPU cycles per tick (TCB0 on CLKDIV2).
+
+#ifndef TIMEBASE_TICKS_PER_US
+#ifdef F_CPU
+#define TIMEBASE_TICKS_PER_US (F_CPU / TIMEBASE_CPU_CYCLES / 1000000UL)
+#else
+#define TIMEBASE_TICKS_PER_US 8 // As at 16 MHz.
+#endif
+#endif
+
+#ifdef F_CPU
+static_assert(F_CPU / TIMEBASE_CPU_CYCLES == TIMEBASE_TICKS_PER_US * 1000000UL,
+              "the timebase needs a whole number of ticks per microsecond");
+#endif
+
+/******************************** CONVERSION **********************************/
+// Microseconds on a clock that wraps at 2^32 us, driven by tick snapshots.
+struct TimebaseClock {
+  uint32_t lastTicks;  // Tick count already converted into us.
+  uint32_t us;         // The clock.
+};
+
+static inline uint32_t ticksToUs(uint32_t ticks) {
+  return ticks / TIMEBASE_TICKS_PER_US;
+}
+
+static inline uint32_t usToTicks(uint32_t us) {
+  return us * TIMEBASE_TICKS_PER_US;
+}
+
+static inline void timebaseStart(TimebaseClock &clock, uint32_t ticks,
+                                 uint32_t us) {
+  clock.lastTicks = ticks;
+  clock.us = us;
+}
+
+// The clock at `ticks`; snapshots must come less than one wrap apart.
+static inline uint32_t timebaseAdvance(TimebaseClock &clock, uint32_t ticks) {
+  uint32_t us = ticksToUs(ticks - clock.lastTicks);
+  clock.lastTicks += usToTicks(us); // Leaves the fraction for next time.
+  clock.us += us;
+  return clock.us;
+}
+
+/********************************* HARDWARE ***********************************/
+#ifdef ARDUINO
+extern volatile uint16_t timebaseHigh; // Overflows of TCB0; ISR only.
+
+// Start TCB0 counting from zero; its PWM on D6 is given up.
+void timebaseBegin();
+
+// Low 16 bits of the count: for intervals under 65536 ticks.
+static inline uint16_t timebaseRead16() {
+  return TCB0.CNT;
+}
+
+// The full count, consistent even as the low word overflows.
+static inline uint32_t timebaseRead() {
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t high = timebaseHigh;
+  uint16_t low = TCB0.CNT;
+  if ((TCB0.INTFLAGS & TCB_CAPT_bm) && (low < 0x8000)) {
+    high++; // Wrapped after the lock; its interrupt is still pending.
+  }
+  SREG = sreg;
+  return (uint32_t(high) << 16) | low;
+}
+#endif
+
+#endif // SCENTTIMEBASE_H
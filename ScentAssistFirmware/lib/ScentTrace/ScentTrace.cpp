@@ -0,0 +1,317 @@
+/*******************************************************************************
+ * ScentAssist - Compressed Sample Trace Files
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ ******************************************************************************/
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ScentTrace.h"
+
+static const uint8_t c_HEADER_MAGIC[4] = {'S', 'A', 'T', 'R'};
+static const uint8_t c_TRAILER_MAGIC[4] = {'S', 'A', 'T', 'I'};
+
+/****************************** BYTE HELPERS **********************************/
+static void put16(uint8_t *p, uint16_t v) {
+  p[0] = uint8_t(v);
+  p[1] = uint8_t(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+  for (int i = 0; i < 4; i++) p[i] = uint8_t(v >> (8 * i));
+}
+
+static void put64(uint8_t *p, uint64_t v) {
+  for (int i = 0; i < 8; i++) p[i] = uint8_t(v >> (8 * i));
+}
+
+static uint16_t get16(const uint8_t *p) {
+  return uint16_t(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t *p) {
+  uint32_t v = 0;
+  for (int i = 3; i >= 0; i--) v = (v << 8) | p[i];
+  return v;
+}
+
+static uint64_t get64(const uint8_t *p) {
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+  return v;
+}
+
+static inline uint8_t *putVarint(uint8_t *p, uint32_t v) {
+  while (v >= 0x80) {
+    *p++ = uint8_t(v | 0x80);
+    v >>= 7;
+  }
+  *p++ = uint8_t(v);
+  return p;
+}
+
+static inline const uint8_t *getVarint(const uint8_t *p, const uint8_t *end,
+                                       uint32_t &v) {
+  uint32_t shift = 0;
+  v = 0;
+  while (p < end && shift < 32) {
+    uint8_t b = *p++;
+    v |= uint32_t(b & 0x7F) << shift;
+    if (!(b & 0x80)) return p;
+    shift += 7;
+  }
+  return nullptr;
+}
+
+/****************************** BLOCK CODING **********************************/
+size_t traceEncode(const uint16_t *samples, uint32_t count, uint8_t *out) {
+  /*******     Delta, zigzag and varint pack one block of samples.      *******/
+  uint8_t *p = putVarint(out, count);
+  if (count == 0) return size_t(p - out);
+
+  p = putVarint(p, samples[0]);
+  for (uint32_t i = 1; i < count; i++) {
+    int32_t delta = int32_t(samples[i]) - int32_t(samples[i - 1]);
+    p = putVarint(p, (uint32_t(delta) << 1) ^ uint32_t(delta >> 31));
+  }
+  return size_t(p - out);
+}
+
+uint32_t traceDecode(const uint8_t *in, size_t bytes, uint16_t *out,
+                     uint32_t capacity) {
+  /*******          Reverse traceEncode(); 0 when malformed.            *******/
+  const uint8_t *end = in + bytes;
+  uint32_t count, value;
+
+  in = getVarint(in, end, count);
+  if (!in || count > capacity) return 0;
+  if (count == 0) return 0;
+
+  in = getVarint(in, end, value);
+  if (!in || value > 0xFFFF) return 0;
+  out[0] = uint16_t(value);
+
+  uint32_t i = 1;
+  // Fast path: most deltas fit in a single byte.
+  while (i < count) {
+    if (in < end && !(in[0] & 0x80)) {
+      uint32_t zz = *in++;
+      value += (zz >> 1) ^ (0u - (zz & 1));
+    } else {
+      uint32_t zz;
+      in = getVarint(in, end, zz);
+      if (!in) return 0;
+      value += (zz >> 1) ^ (0u - (zz & 1));
+    }
+    if (value > 0xFFFF) return 0;
+    out[i++] = uint16_t(value);
+  }
+  return count;
+}
+
+/********************************** WRITING ***********************************/
+static bool writeBytes(TraceWriter &w, const uint8_t *bytes, size_t n) {
+  if (fwrite(bytes, 1, n, w.file) != n) return false;
+  w.offset += n;
+  return true;
+}
+
+static bool flushBlock(TraceWriter &w) {
+  if (w.pendingCount == 0) return true;
+
+  if (w.indexCount == w.indexCapacity) {
+    size_t capacity = w.indexCapacity ? w.indexCapacity * 2 : 64;
+    void *grown = realloc(w.index, capacity * sizeof(TraceBlockInfo));
+    if (!grown) return false;
+    w.index = (TraceBlockInfo *)grown;
+    w.indexCapacity = capacity;
+  }
+
+  size_t bytes = traceEncode(w.pending, w.pendingCount, w.scratch);
+  TraceBlockInfo &info = w.index[w.indexCount++];
+  info.timestampUs = w.blockTime;
+  info.offset = w.offset;
+  info.count = w.pendingCount;
+  info.bytes = uint32_t(bytes);
+
+  // Next block continues where this one ends.
+  w.segmentSamples += w.pendingCount;
+  w.blockTime = w.segmentTime +
+    w.segmentSamples * 1000000 / w.sampleRateHz;
+  w.pendingCount = 0;
+  return writeBytes(w, w.scratch, bytes);
+}
+
+bool traceCreate(TraceWriter &w, const char *path, uint32_t sampleRateHz,
+                 uint16_t blockSamples) {
+  uint8_t header[TRACE_HEADER_BYTES] = {0};
+
+  memset(&w, 0, sizeof(w));
+  if (sampleRateHz == 0 || blockSamples == 0) return false;
+  w.file = fopen(path, "wb");
+  if (!w.file) return false;
+  w.sampleRateHz = sampleRateHz;
+  w.blockSamples = blockSamples;
+  w.pending = (uint16_t *)malloc(blockSamples * sizeof(uint16_t));
+  w.scratch = (uint8_t *)malloc(traceEncodeBound(blockSamples));
+
+  memcpy(header, c_HEADER_MAGIC, 4);
+  put16(header + 4, TRACE_VERSION);
+  put16(header + 6, blockSamples);
+  put32(header + 8, sampleRateHz);
+  if (!w.pending || !w.scratch || !writeBytes(w, header, sizeof(header))) {
+    fclose(w.file);
+    free(w.pending);
+    free(w.scratch);
+    memset(&w, 0, sizeof(w));
+    return false;
+  }
+  return true;
+}
+
+bool traceAppend(TraceWriter &w, const uint16_t *samples, size_t count) {
+  while (count > 0) {
+    size_t room = w.blockSamples - w.pendingCount;
+    size_t n = (count < room) ? count : room;
+    memcpy(w.pending + w.pendingCount, samples, n * sizeof(uint16_t));
+    w.pendingCount += uint32_t(n);
+    w.sampleCount += n;
+    samples += n;
+    count -= n;
+    if (w.pendingCount == w.blockSamples && !flushBlock(w)) return false;
+  }
+  return true;
+}
+
+bool traceSegment(TraceWriter &w, uint64_t timestampUs) {
+  if (!flushBlock(w)) return false;
+  w.segmentTime = timestampUs;
+  w.segmentSamples = 0;
+  w.blockTime = timestampUs;
+  return true;
+}
+
+bool traceFinish(TraceWriter &w) {
+  uint8_t entry[TRACE_INDEX_BYTES];
+  uint8_t trailer[TRACE_TRAILER_BYTES];
+  uint64_t indexOffset;
+  bool ok = flushBlock(w);
+
+  indexOffset = w.offset;
+  for (size_t i = 0; ok && i < w.indexCount; i++) {
+    put64(entry, w.index[i].timestampUs);
+    put64(entry + 8, w.index[i].offset);
+    put32(entry + 16, w.index[i].count);
+    put32(entry + 20, w.index[i].bytes);
+    ok = writeBytes(w, entry, sizeof(entry));
+  }
+  put64(trailer, indexOffset);
+  put64(trailer + 8, w.sampleCount);
+  put32(trailer + 16, uint32_t(w.indexCount));
+  memcpy(trailer + 20, c_TRAILER_MAGIC, 4);
+  ok = ok && writeBytes(w, trailer, sizeof(trailer));
+
+  ok = (fclose(w.file) == 0) && ok;
+  free(w.pending);
+  free(w.scratch);
+  free(w.index);
+  memset(&w, 0, sizeof(w));
+  return ok;
+}
+
+/********************************** READING ***********************************/
+bool traceOpen(TraceReader &r, const char *path) {
+  struct stat st;
+  int fd;
+
+  memset(&r, 0, sizeof(r));
+  fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  if (fstat(fd, &st) != 0 ||
+      size_t(st.st_size) < TRACE_HEADER_BYTES + TRACE_TRAILER_BYTES) {
+    close(fd);
+    return false;
+  }
+  void *map = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) return false;
+  r.data = (const uint8_t *)map;
+  r.size = size_t(st.st_size);
+
+  // Validate Header and Trailer
+  const uint8_t *trailer = r.data + r.size - TRACE_TRAILER_BYTES;
+  uint64_t indexOffset = get64(trailer);
+  r.sampleCount = get64(trailer + 8);
+  r.blockCount = get32(trailer + 16);
+  r.blockSamples = get16(r.data + 6);
+  r.sampleRateHz = get32(r.data + 8);
+  if (memcmp(r.data, c_HEADER_MAGIC, 4) != 0 ||
+      get16(r.data + 4) != TRACE_VERSION ||
+      memcmp(trailer + 20, c_TRAILER_MAGIC, 4) != 0 ||
+      r.sampleRateHz == 0 || r.blockSamples == 0 ||
+      indexOffset < TRACE_HEADER_BYTES ||
+      indexOffset + uint64_t(r.blockCount) * TRACE_INDEX_BYTES !=
+        r.size - TRACE_TRAILER_BYTES) {
+    traceClose(r);
+    return false;
+  }
+  r.index = r.data + indexOffset;
+
+  // Every block must lie between the header and the index.
+  for (uint32_t b = 0; b < r.blockCount; b++) {
+    TraceBlockInfo info = traceBlock(r, b);
+    if (info.offset < TRACE_HEADER_BYTES ||
+        info.offset + info.bytes > indexOffset ||
+        info.count > r.blockSamples) {
+      traceClose(r);
+      return false;
+    }
+  }
+  return true;
+}
+
+void traceClose(TraceReader &r) {
+  if (r.data) {
+    munmap((void *)r.data, r.size);
+  }
+  memset(&r, 0, sizeof(r));
+}
+
+TraceBlockInfo traceBlock(const TraceReader &r, uint32_t block) {
+  const uint8_t *p = r.index + size_t(block) * TRACE_INDEX_BYTES;
+  TraceBlockInfo info;
+  info.timestampUs = get64(p);
+  info.offset = get64(p + 8);
+  info.count = get32(p + 16);
+  info.bytes = get32(p + 20);
+  return info;
+}
+
+uint32_t traceFindBlock(const TraceReader &r, uint64_t timestampUs) {
+  /*******   Binary search for the last block starting at or before t.  *******/
+  uint32_t lo = 0, hi = r.blockCount;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (get64(r.index + size_t(mid) * TRACE_INDEX_BYTES) <= timestampUs) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return (lo == 0) ? 0 : lo - 1;
+}
+
+uint32_t traceDecodeBlock(const TraceReader &r, uint32_t block, uint16_t *out) {
+  if (block >= r.blockCount) return 0;
+  TraceBlockInfo info = traceBlock(r, block);
+  uint32_t n = traceDecode(r.data + info.offset, info.bytes, out,
+                           r.blockSamples);
+  return (n == info.count) ? n : 0;
+}
@@ -0,0 +1,114 @@
+/*******************************************************************************
+ * ScentAssist - Compressed Sample Trace Files
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Host-side reader/writer for ".sat" motion sensor recordings.
+ *
+ *        A file is a fixed header, a run of independently decodable blocks
+ *        and a block index footer:
+ *
+ *          HEADER   "SATR" | version u16 | blockSamples u16 | rateHz u32 |
+ *                   reserved u32
+ *          BLOCK    count varint | first sample varint |
+ *                   (count - 1) zigzag varint deltas
+ *          INDEX    per block: timestampUs u64 | offset u64 | count u32 |
+ *                   bytes u32
+ *          TRAILER  indexOffset u64 | sampleCount u64 | blockCount u32 |
+ *                   "SATI"
+ *
+ *        All integers are little-endian. Samples within a block are evenly
+ *        spaced at rateHz; a new block (with its own timestamp) starts
+ *        whenever the block fills or the capture has a gap. Readers map the
+ *        file and binary-search the index to seek by timestamp.
+ ******************************************************************************/
+
+#ifndef SCENTTRACE_H
+#define SCENTTRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define TRACE_VERSION 1
+#define TRACE_HEADER_BYTES 16
+#define TRACE_INDEX_BYTES 24
+#define TRACE_TRAILER_BYTES 24
+#define TRACE_DEFAULT_BLOCK 4096
+#define TRACE_MAX_BLOCK 65535
+
+struct TraceBlockInfo {
+  uint64_t timestampUs; // Time of the first sample in the block.
+  uint64_t offset;      // File offset of the encoded block.
+  uint32_t count;       // Samples in the block.
+  uint32_t bytes;       // Encoded size of the block.
+};
+
+/********************************** WRITING ***********************************/
+struct TraceWriter {
+  FILE *file;
+  uint32_t sampleRateHz;
+  uint16_t blockSamples;
+  uint64_t offset;         // Bytes written so far.
+  uint64_t sampleCount;
+  uint64_t segmentTime;    // Timestamp of the present segment.
+  uint64_t segmentSamples; // Samples flushed since the segment began.
+  uint64_t blockTime;      // Timestamp of the block being collected.
+  uint16_t *pending;       // Samples of the block being collected.
+  uint32_t pendingCount;
+  uint8_t *scratch;        // Encoded block buffer.
+  TraceBlockInfo *index;
+  size_t indexCount;
+  size_t indexCapacity;
+};
+
+bool traceCreate(TraceWriter &w, const char *path, uint32_t sampleRateHz,
+                 uint16_t blockSamples = TRACE_DEFAULT_BLOCK);
+
+// Append evenly spaced samples continuing the present segment.
+bool traceAppend(TraceWriter &w, const uint16_t *samples, size_t count);
+
+// Start a new segment whose first sample is taken at timestampUs.
+bool traceSegment(TraceWriter &w, uint64_t timestampUs);
+
+// Flush, write the index footer and close. Returns false on I/O failure.
+bool traceFinish(TraceWriter &w);
+
+/********************************** READING ***********************************/
+struct TraceReader {
+  const uint8_t *data;  // Mapped file contents.
+  size_t size;
+  uint32_t sampleRateHz;
+  uint16_t blockSamples;
+  uint64_t sampleCount;
+  uint32_t blockCount;
+  const uint8_t *index; // Start of the index footer within data.
+};
+
+bool traceOpen(TraceReader &r, const char *path);
+
+void traceClose(TraceReader &r);
+
+TraceBlockInfo traceBlock(const TraceReader &r, uint32_t block);
+
+// Last block starting at or before timestampUs (block 0 if none).
+uint32_t traceFindBlock(const TraceReader &r, uint64_t timestampUs);
+
+// Decode one block into out (room for blockSamples). Returns the number of
+// samples produced, or 0 when the block is corrupt.
+uint32_t traceDecodeBlock(const TraceReader &r, uint32_t block, uint16_t *out);
+
+// Encode/decode the body of a single block.
+size_t traceEncode(const uint16_t *samples, uint32_t count, uint8_t *out);
+
+uint32_t traceDecode(const uint8_t *in, size_t bytes, uint16_t *out,
+                     uint32_t capacity);
+
+// Worst-case encoded size of a block of `count` samples.
+inline size_t traceEncodeBound(uint32_t count) {
+  return 3 + 3 + size_t(count) * 3;
+}
+
+#endif // SCENTTRACE_H
@@ -0,0 +1,209 @@
+/*******************************************************************************
+ * ScentAssist - Interrupt-Driven UART
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ ******************************************************************************/
+
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#include "ScentUart.h"
+
+/********************************** RINGS *************************************/
+// Indexes run free and are masked on use; head - tail is the fill. Each is
+// written from one side only, so neither side needs to mask interrupts.
+static uint8_t txRing[UART_TX_BYTES];
+static volatile uint8_t txHead;   // Written only by the writer.
+static volatile uint8_t txTail;   // Written only by the transmit interrupt.
+static uint8_t rxRing[UART_RX_BYTES];
+static volatile uint8_t rxHead;   // Written only by the receive interrupt.
+static volatile uint8_t rxTail;   // Written only by the reader.
+static uint16_t txDropped;        // Bytes refused for a full ring.
+static volatile uint8_t rxLost;   // Bytes lost on the receive side.
+
+static inline void transmitStart() {
+  /*******    Wake the transmit interrupt; it sleeps once drained.      *******/
+  #ifdef ARDUINO
+  USART3.CTRLA |= USART_DREIE_bm;
+  #endif
+}
+
+/********************************* HARDWARE ***********************************/
+#ifdef ARDUINO
+ISR(USART3_RXC_vect) {
+  if (USART3.RXDATAH & USART_BUFOVF_bm) { // Must be read before RXDATAL.
+    rxLost++;
+  }
+  uartDeliver(USART3.RXDATAL);
+}
+
+ISR(USART3_DRE_vect) {
+  uint8_t byte;
+  if (uartTake(byte)) {
+    USART3.TXDATAL = byte;
+  }
+  if (txTail == txHead) {
+    // Also covers a wake-up that arrives after the ring was drained.
+    USART3.CTRLA &= ~USART_DREIE_bm;
+  }
+}
+
+void uartBegin(uint32_t baud) {
+  /*******  USB pins and oscillator trim, as the core's Serial has them *******/
+  int32_t setting = int32_t(((8 * F_CPU) / baud + 1) / 2); // 64 F / 16 baud
+  setting += (setting * int8_t(SIGROW.OSC16ERR5V)) / 1024;
+
+  USART3.CTRLB = 0;
+  txHead = 0;
+  txTail = 0;
+  rxHead = 0;
+  rxTail = 0;
+  txDropped = 0;
+  rxLost = 0;
+
+  PORTMUX.USARTROUTEA = (PORTMUX.USARTROUTEA & ~PORTMUX_USART3_gm) |
+                        PORTMUX_USART3_ALT1_gc; // TX PB4, RX PB5
+  PORTB.OUTSET = PIN4_bm; // Idle high from the first edge.
+  PORTB.DIRSET = PIN4_bm;
+  USART3.BAUD = uint16_t(setting);
+  USART3.CTRLC = USART_CMODE_ASYNCHRONOUS_gc | USART_PMODE_DISABLED_gc |
+                 USART_SBMODE_1BIT_gc | USART_CHSIZE_8BIT_gc;
+  USART3.CTRLA = USART_RXCIE_bm;
+  USART3.CTRLB = USART_RXEN_bm | USART_TXEN_bm;
+}
+#endif
+
+/********************************* TRANSMIT ***********************************/
+uint8_t uartRoom() {
+  return uint8_t(UART_TX_BYTES - uint8_t(txHead - txTail));
+}
+
+uint8_t *uartReserve(uint8_t &length) {
+  /*******     Free space from the head up to the tail or the wrap.     *******/
+  uint8_t head = txHead;
+  uint8_t offset = head & (UART_TX_BYTES - 1);
+  uint8_t room = uartRoom();
+  uint8_t toWrap = uint8_t(UART_TX_BYTES - offset);
+  if (room > toWrap) {
+    room = toWrap;
+  }
+  if (length > room) {
+    length = room;
+  }
+  return &txRing[offset];
+}
+
+void uartCommit(uint8_t length) {
+  if (length > 0) {
+    txHead = uint8_t(txHead + length);
+    transmitStart();
+  }
+}
+
+uint8_t uartWrite(const uint8_t *data, uint8_t length) {
+  /*******   Copy what fits, in at most two pieces around the wrap.     *******/
+  uint8_t taken = 0;
+  for (uint8_t piece = 0; (piece < 2) && (taken < length); piece++) {
+    uint8_t count = uint8_t(length - taken);
+    uint8_t *space = uartReserve(count);
+    memcpy(space, &data[taken], count);
+    uartCommit(count);
+    taken += count;
+  }
+  return taken;
+}
+
+static void putText(const char *text, uint8_t length) {
+  /*******          All or nothing, so lines never arrive torn.         *******/
+  if (length > uartRoom()) {
+    txDropped += length;
+    return;
+  }
+  uartWrite(reinterpret_cast<const uint8_t *>(text), length);
+}
+
+void uartPrint(const char *text) {
+  size_t length = strlen(text);
+  putText(text, (length < 0xFF) ? uint8_t(length) : 0xFF); // 0xFF never fits.
+}
+
+void uartPrintChar(char c) {
+  putText(&c, 1);
+}
+
+void uartPrintNumber(uint32_t value) {
+  uartPrintFixed(value, 0);
+}
+
+void uartPrintFixed(uint32_t value, uint8_t decimals) {
+  /*******    Digits are built from the right, then sent as one piece. *******/
+  char digits[12]; // 4294967295 and a point
+  uint8_t n = sizeof(digits);
+  uint8_t place = 0;
+  if (decimals > 9) {
+    decimals = 9;
+  }
+  do {
+    if ((place == decimals) && (decimals > 0)) {
+      digits[--n] = '.';
+    }
+    digits[--n] = char('0' + value % 10);
+    value /= 10;
+    place++;
+  } while ((value > 0) || (place <= decimals));
+  putText(&digits[n], uint8_t(sizeof(digits) - n));
+}
+
+void uartPrintln(const char *text) {
+  uartPrint(text);
+  uartPrintln();
+}
+
+void uartPrintln() {
+  putText("\r\n", 2);
+}
+
+uint16_t uartDropped() {
+  return txDropped;
+}
+
+/********************************** RECEIVE ***********************************/
+bool uartRead(uint8_t &byte) {
+  uint8_t tail = rxTail;
+  if (tail == rxHead) {
+    return false;
+  }
+  byte = rxRing[tail & (UART_RX_BYTES - 1)];
+  rxTail = uint8_t(tail + 1);
+  return true;
+}
+
+uint8_t uartLost() {
+  return rxLost;
+}
+
+/****************************** INTERRUPT SIDE ********************************/
+bool uartTake(uint8_t &byte) {
+  uint8_t tail = txTail;
+  if (tail == txHead) {
+    return false;
+  }
+  byte = txRing[tail & (UART_TX_BYTES - 1)];
+  txTail = uint8_t(tail + 1);
+  return true;
+}
+
+void uartDeliver(uint8_t byte) {
+  uint8_t head = rxHead;
+  if (uint8_t(head - rxTail) >= UART_RX_BYTES) {
+    rxLost++; // The reader is behind; keep what it has not seen yet.
+    return;
+  }
+  rxRing[head & (UART_RX_BYTES - 1)] = byte;
+  rxHead = uint8_t(head + 1);
+}
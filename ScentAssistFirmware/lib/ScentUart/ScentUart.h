@@ -0,0 +1,98 @@
+/*******************************************************************************
+ * ScentAssist - Interrupt-Driven UART
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Lean stand-in for Arduino's Serial on the USB port (USART3 of the
+ *        Nano Every's ATmega4809). Each direction is a ring buffer, sized at
+ *        compile time, serviced by its own interrupt. Nothing here waits: a
+ *        piece of text goes into the ring whole or, when there is no room,
+ *        is dropped and counted, so a report costs the same few cycles per
+ *        byte whether or not anyone is listening. Binary streams can build
+ *        their bytes straight in the ring with uartReserve()/uartCommit().
+ *        Numbers are formatted with integer arithmetic only.
+ *
+ *        The rings are plain memory; off the target the caller plays the
+ *        part of the interrupts with uartTake() and uartDeliver().
+ *
+ * USAGE: uartBegin(115200);
+ *        uartPrint("State: "); uartPrintln(stateName(state));
+ *
+ *        uint8_t length = 16;
+ *        uint8_t *space = uartReserve(length); // length: bytes granted
+ *        ... fill up to length bytes of space ...
+ *        uartCommit(used);
+ ******************************************************************************/
+
+#ifndef SCENTUART_H
+#define SCENTUART_H
+
+#include <stdint.h>
+
+// Ring sizes in bytes: powers of two up to 128 (the indexes are 8-bit).
+#ifndef UART_TX_BYTES
+#define UART_TX_BYTES 128 // Longest burst of reports sent within a scan.
+#endif
+#ifndef UART_RX_BYTES
+#ifdef MODBUS
+#define UART_RX_BYTES 128 // A whole request, even across a blocking delay.
+#else
+#define UART_RX_BYTES 32  // Bytes arriving between two scans.
+#endif
+#endif
+
+static_assert((UART_TX_BYTES & (UART_TX_BYTES - 1)) == 0 &&
+              UART_TX_BYTES >= 16 && UART_TX_BYTES <= 128,
+              "UART_TX_BYTES must be a power of two from 16 to 128");
+static_assert((UART_RX_BYTES & (UART_RX_BYTES - 1)) == 0 &&
+              UART_RX_BYTES >= 8 && UART_RX_BYTES <= 128,
+              "UART_RX_BYTES must be a power of two from 8 to 128");
+
+#ifdef ARDUINO
+// 8N1 at `baud` on the USB pins, interrupts on; both rings empty.
+void uartBegin(uint32_t baud);
+#endif
+
+/********************************* TRANSMIT ***********************************/
+// Free bytes in the transmit ring.
+uint8_t uartRoom();
+
+// Contiguous free space for up to `length` bytes; `length` comes back as
+// what was granted (fewer at the end of the ring, zero when it is full).
+uint8_t *uartReserve(uint8_t &length);
+
+// Send the first `length` bytes of the space just reserved.
+void uartCommit(uint8_t length);
+
+// As many of `length` bytes as fit now; returns how many were taken.
+uint8_t uartWrite(const uint8_t *data, uint8_t length);
+
+// Text: each call is taken whole or dropped whole.
+void uartPrint(const char *text);
+void uartPrintChar(char c);
+void uartPrintNumber(uint32_t value);
+// `value` scaled by 10^decimals, e.g. (1234, 1) prints "123.4".
+void uartPrintFixed(uint32_t value, uint8_t decimals);
+void uartPrintln(const char *text);
+void uartPrintln();
+
+// Bytes of text dropped for a full ring since uartBegin().
+uint16_t uartDropped();
+
+/********************************** RECEIVE ***********************************/
+// The oldest received byte; false when none is waiting.
+bool uartRead(uint8_t &byte);
+
+// Received bytes lost to a full ring or a late interrupt (wraps).
+uint8_t uartLost();
+
+/****************************** INTERRUPT SIDE ********************************/
+// The next byte to put on the wire; false once the ring is empty.
+bool uartTake(uint8_t &byte);
+
+// A byte off the wire.
+void uartDeliver(uint8_t byte);
+
+#endif // SCENTUART_H
@@ -11,8 +11,72 @@
  ******************************************************************************/
 
 #include <Arduino.h>
+#include <EEPROM.h>
+#include <ScentCore.h>
+#include <ScentTimebase.h>
+#include <ScentUart.h>
 
 //#define DEBUG true  // Uncomment to Turn On Motion Sensor Debugging Statements
+//#define CAPTURE true // Uncomment to Stream Raw Samples (see tools/capture)
+//#define BENCH true   // Uncomment to Print Filter Cycle Costs at Startup
+//#define LOADMETER true // Uncomment to Report CPU Load Once a Second
+//#define SIGNALGEN true // Uncomment to Replace the Sensor with a Generator
+// MODBUS (serve Modbus RTU, see tools/modbuspty) is a build flag only, as
+// ScentUart sizes its receive ring from it: pio run -e nano_every_modbus.
+
+#ifdef CAPTURE
+#include <ScentCapture.h>
+#endif
+#ifdef LOADMETER
+#include <ScentLoad.h>
+#endif
+#ifdef MODBUS
+#include <ScentModbus.h>
+#endif
+#ifdef SIGNALGEN
+#include <ScentSignal.h>
+#endif
+
+// Human-readable reports use the port unless a binary protocol owns it.
+#if !defined(CAPTURE) && !defined(MODBUS)
+#define SERIAL_TEXT true
+#endif
+
+// Scans per second of the timer-driven executive; 0 lets loop() run free.
+#ifndef SCAN_RATE_HZ
+#define SCAN_RATE_HZ 0
+#endif
+#if SCAN_RATE_HZ
+#include <ScentExec.h>
+#endif
+
+// ADC readings per decimated sample; 0 samples with analogRead() instead.
+#ifndef CIC_RATIO
+#define CIC_RATIO 0
+#endif
+#ifndef CIC_ORDER
+#define CIC_ORDER 3
+#endif
+
+#if defined(CAPTURE) && defined(LOADMETER)
+#error "CAPTURE and LOADMETER both need the serial port; pick one."
+#endif
+#if defined(MODBUS) && \
+    (defined(CAPTURE) || defined(LOADMETER) || defined(DEBUG))
+#error "MODBUS needs the serial port to itself; drop CAPTURE/LOADMETER/DEBUG."
+#endif
+#if defined(LOADMETER) && !SCAN_RATE_HZ
+#error "LOADMETER counts idle time between executive scans; set SCAN_RATE_HZ."
+#endif
+#if CIC_RATIO && !SCAN_RATE_HZ
+#error "CIC_RATIO paces the ADC to the executive's scans; set SCAN_RATE_HZ."
+#endif
+#if defined(SIGNALGEN) && !SCAN_RATE_HZ
+#error "SIGNALGEN keeps time by readings taken; set SCAN_RATE_HZ."
+#endif
+#if defined(SIGNALGEN) && CIC_RATIO
+#error "SIGNALGEN replaces the ADC; drop CIC_RATIO."
+#endif
 
 /**************************** PIN DEFINITIONS *********************************/
 #define MOTION_INPUT_PIN A0
@@ -20,289 +84,1028 @@
 #define RELAY_OUTPUT_PIN 6
 #define LED_OUTPUT_PIN 11
 
-/*************************** GENERAL CONSTANTS ********************************/
-#define FILTER_LENGTH 10 // Seemed Reasonable
-#define MIN_THRESHOLD 20 // Determined by Experimentation
-
-/***************************** TIME CONSTANTS *********************************/
-const uint32_t c_DELAY_TIME = 300000000;          // 5 Minutes
-const uint32_t c_RUN_TIME = 480000000;            // 8 Minutes
-const uint32_t c_HEARTBEAT_BLINK_TIME = 5000000;  // 5 Seconds
-const uint32_t c_BLOCK_DETECTION_DELAY = 3000000; // 3 Seconds
-const uint32_t c_WAITING_BLINK_TIME = 100000;     // 100 Milliseconds
-const uint32_t c_DETECTION_INTER_DELAY = 100000;  // 100 Milliseconds
-const float c_IIR_COEF = 0.40;
-
-/*************************** STATE ENUMERATIONS *******************************/
-enum controlState {
-  IDLE = 0,
-  DETECTED,
-  ACTIVATE,
-  RESET
-};
+/**************************** EEPROM LAYOUT ***********************************/
+#define EEPROM_LEARN_ADDR 0 // LearnRecord: sensitivity learned from feedback.
+#define EEPROM_PROFILE_SELECT_ADDR 8 // Index of the profile in force.
+#define EEPROM_PROFILE_ADDR 16 // ProfileRecord[PROFILE_COUNT]: households.
+static_assert(EEPROM_PROFILE_ADDR + PROFILE_COUNT * sizeof(ProfileRecord) <=
+              EEPROM_SIZE, "profiles overrun the EEPROM");
 
-/****************************      SETUP      *********************************/
-void setup() {
-  Serial.begin(115200);
-  Serial.println("ScentAssist STARTUP - (c) STANLEY SOLUTIONS");
+/************************** SCAN EXECUTIVE SETTINGS ***************************/
+#if SCAN_RATE_HZ
+static_assert((F_CPU / 2) / SCAN_RATE_HZ <= 65536,
+              "SCAN_RATE_HZ is too slow for the 16-bit scan timer");
+static_assert(SCAN_RATE_HZ <= 10000, "SCAN_RATE_HZ leaves no time to scan");
+const uint16_t c_SCAN_PERIOD_US = 1000000UL / SCAN_RATE_HZ;
+const uint16_t c_SCAN_TIMER_TOP = (F_CPU / 2) / SCAN_RATE_HZ - 1; // TCB2 ticks
+const uint16_t c_EXEC_REPORT_SCANS = SCAN_RATE_HZ; // Summaries once a second.
+#endif
 
-  // Initialize the I/O Pins
-  pinMode(MOTION_INPUT_PIN, INPUT);
-  pinMode(PUSHBUTTON_INPUT_PIN, INPUT_PULLUP);
-  pinMode(RELAY_OUTPUT_PIN, OUTPUT);
-  pinMode(LED_OUTPUT_PIN, OUTPUT);
-  pinMode(LED_BUILTIN, OUTPUT);
+/************************** OVERSAMPLING SETTINGS *****************************/
+// The ADC is triggered by TCB1 through the event system at exactly
+// CIC_RATIO readings per qualified sample, so the decimated stream stays
+// locked to the scan rate; the queue only absorbs the phase between them.
+#if CIC_RATIO
+const uint32_t c_ADC_RATE_HZ = uint32_t(SCAN_RATE_HZ) * SAMPLE_BLOCK * CIC_RATIO;
+static_assert(c_ADC_RATE_HZ <= 50000,
+              "CIC_RATIO asks more of the ADC than it converts");
+static_assert((F_CPU / 2) / c_ADC_RATE_HZ <= 65536,
+              "CIC_RATIO is too slow for the 16-bit ADC trigger timer");
+const uint16_t c_ADC_TIMER_TOP = (F_CPU / 2) / c_ADC_RATE_HZ - 1; // TCB1 ticks
+const uint8_t c_CIC_QUEUE = 16; // Decimated samples awaiting a scan.
+static_assert((c_CIC_QUEUE & (c_CIC_QUEUE - 1)) == 0 &&
+              c_CIC_QUEUE > 2 * SAMPLE_BLOCK + 1,
+              "the decimated queue must be a power of two holding two scans");
+#endif
 
-  // Set Output Defaults
-  digitalWrite(RELAY_OUTPUT_PIN, false);
-  for (uint8_t i = 0; i < 10; i++) {
-    digitalWrite(LED_OUTPUT_PIN, true);
-    delay(100);
-    digitalWrite(LED_OUTPUT_PIN, false);
-    delay(100);
-  }
+/***************************** SERIAL SETTINGS ********************************/
+const uint32_t c_SERIAL_BAUD = 115200;
+
+#ifndef MODBUS_ADDRESS
+#define MODBUS_ADDRESS 1 // Slave address; give each unit on a bus its own.
+#endif
+#ifdef MODBUS
+static_assert(UART_RX_BYTES >= MODBUS_FRAME_MAX,
+              "a whole Modbus request must fit the UART receive ring; "
+              "set MODBUS in build_flags, not in this file");
+#endif
+
+/***************************** CAPTURE SETTINGS *******************************/
+// Every sample of a scan's block is streamed, evenly spaced across one scan
+// period: the executive's under SCAN_RATE_HZ, otherwise a slot no faster
+// than loop() spins. SIGNALGEN and CIC_RATIO samples fall on that grid
+// already; analogRead() is paced onto it, so each period must outlast one
+// conversion.
+#if SCAN_RATE_HZ
+const uint16_t c_CAPTURE_SCAN_US = c_SCAN_PERIOD_US;
+#else
+const uint16_t c_CAPTURE_SCAN_US = 500;          // 2 kHz of blocks
+#endif
+static_assert(c_CAPTURE_SCAN_US % SAMPLE_BLOCK == 0,
+              "a scan period must split evenly into SAMPLE_BLOCK samples");
+const uint16_t c_CAPTURE_PERIOD_US = c_CAPTURE_SCAN_US / SAMPLE_BLOCK;
+
+/************************* SIGNAL GENERATOR SETTINGS **************************/
+// Readings come from ScentSignal in place of the sensor, one per sample slot
+// of the executive, so a run is the same on every board and every boot.
+#ifdef SIGNALGEN
+#ifndef SIGNALGEN_PATTERN
+#define SIGNALGEN_PATTERN SIGNAL_SPIKES
+#endif
+static_assert(uint32_t(SCAN_RATE_HZ) * SAMPLE_BLOCK <= 0xFFFF,
+              "SIGNALGEN counts readings per second in 16 bits");
+const uint16_t c_SIGNAL_RATE_HZ = SCAN_RATE_HZ * SAMPLE_BLOCK;
+const uint16_t c_SIGNAL_SEED = 1;
+#endif
 
-  Serial.println("READY.");
+/**************************** LOAD METER SETTINGS *****************************/
+const uint32_t c_LOAD_WINDOW_US = 1000000;       // Report once a second.
+
+/**************************** PUSHBUTTON SETTINGS *****************************/
+// A short press reaches the controller on release; holding the button steps
+// to the next profile instead, so the fan is not toggled on the way.
+const uint32_t c_BUTTON_PRESS_US = 30000;        // Shorter contact is bounce.
+const uint32_t c_PROFILE_HOLD_US = 3000000;      // Long press: next profile.
+const uint16_t c_PROFILE_RELEASE_MS = 5000;      // Startup wait for release.
+
+/***************************** CONTROLLER STATE *******************************/
+static ControllerState controller; // All state carried between scans.
+static TimebaseClock timebase; // Microseconds, advanced from TCB0 ticks.
+#ifdef CAPTURE
+static CaptureEncoder capture; // Framed sample stream to the host.
+#endif
+#ifdef SIGNALGEN
+static SignalGenerator generator; // Stands in for the motion sensor.
+#endif
+#ifdef LOADMETER
+static LoadMeter load; // Idle counts and per-section time of loop().
+#define LOAD_MARK(section) loadMark(load, section, timeNow())
+#else
+#define LOAD_MARK(section)
+#endif
+
+/********************************* TIMEBASE ***********************************/
+static uint32_t timeNow() {
+  /*******  Read the tick counter once and bring the clock up to it.   *******/
+  return timebaseAdvance(timebase, timebaseRead());
 }
 
-uint32_t timepassed(uint32_t timeLeft, unsigned long lastTime) {
-  /*******   Evaluate the difference, do not allow negative-overflow.   *******/
-  uint32_t timeElapsed;
+/***************************** CYCLE BENCHMARK ********************************/
+#ifdef BENCH
+const uint16_t c_BENCH_SAMPLES = 4096; // Readings timed per measurement.
 
-  timeElapsed = uint32_t(micros() - lastTime);
+static void benchReport(const char *label, uint8_t n, uint32_t elapsedTicks,
+                        uint16_t samples) {
+  /*******       Print the measured cost in CPU cycles per sample.      *******/
+  uartPrint(label);
+  uartPrintNumber(n);
+  uartPrint(": ");
+  uartPrintFixed(elapsedTicks * (10 * TIMEBASE_CPU_CYCLES) / samples, 1);
+  uartPrintln(" cycles/sample");
+}
 
-  // Evaluate Time Remaining, 0 as an absolute minimum.
-  if (timeElapsed < timeLeft) {
-    timeLeft -= timeElapsed;
-  } else {
-    timeLeft = 0;
+template <uint8_t N>
+static void benchBlock(const uint16_t *readings) {
+  /*******   Time qualifyAnalogBlock<N>() over c_BENCH_SAMPLES readings. *******/
+  FilterState filter = {};
+  volatile uint8_t sink = 0;
+  uint32_t start = timebaseRead();
+  for (uint16_t b = 0; b < c_BENCH_SAMPLES / N; b++) {
+    sink += qualifyAnalogBlock<N>(filter, c_FILTER_PARAMS, readings);
   }
+  benchReport("Filter block ", N, timebaseRead() - start, c_BENCH_SAMPLES);
+}
 
-  return timeLeft;
+template <uint8_t K>
+static void benchMedian(const uint16_t *readings) {
+  /*******    Time the K-tap median network; its cost is data-blind.    *******/
+  MedianWindow<K> median = {};
+  volatile uint16_t sink = 0;
+  uint32_t start = timebaseRead();
+  for (uint16_t n = 0; n < c_BENCH_SAMPLES; n++) {
+    sink += medianPush(median, readings[n % 16]);
+  }
+  benchReport("Median taps ", K, timebaseRead() - start, c_BENCH_SAMPLES);
 }
 
-bool qualifyAllBits(uint8_t val) {
-  /*******             Evaluate whether all bits are set.               *******/
-  uint8_t mask = (1ULL << 8) - 1;
-  val &= mask;
-  return val == mask;
+template <uint8_t ORDER>
+static void benchCic(const uint16_t *readings) {
+  /*******   Time the ORDER-stage CIC at 8:1, per raw ADC reading.       *******/
+  CicDecimator<ORDER, 8> decimator = {};
+  volatile uint16_t sink = 0;
+  uint16_t output;
+  uint32_t start = timebaseRead();
+  for (uint16_t n = 0; n < c_BENCH_SAMPLES; n++) {
+    if (cicPush(decimator, readings[n % 16], output)) {
+      sink += output;
+    }
+  }
+  benchReport("CIC 8:1 order ", ORDER, timebaseRead() - start,
+              c_BENCH_SAMPLES);
 }
 
-bool qualifyAnalog() {
-  /*******   Qualify analog input to determine motion sensor pickup.    *******/
-  static uint8_t readings[FILTER_LENGTH];
-  static uint8_t readingIndex;
-  uint8_t sample = analogRead(MOTION_INPUT_PIN); // Collect This Sample
-  uint8_t average = 0;
-  bool detect;
+static void benchFilter() {
+  /*******  Filter and full-scan cost per sample for several blocks.    *******/
+  uint16_t readings[16];
+  ControllerState ctrl;
+  ScanInputs in;
+  ScanOutputs out;
 
-  // Evaluate Average
-  for (uint8_t i = 0; i++; i < FILTER_LENGTH) {
-    average += readings[i];
+  for (uint8_t n = 0; n < 16; n++) {
+    readings[n] = analogRead(MOTION_INPUT_PIN);
   }
-  average = average / FILTER_LENGTH;
+  benchBlock<1>(readings);
+  benchBlock<2>(readings);
+  benchBlock<4>(readings);
+  benchBlock<8>(readings);
+  benchBlock<16>(readings);
+  benchMedian<3>(readings);
+  benchMedian<5>(readings);
+  benchMedian<7>(readings);
+  benchCic<2>(readings);
+  benchCic<3>(readings);
 
-  // Run Sample through Filter
-  sample = uint8_t(
-    (float(average) * c_IIR_COEF) + (float(sample) * (1-c_IIR_COEF))
-  );
-
-  // Load the Most Recent Sample
-  readings[readingIndex] = sample;
-  
-  // Update Index
-  if (readingIndex == FILTER_LENGTH) {
-    readingIndex = 0;
-  } else {
-    readingIndex++;
+  // Whole scan at this build's SAMPLE_BLOCK, amortized per sample.
+  controllerInit(ctrl, timeNow());
+  for (uint8_t n = 0; n < SAMPLE_BLOCK; n++) {
+    in.samples[n] = readings[n % 16];
   }
+  in.manualActivate = false;
+  uint32_t start = timebaseRead();
+  for (uint16_t b = 0; b < c_BENCH_SAMPLES / SAMPLE_BLOCK; b++) {
+    in.now = timeNow();
+    controllerScan(ctrl, in, out);
+  }
+  benchReport("Scan block ", SAMPLE_BLOCK, timebaseRead() - start,
+              c_BENCH_SAMPLES);
+}
+#endif
 
-  detect = sample > (4 * max(MIN_THRESHOLD, average));
+/******************************* OVERSAMPLING *********************************/
+#if CIC_RATIO
+static CicDecimator<CIC_ORDER, CIC_RATIO> cic; // Owned by the ADC interrupt.
+static volatile uint16_t cicQueue[c_CIC_QUEUE]; // Decimated samples.
+static volatile uint8_t cicHead;    // Written only by the interrupt.
+static volatile uint8_t cicTail;    // Written only by loop().
+static uint8_t cicHeld;             // Samples repeated for an empty queue.
 
-  /***************               DEBUGGING CODE               *****************/
-  #ifdef DEBUG
-  char buffer[255];
-  sprintf(buffer, "Average: %d\t\tSample: %d\t\tResult: %d",
-    average, sample, detect);
-  Serial.println(buffer);
-  #endif
-  /****************************************************************************/
-  
-  // Compare Sample to Average - If Sample is > 2*average: Spike Detected
-  return detect;
+ISR(ADC0_RESRDY_vect) {
+  uint16_t output;
+  if (cicPush(cic, ADC0.RES, output)) { // Reading RES clears the flag.
+    // Overwrites the oldest while loop() is not scanning; cicTake() skips
+    // ahead to the newest samples when it resumes.
+    uint8_t head = cicHead;
+    cicQueue[head & (c_CIC_QUEUE - 1)] = output;
+    cicHead = head + 1;
+  }
 }
 
-void blink(uint32_t blinkFrequency) {
-  /*******   Blink the LED at a specified frequency of milliseconds.    *******/
-  static unsigned long lastUSec = 0;
-  static uint32_t usecRemaining = 0;
+static void cicBegin() {
+  /*******  TCB1 starts each conversion via event channel 0; no ISR.   *******/
+  TCB1.CTRLA = 0;
+  TCB1.CTRLB = TCB_CNTMODE_INT_gc;
+  TCB1.CCMP = c_ADC_TIMER_TOP;
+  TCB1.CNT = 0;
+  EVSYS.CHANNEL0 = EVSYS_GENERATOR_TCB1_CAPT_gc;
+  EVSYS.USERADC0 = EVSYS_CHANNEL_CHANNEL0_gc;
 
-  // Deduct the milliseconds that have passed since last scan.
-  usecRemaining = timepassed(usecRemaining, lastUSec);
+  ADC0.CTRLA = 0;
+  ADC0.CTRLB = ADC_SAMPNUM_ACC1_gc;
+  ADC0.CTRLC = ADC_SAMPCAP_bm | ADC_REFSEL_VDDREF_gc | ADC_PRESC_DIV16_gc;
+  ADC0.MUXPOS = digitalPinToAnalogInput(MOTION_INPUT_PIN) << ADC_MUXPOS_gp;
+  ADC0.EVCTRL = ADC_STARTEI_bm;
+  ADC0.INTFLAGS = ADC_RESRDY_bm;
+  ADC0.INTCTRL = ADC_RESRDY_bm;
+  ADC0.CTRLA = ADC_RESSEL_10BIT_gc | ADC_ENABLE_bm;
 
-  if (usecRemaining == 0) {
-    // Change State of LED
-    if (!digitalRead(LED_OUTPUT_PIN)) {
-      digitalWrite(LED_OUTPUT_PIN, true);
+  TCB1.CTRLA = TCB_CLKSEL_CLKDIV2_gc | TCB_ENABLE_bm;
+}
+
+static void cicTake(uint16_t *samples) {
+  /*******  One scan's samples, oldest first; hold the last if short.  *******/
+  static uint16_t last;
+  uint8_t head = cicHead;
+  uint8_t tail = cicTail;
 
-      // Short Period
-      usecRemaining = 100000; // 100 milliseconds
+  // Samples left over from startup or a debounce delay are stale (some may
+  // be overwritten); keep one spare beyond this scan to ride out the phase
+  // between the two timers.
+  if (uint8_t(head - tail) > 2 * SAMPLE_BLOCK + 1) {
+    tail = head - (SAMPLE_BLOCK + 1);
+  }
+  for (uint8_t n = 0; n < SAMPLE_BLOCK; n++) {
+    if (tail != head) {
+      last = cicQueue[tail & (c_CIC_QUEUE - 1)];
+      tail++;
     } else {
-      digitalWrite(LED_OUTPUT_PIN, false);
+      cicHeld++;
+    }
+    samples[n] = last;
+  }
+  cicTail = tail;
+}
 
-      // Reset/Update Blink Frequency
-      usecRemaining = blinkFrequency;
+#ifdef SERIAL_TEXT
+static void cicPrint() {
+  /*******   Samples held since the last report; silent when locked.   *******/
+  static uint8_t held;
+  if (cicHeld != held) {
+    uartPrint("ADC Queue Underruns: ");
+    uartPrintNumber(uint8_t(cicHeld - held));
+    uartPrintln();
+    held = cicHeld;
+  }
+}
+#endif
+#endif
+
+/****************************** LEARNED REPORT ********************************/
+static void learnPrint(const char *label) {
+  /*******   The learned threshold to two places, then its multiplier.  *******/
+  uartPrint(label);
+  uartPrintFixed((uint32_t(controller.learn.thresholdQ4) * 100 + 8) / 16, 2);
+  uartPrint(" x");
+  uartPrintNumber(controller.learn.multiplier);
+  uartPrintln();
+}
+
+static void learnSave() {
+  /*******   Persist the learned values (EEPROM writes changed bytes).  *******/
+  LearnRecord record;
+  learnStore(controller.learn, record);
+  EEPROM.put(EEPROM_LEARN_ADDR, record);
+}
+
+/********************************* PROFILES ***********************************/
+// Every profile is decoded and checked once at startup; switching is then
+// controllerSetProfile() on an entry already in RAM.
+static ControllerProfile profiles[PROFILE_COUNT];
+
+static uint16_t profileAddress(uint8_t index) {
+  return EEPROM_PROFILE_ADDR + index * sizeof(ProfileRecord);
+}
+
+static void profileSave(uint8_t index) {
+  /*******        Persist a profile changed while running.            *******/
+  ProfileRecord record;
+  profileStore(profiles[index], record);
+  EEPROM.put(profileAddress(index), record);
+}
+
+static void profilePrint(uint8_t index) {
+  /*******          Name a profile, marking the one in force.           *******/
+  uartPrint((controller.profile == &profiles[index]) ? "* " : "  ");
+  uartPrintNumber(index);
+  uartPrint(": ");
+  for (uint8_t n = 0; n < PROFILE_NAME_LENGTH && profiles[index].name[n]; n++) {
+    uartPrintChar(profiles[index].name[n]);
+  }
+  uartPrintln();
+}
+
+static uint8_t profilesBegin(bool &stepped) {
+  /*******  Load all profiles; holding the button steps to the next.   *******/
+  for (uint8_t i = 0; i < PROFILE_COUNT; i++) {
+    ProfileRecord record;
+    EEPROM.get(profileAddress(i), record);
+    if (!profileRestore(profiles[i], c_LEARN_PARAMS, record)) {
+      profiles[i] = c_FACTORY_PROFILES[i]; // Erased or damaged: reseed it.
+      profileSave(i);
     }
   }
-  
-  lastUSec = micros();
+
+  uint8_t index = EEPROM.read(EEPROM_PROFILE_SELECT_ADDR);
+  if (index >= PROFILE_COUNT) {
+    index = 0;
+  }
+  stepped = digitalRead(PUSHBUTTON_INPUT_PIN);
+  if (stepped) {
+    // Show the new profile's number, then wait so it is not a fan start.
+    uint8_t next = (index + 1) % PROFILE_COUNT;
+    delay(500);
+    for (uint8_t i = 0; i <= next; i++) {
+      digitalWrite(LED_OUTPUT_PIN, true);
+      delay(300);
+      digitalWrite(LED_OUTPUT_PIN, false);
+      delay(300);
+    }
+    uint32_t start = millis();
+    while (digitalRead(PUSHBUTTON_INPUT_PIN) &&
+           (millis() - start < c_PROFILE_RELEASE_MS)) {}
+    // A button never released is stuck, not a choice: keep the stored one.
+    stepped = !digitalRead(PUSHBUTTON_INPUT_PIN);
+    if (stepped) {
+      index = next;
+      EEPROM.update(EEPROM_PROFILE_SELECT_ADDR, index);
+    }
+  }
+  return index;
 }
 
+static void profileSelect(uint8_t index) {
+  /*******  Switch households now; learning restarts from the profile. *******/
+  controllerSetProfile(controller, &profiles[index]);
+  EEPROM.update(EEPROM_PROFILE_SELECT_ADDR, index);
+  learnSave();
+}
 
-/****************************      EXECUTE    *********************************/
-void loop() {
-  static controlState state = controlState::IDLE; // Operating State of System.
-  static unsigned long lastUSec = 0; // Last time which was sampled.
-  static uint32_t timeRemaining = 0; // Time remaining until fan start.
-  static uint32_t stopDetection = 0; // Blocking condition for motion detect.
-  static uint32_t fanTimeRemain = 0; // Time remaining of fan run.
-  static uint32_t blockMotionIn = 0; // Time to block motion sensor input.
-  static uint32_t sampleReadTime = 0; // Time between qualifying motion samples.
-  static uint8_t detectionSet = 0; // Set of detection samples.
-  static bool fanRunning = false; // Control indicator that fan is running.
-  controlState nextState = state; // Next state system will operate in.
-  bool motionDetected = false; // Motion has been detected.
-  bool manualActivate = false; // Manually activated by pushbutton.
-  bool detect; // Instantaneous Motion detection.
-
-  // Read and Qualify Motion Input
-  if (blockMotionIn == 0) {
-    detect = qualifyAnalog();
-
-    if (sampleReadTime == 0) {
-      detectionSet = detectionSet << 1; // Shift oldest sample off
-      detectionSet |= uint8_t(detect); // Set Lowest Bit According to Detection
-      sampleReadTime = c_DETECTION_INTER_DELAY;
+static bool buttonService(bool pressed, uint32_t now) {
+  /*******  True on release of a short press; a long one steps profile. *******/
+  // A press already down at startup was the startup gesture (or is stuck).
+  static bool held = true;        // Pressed at the last scan.
+  static bool stepped = true;     // This press already changed profile.
+  static uint32_t pressedAt = 0;
+  bool release = false;
+
+  if (pressed && !held) {
+    pressedAt = now;
+    stepped = false;
+  } else if (pressed && !stepped && (now - pressedAt >= c_PROFILE_HOLD_US)) {
+    uint8_t next = (uint8_t(controller.profile - profiles) + 1) % PROFILE_COUNT;
+    stepped = true;
+    profileSelect(next);
+    #ifdef SERIAL_TEXT
+    uartPrint("Profile ");
+    profilePrint(next);
+    #endif
+  } else if (!pressed && held) {
+    release = !stepped && (now - pressedAt >= c_BUTTON_PRESS_US);
+  }
+  held = pressed;
+  return release;
+}
+
+/***************************** SIGNAL GENERATOR *******************************/
+#ifdef SIGNALGEN
+static void signalSelect(signalPattern pattern) {
+  /*******     Restart the generator; every run begins the same way.    *******/
+  signalBegin(generator, pattern, c_SIGNAL_PARAMS, c_SIGNAL_RATE_HZ,
+              c_SIGNAL_SEED);
+  #ifdef SERIAL_TEXT
+  uartPrint("Signal Generator: ");
+  uartPrintln(signalPatternName(pattern));
+  #endif
+}
+
+#ifdef SERIAL_TEXT
+static void signalReport(const ScanOutputs &outputs) {
+  /*******   Time from each generated event to its motion start.      *******/
+  static uint16_t seen;    // Latest event begun.
+  static bool detected;    // ... and motion has started since.
+
+  if (generator.events != seen) {
+    if ((seen != 0) && !detected) {
+      uartPrint("Signal Event ");
+      uartPrintNumber(seen);
+      uartPrintln(" Missed");
+    }
+    seen = generator.events;
+    detected = false;
+  }
+  if (outputs.motion == motionEvent::MOTION_START) {
+    if ((seen != 0) && !detected) {
+      detected = true;
+      uartPrint("Signal Event ");
+      uartPrintNumber(seen);
+      uartPrint(" Detected after ");
+      uartPrintNumber(signalEventMs(generator));
+      uartPrintln(" ms");
     } else {
-      sampleReadTime = timepassed(sampleReadTime, lastUSec);
+      uartPrintln("Signal: Motion Start without an Event");
     }
+  }
+}
+#endif
+#endif
+
+/******************************** SNAPSHOTS ***********************************/
+// `snapshot` prints every byte of controller state as one hex line; `restore`
+// then that line puts any unit running the same build in exactly that state.
+// Learned values are then the other unit's, so none are saved until reset.
+// While `restore` waits for the line, scans (and the fan and LED) go on. The
+// line itself is sent and taken whole, since one interleaved with reports or
+// cut short by a full ring is useless: the unit stops scanning for the few
+// tens of ms it takes.
+#ifdef SERIAL_TEXT
+const uint32_t c_SNAPSHOT_TIMEOUT_US = 30000000; // To paste the line.
+const uint32_t c_SNAPSHOT_LINE_US = 1000000;     // For it to arrive, begun.
 
-    motionDetected = qualifyAllBits(detectionSet);
+static bool snapshotWaiting;   // `restore` given; its line has not begun.
+static uint32_t snapshotSince; // ... since this time,
+static uint8_t snapshotLost;   // ... with uartLost() then at this count.
+#endif
+static bool snapshotRestored;  // A snapshot is in force until reset.
+
+#ifdef SERIAL_TEXT
+static void snapshotPut(const char *text) {
+  /*******        Print, waiting for the ring rather than dropping.     *******/
+  for (; *text; text++) {
+    while (uartRoom() == 0) {}
+    uartPrintChar(*text);
   }
+}
 
-  // Read Pushbutton
-  manualActivate = digitalRead(PUSHBUTTON_INPUT_PIN);
+static void snapshotSend() {
+  /*******          The state this scan left, as a hex line.           *******/
+  static const char c_HEX[] = "0123456789ABCDEF";
+  ControllerSnapshot snap;
+  snapshotStore(controller, uint8_t(controller.profile - profiles), snap);
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&snap);
 
-  // Indicate (internally) that Motion has been Detected
-  digitalWrite(LED_BUILTIN, detect);
+  snapshotPut("Snapshot:\r\n");
+  for (uint16_t n = 0; n < sizeof(snap); n++) {
+    char digits[3] = {c_HEX[bytes[n] >> 4], c_HEX[bytes[n] & 0x0F], '\0'};
+    snapshotPut(digits);
+  }
+  snapshotPut("\r\n");
+}
+
+static int8_t hexValue(char c) {
+  /*******       One hex digit's value, or -1 for anything else.        *******/
+  if ((c >= '0') && (c <= '9')) return int8_t(c - '0');
+  if ((c >= 'A') && (c <= 'F')) return int8_t(c - 'A' + 10);
+  if ((c >= 'a') && (c <= 'f')) return int8_t(c - 'a' + 10);
+  return -1;
+}
 
-  // Decrement timers as needed.
-  if (timeRemaining > 0) {
-    // Subtract the Time-Delta, Ensuring 0 is the minimum viable time value.
-    timeRemaining = timepassed(timeRemaining, lastUSec);
+static bool snapshotReceive(ControllerSnapshot &snap, uint8_t byte) {
+  /*******  Decode a hex line from its first byte; false if it fails.  *******/
+  uint8_t *bytes = reinterpret_cast<uint8_t *>(&snap);
+  uint16_t digits = 0;
+  bool bad = false;
+  uint32_t start = timeNow();
 
-    // Monitor for Timer Elapse
-    if (timeRemaining == 0) {
-      // Move to Activate Fan, Immediately
-      nextState = controlState::ACTIVATE;
+  for (;;) {
+    char c = char(byte);
+    if ((c == '\r') || (c == '\n')) {
+      return !bad && (digits == 2 * sizeof(snap)) &&
+             (uartLost() == snapshotLost);
     }
-  }
-  if (stopDetection > 0) {
-    stopDetection = timepassed(stopDetection, lastUSec);
-  }
-  if (blockMotionIn > 0) {
-    blockMotionIn = timepassed(blockMotionIn, lastUSec);
-  }
-  if (fanTimeRemain > 0) {
-    fanTimeRemain = timepassed(fanTimeRemain, lastUSec);
-  }
-  lastUSec = micros(); // Update Time Reference
-
-  // Control Blinking Behavior
-  if ((!fanRunning) && (timeRemaining == 0)) {
-    // Perform Heartbeat Blink
-    blink(c_HEARTBEAT_BLINK_TIME);
-  } else if (timeRemaining > 0) {
-    // Perform Waiting Blink
-    blink(c_WAITING_BLINK_TIME);
-  }
-
-  /************************** FINITE STATE MACHINE ****************************/
-  switch (state) {
-    case controlState::IDLE: {
-      /**********************      IDLE STATE      ****************************/
-      if (motionDetected && (stopDetection == 0)) {
-        // Move to the Detected State
-        nextState = controlState::DETECTED;
-      } else if (fanRunning && manualActivate) {
-        // Deactivate Fan
-        nextState = controlState::RESET;
-      } else if (manualActivate && !fanRunning) {
-        // Move to Activate Fan, Immediately
-        nextState = controlState::ACTIVATE;
-      } else if ((fanTimeRemain == 0) && fanRunning) {
-        // Move to Deactivate Fan
-        nextState = controlState::RESET;
+    int8_t nibble = hexValue(c);
+    if ((nibble < 0) || (digits >= 2 * sizeof(snap))) {
+      bad = true; // Read on to the end of the line regardless.
+    } else {
+      uint8_t &target = bytes[digits / 2]; // High digit first.
+      target = (digits & 1) ? uint8_t(target | nibble) : uint8_t(nibble << 4);
+      digits++;
+    }
+    do {
+      if (uint32_t(timeNow() - start) >= c_SNAPSHOT_LINE_US) {
+        return false;
       }
-      break;
-      /**********************    END IDLE STATE    ****************************/
+    } while (!uartRead(byte));
+  }
+}
+
+static void snapshotLoad() {
+  /*******    Ask for a snapshot line; scans go on until it begins.     *******/
+  snapshotPut("Send Snapshot:\r\n");
+  snapshotWaiting = true;
+  snapshotSince = timeNow();
+  snapshotLost = uartLost();
+}
+
+static void snapshotTake(uint8_t byte) {
+  /*******     Run on from the state in the line this byte begins.      *******/
+  ControllerSnapshot snap;
+  if ((byte == '\r') || (byte == '\n')) {
+    return; // The end of the `restore` line itself.
+  }
+  snapshotWaiting = false;
+  if (snapshotReceive(snap, byte) &&
+      snapshotRestore(controller, profiles, c_LEARN_PARAMS, snap, timeNow())) {
+    snapshotRestored = true;
+    snapshotPut("Restored; Profile ");
+    profilePrint(snap.profileIndex);
+  } else {
+    snapshotPut("Snapshot Rejected.\r\n");
+  }
+}
+#endif
+
+/****************************** SERIAL COMMANDS *******************************/
+#ifdef SERIAL_TEXT
+const uint8_t c_COMMAND_LENGTH = 16; // Longest command line kept.
+
+static void commandRun(const char *line) {
+  /*******                 Act on one command line.                     *******/
+  if (strcmp(line, "profile") == 0) {
+    for (uint8_t i = 0; i < PROFILE_COUNT; i++) {
+      profilePrint(i);
+    }
+  } else if ((strncmp(line, "profile ", 8) == 0) && (line[8] >= '0') &&
+             (line[8] < '0' + PROFILE_COUNT) && (line[9] == '\0')) {
+    profileSelect(uint8_t(line[8] - '0'));
+    profilePrint(uint8_t(line[8] - '0'));
+  #ifdef SIGNALGEN
+  } else if ((strncmp(line, "signal ", 7) == 0) && (line[7] >= '0') &&
+             (line[7] < '0' + SIGNAL_PATTERNS) && (line[8] == '\0')) {
+    signalSelect(signalPattern(line[7] - '0'));
+  #endif
+  } else if (strcmp(line, "snapshot") == 0) {
+    snapshotSend();
+  } else if (strcmp(line, "restore") == 0) {
+    snapshotLoad();
+  } else {
+    uartPrintln("Commands: profile [INDEX], snapshot, restore");
+    #ifdef SIGNALGEN
+    uartPrint("          signal PATTERN:");
+    for (uint8_t p = 0; p < SIGNAL_PATTERNS; p++) {
+      uartPrintChar(' ');
+      uartPrintNumber(p);
+      uartPrintChar('=');
+      uartPrint(signalPatternName(signalPattern(p)));
     }
-    case controlState::DETECTED: {
-      /**********************    DETECTED STATE    ****************************/
-      Serial.println("State: DETECTED");
-      if (fanRunning) {
-        // If already running, just move to reset timer for fan runtime
-        nextState = controlState::ACTIVATE;
-      } else {
-        // Otherwise set the countdown timer to its maximum.
-        timeRemaining = c_DELAY_TIME;
-        nextState = controlState::IDLE;
+    uartPrintln();
+    #endif
+  }
+}
+
+static void commandService() {
+  /*******    Collect characters without blocking; run whole lines.    *******/
+  static char line[c_COMMAND_LENGTH];
+  static uint8_t length;
+  uint8_t byte;
+  while (uartRead(byte)) {
+    if (snapshotWaiting) {
+      snapshotTake(byte);
+      continue;
+    }
+    char c = char(byte);
+    if ((c == '\r') || (c == '\n')) {
+      if (length > 0) {
+        line[length] = '\0';
+        commandRun(line);
       }
-      // Ignore Subsequent Pickups for a Delay Period
-      stopDetection = c_BLOCK_DETECTION_DELAY;
-      break;
-      /**********************  END DETECTED STATE  ****************************/
+      length = 0;
+    } else if (length < c_COMMAND_LENGTH - 1) {
+      line[length++] = c;
     }
-    case controlState::ACTIVATE: {
-      /**********************    ACTIVATE STATE    ****************************/
-      Serial.println("State: ACTIVATE");
-      fanRunning = true;
-      fanTimeRemain = c_RUN_TIME; // Set fan runtime to maximum
-      digitalWrite(RELAY_OUTPUT_PIN, true); // Turn On
-      digitalWrite(LED_OUTPUT_PIN, true);
+  }
+  if (snapshotWaiting &&
+      (uint32_t(timeNow() - snapshotSince) >= c_SNAPSHOT_TIMEOUT_US)) {
+    snapshotWaiting = false;
+    snapshotPut("Snapshot Rejected.\r\n");
+  }
+}
+#endif
+
+/******************************* MODBUS SLAVE *********************************/
+#ifdef MODBUS
+static ModbusSlave modbus; // Request assembly and the reply being sent.
+static UnitCounters counters; // Events since power-up, for the hub.
 
-      // Reset Time Remaining (in case of manual activation)
-      timeRemaining = 0;
+static void modbusService(const ScanOutputs &outputs, uint32_t now) {
+  /*******  Take what has arrived, answer a whole request, send a bit.  *******/
+  countersUpdate(counters, outputs);
+  uint8_t byte;
+  while (uartRead(byte)) {
+    modbusReceive(modbus, byte, now); // Stamped by the scan that read it.
+  }
+
+  uint8_t active = uint8_t(controller.profile - profiles);
+  ModbusMap map = {&controller, &profiles[active], active, &counters};
+  ModbusActions actions;
+  modbusPoll(modbus, now, map, actions);
+  if (actions.profileChanged) {
+    profileSave(active);
+  }
+  if (actions.filterChanged) {
+    // Detection runs at the learned level: restart it from the new one.
+    controllerSetProfile(controller, &profiles[active]);
+    learnSave();
+  }
+  if (actions.selectProfile && (actions.selectIndex != active)) {
+    profileSelect(actions.selectIndex);
+  }
+
+  // Only what the transmit ring takes now; the rest goes next scan.
+  uint8_t count = modbusPending(modbus);
+  if (count > 0) {
+    modbusSent(modbus, uartWrite(&modbus.reply[modbus.replySent], count));
+  }
+}
+#endif
+
+/****************************** SCAN EXECUTIVE ********************************/
+#if SCAN_RATE_HZ
+static ScanExecutive executive; // Scan timing, slack and overruns.
+static volatile uint8_t scanReleases; // Periods released by the timer.
+
+ISR(TCB2_INT_vect) {
+  TCB2.INTFLAGS = TCB_CAPT_bm;
+  scanReleases++;
+}
+
+static void scanTimerBegin() {
+  /*******   TCB2 as a periodic interrupt: one release every period.    *******/
+  TCB2.CTRLA = 0;
+  TCB2.CTRLB = TCB_CNTMODE_INT_gc;
+  TCB2.CCMP = c_SCAN_TIMER_TOP;
+  TCB2.CNT = 0;
+  TCB2.INTFLAGS = TCB_CAPT_bm;
+  TCB2.INTCTRL = TCB_CAPT_bm;
+  TCB2.CTRLA = TCB_CLKSEL_CLKDIV2_gc | TCB_ENABLE_bm;
+}
+
+static uint8_t scanWait() {
+  /*******  Spin until a period is released; each pass is idle time.   *******/
+  uint8_t releases;
+  while ((releases = scanReleases) == executive.handled) {
+    #ifdef LOADMETER
+    loadIdle(load);
+    #endif
+  }
+  return releases;
+}
 
-      nextState = controlState::IDLE;
-      delay(350); // Debounce
-      break;
-      /**********************  END ACTIVATE STATE  ****************************/
+static void scanFinish() {
+  /*******   Note where in its period this scan ended (read atomically). *******/
+  uint8_t sreg = SREG;
+  uint8_t releases;
+  uint16_t count;
+
+  cli();
+  releases = scanReleases;
+  count = TCB2.CNT;
+  if (TCB2.INTFLAGS & TCB_CAPT_bm) {
+    releases++; // The period just ended; its interrupt has not run yet.
+  }
+  SREG = sreg;
+
+  execFinish(executive, releases, count / ((F_CPU / 2) / 1000000UL));
+}
+
+static void scanDelay(uint16_t ms) {
+  /*******  Block without scanning; skipped periods are not overruns.  *******/
+  for (uint32_t n = (uint32_t(ms) * SCAN_RATE_HZ) / 1000; n > 0; n--) {
+    scanWait();
+    execSkip(executive);
+  }
+}
+
+#ifdef SERIAL_TEXT
+static void execPrint(const ExecReport &report) {
+  /*******     Slack over the last second and overrun totals.          *******/
+  uartPrint("Slack: min ");
+  uartPrintNumber(report.minSlackUs);
+  uartPrint(" us, mean ");
+  uartPrintNumber(report.meanSlackUs);
+  uartPrint(" us; Overruns: ");
+  uartPrintNumber(report.overruns);
+  uartPrint(", Missed: ");
+  uartPrintNumber(report.missed);
+  if (report.overruns > 0) {
+    uartPrint(" (last at scan ");
+    uartPrintNumber(report.lastOverrun);
+    uartPrintChar(')');
+  }
+  uartPrintln();
+}
+#endif
+#endif
+
+/***************************** CPU LOAD METER *********************************/
+#ifdef LOADMETER
+static void loadPrint(const LoadReport &report) {
+  /*******   One line: total load, then each section's share of time.  *******/
+  uartPrint("Load: ");
+  uartPrintFixed(report.loadPermille, 1);
+  uartPrintChar('%');
+  for (uint8_t s = 0; s < LOAD_SECTIONS; s++) {
+    uartPrintChar(' ');
+    uartPrint(loadSectionName(loadSection(s)));
+    uartPrintChar(' ');
+    uartPrintFixed(report.sectionPermille[s], 1);
+    uartPrintChar('%');
+  }
+  uartPrintln();
+}
+#endif
+
+/****************************      SETUP      *********************************/
+void setup() {
+  uartBegin(c_SERIAL_BAUD);
+  timebaseBegin();
+  timebaseStart(timebase, timebaseRead(), 0);
+  #ifdef SERIAL_TEXT
+  uartPrintln("ScentAssist STARTUP - (c) STANLEY SOLUTIONS");
+  #endif
+
+  // Initialize the I/O Pins
+  pinMode(MOTION_INPUT_PIN, INPUT);
+  pinMode(PUSHBUTTON_INPUT_PIN, INPUT_PULLUP);
+  pinMode(RELAY_OUTPUT_PIN, OUTPUT);
+  pinMode(LED_OUTPUT_PIN, OUTPUT);
+  pinMode(LED_BUILTIN, OUTPUT);
+
+  // Set Output Defaults
+  digitalWrite(RELAY_OUTPUT_PIN, false);
+  for (uint8_t i = 0; i < 10; i++) {
+    digitalWrite(LED_OUTPUT_PIN, true);
+    delay(100);
+    digitalWrite(LED_OUTPUT_PIN, false);
+    delay(100);
+  }
+  bool profileStepped;
+  uint8_t profile = profilesBegin(profileStepped);
+
+  #ifdef BENCH
+  benchFilter();
+  #endif
+
+  #if SCAN_RATE_HZ
+  scanTimerBegin();
+  execBegin(executive, c_SCAN_PERIOD_US, scanReleases);
+  #endif
+
+  #ifdef LOADMETER
+  // Count a whole window of idle spins while nothing else is running.
+  loadBegin(load, c_LOAD_WINDOW_US, timeNow());
+  scanDelay(c_LOAD_WINDOW_US / 1000);
+  loadCalibrate(load, timeNow());
+  uartPrint("Idle Count/Window: ");
+  uartPrintNumber(load.idleFull);
+  uartPrintln();
+  #endif
+
+  #if CIC_RATIO
+  cicBegin(); // After calibration: the interrupt's time is load, not idle.
+  #endif
+
+  controllerInit(controller, timeNow());
+  LearnRecord record;
+  EEPROM.get(EEPROM_LEARN_ADDR, record);
+  if (profileStepped) {
+    profileSelect(profile); // Values learned under the old one do not apply.
+  } else {
+    controllerSetProfile(controller, &profiles[profile]);
+  }
+  #ifdef SERIAL_TEXT
+  uartPrint("Profile ");
+  profilePrint(profile);
+  #endif
+  if (!profileStepped &&
+      learnRestore(controller.learn, c_LEARN_PARAMS, record)) {
+    #ifdef SERIAL_TEXT
+    learnPrint("Learned Threshold: ");
+    #endif
+  }
+  #ifdef CAPTURE
+  captureBegin(capture, c_CAPTURE_PERIOD_US);
+  #endif
+  #ifdef SIGNALGEN
+  signalSelect(SIGNALGEN_PATTERN);
+  #endif
+  #ifdef MODBUS
+  modbusBegin(modbus, MODBUS_ADDRESS, c_SERIAL_BAUD);
+  #endif
+  #ifdef SERIAL_TEXT
+  uartPrintln("READY.");
+  #endif
+}
+
+#ifdef CAPTURE
+void captureService(const uint16_t (&samples)[SAMPLE_BLOCK], uint32_t first) {
+  /*******  Stream each block at a fixed rate without blocking loop().  *******/
+  // `first` is when samples[0] was taken; the rest follow a period apart.
+  static uint32_t nextScan = 0;
+  const uint8_t *data;
+  uint8_t pending;
+
+  if (int32_t(first - nextScan) >= 0) {
+    if (uint32_t(first - nextScan) >= c_CAPTURE_SCAN_US) {
+      // Scan slots were missed; restart framing on a new timestamp.
+      captureFlush(capture);
+      nextScan = first;
     }
-    case controlState::RESET: {
-      /**********************     RESET STATE      ****************************/
-      Serial.println("State: RESET");
-      fanRunning = false;
-      fanTimeRemain = 0;
-      timeRemaining = 0;
-      blockMotionIn = 5 * c_BLOCK_DETECTION_DELAY; // Block Motion Sensor Input.
-      digitalWrite(RELAY_OUTPUT_PIN, false); // Turn Off
-      digitalWrite(LED_OUTPUT_PIN, false);
+    for (uint8_t n = 0; n < SAMPLE_BLOCK; n++) {
+      capturePush(capture, samples[n], first + n * c_CAPTURE_PERIOD_US);
+    }
+    nextScan += c_CAPTURE_SCAN_US;
+  }
+
+  // Hand over only what the UART can take without waiting.
+  pending = capturePending(capture, &data);
+  if (pending > 0) {
+    captureConsume(capture, uartWrite(data, pending));
+  }
+}
+#endif
+
+/****************************      EXECUTE    *********************************/
+void loop() {
+  ScanInputs inputs;
+  ScanOutputs outputs;
+
+  #if SCAN_RATE_HZ
+  // Run Once per Timer Period
+  execStart(executive, scanWait());
+  LOAD_MARK(LOAD_IDLE);
+  #endif
+
+  // Collect This Scan's Inputs
+  #ifdef SIGNALGEN
+  for (uint8_t n = 0; n < SAMPLE_BLOCK; n++) {
+    inputs.samples[n] = signalNext(generator);
+  }
+  #elif CIC_RATIO
+  cicTake(inputs.samples);
+  #else
+  #ifdef CAPTURE
+  uint32_t sampledAt = timeNow(); // The stream stamps the block from here.
+  #endif
+  for (uint8_t n = 0; n < SAMPLE_BLOCK; n++) {
+    #ifdef CAPTURE
+    // Read on the stream's sample grid, not back to back.
+    while (uint32_t(timeNow() - sampledAt) < n * c_CAPTURE_PERIOD_US) {
+    }
+    #endif
+    inputs.samples[n] = analogRead(MOTION_INPUT_PIN);
+  }
+  #endif
+  bool pressed = digitalRead(PUSHBUTTON_INPUT_PIN); // Read Pushbutton
+  inputs.now = timeNow(); // The scan's one snapshot for all timers.
+  inputs.manualActivate = buttonService(pressed, inputs.now);
+  LOAD_MARK(LOAD_SAMPLE);
+
+  #ifdef CAPTURE
+  #if defined(SIGNALGEN) || CIC_RATIO
+  // Evenly spaced already, the newest just before the snapshot.
+  uint32_t sampledAt =
+    inputs.now - (SAMPLE_BLOCK - 1) * uint32_t(c_CAPTURE_PERIOD_US);
+  #endif
+  captureService(inputs.samples, sampledAt);
+  #endif
+
+  controllerScan(controller, inputs, outputs);
+  LOAD_MARK(LOAD_FSM);
+
+  /***************               DEBUGGING CODE               *****************/
+  #ifdef DEBUG
+  if (controller.blockMotionIn == 0) {
+    uartPrint("Average: ");
+    uartPrintNumber(controller.filter.average);
+    uartPrint("\t\tSample: ");
+    uartPrintNumber(controller.filter.sample);
+    uartPrint("\t\tResult: ");
+    uartPrintNumber(outputs.detect);
+    uartPrintln();
+  }
+  if (outputs.motion == motionEvent::MOTION_START) {
+    uartPrintln("Motion Start");
+  } else if (outputs.motion == motionEvent::MOTION_END) {
+    uartPrintln("Motion End");
+  }
+  static uint16_t motionSuppressed = 0, manualSuppressed = 0;
+  if (controller.motionRate.suppressed != motionSuppressed) {
+    motionSuppressed = controller.motionRate.suppressed;
+    uartPrintln("Motion Start Suppressed");
+  }
+  if (controller.manualRate.suppressed != manualSuppressed) {
+    manualSuppressed = controller.manualRate.suppressed;
+    uartPrintln("Button Suppressed");
+  }
+  if (outputs.presence == presenceEvent::PRESENCE_ARRIVED) {
+    uartPrintln("Box Occupied");
+  } else if (outputs.presence == presenceEvent::PRESENCE_LEFT) {
+    uartPrintln("Box Vacated");
+  }
+  LOAD_MARK(LOAD_LOG);
+  #endif
+  /****************************************************************************/
+
+  // Indicate (internally) that Motion has been Detected
+  digitalWrite(LED_BUILTIN, outputs.detect);
+  digitalWrite(RELAY_OUTPUT_PIN, outputs.relay);
+  digitalWrite(LED_OUTPUT_PIN, outputs.led);
+  LOAD_MARK(LOAD_OUTPUT);
 
-      // Delay when manually deactivated
-      if (manualActivate) {
-        Serial.println("Delay for Debounce.");
-        delay(c_BLOCK_DETECTION_DELAY / 1000);
-        Serial.println("Delay Expired.");
+  // Keep Learned Sensitivity across Power Cycles (writes changed bytes only);
+  // a restored snapshot's belongs to another unit.
+  if (outputs.saveLearned && !snapshotRestored) {
+    learnSave();
+  }
+
+  // Report State Changes (unless a binary protocol owns the port)
+  #ifdef SERIAL_TEXT
+  if (outputs.handled != controlState::IDLE) {
+    uartPrint("State: ");
+    uartPrintln(stateName(outputs.handled));
+  }
+  if (outputs.faultsChanged) {
+    if (outputs.faults) {
+      uartPrint("Sensor Fault:");
+      for (uint8_t bit = 0x01; bit <= HEALTH_STEPS; bit <<= 1) {
+        if (outputs.faults & bit) {
+          uartPrintChar(' ');
+          uartPrint(healthFaultName(healthFault(bit)));
+        }
       }
+      uartPrintln(" - Timed Runs Only");
+    } else {
+      uartPrintln("Sensor Recovered.");
+    }
+  }
+  if (outputs.learned != learnEvent::LEARN_NONE) {
+    learnPrint((outputs.learned == learnEvent::LEARN_MISSED) ?
+               "Missed Visit; Threshold: " : "False Trigger; Threshold: ");
+  }
+  #ifdef SIGNALGEN
+  signalReport(outputs);
+  #endif
+  commandService();
+  LOAD_MARK(LOAD_LOG);
+  #endif
+  #ifdef MODBUS
+  modbusService(outputs, inputs.now);
+  #endif
 
-      nextState = controlState::IDLE;
-      break;
-      /**********************   END RESET STATE    ****************************/
+  // Periodic Reports (part of the scan, so their cost is measured)
+  #if SCAN_RATE_HZ && defined(SERIAL_TEXT)
+  ExecReport timing;
+  if (execReport(executive, c_EXEC_REPORT_SCANS, timing)) {
+    #ifdef LOADMETER
+    execPrint(timing);
+    #else
+    if (timing.newOverruns) {
+      execPrint(timing);
     }
+    #endif
+    #if CIC_RATIO
+    cicPrint();
+    #endif
+  }
+  #endif
+  #ifdef LOADMETER
+  LoadReport report;
+  if (loadReport(load, inputs.now, report)) {
+    loadPrint(report);
   }
-  /************************ END FINITE STATE MACHINE **************************/
+  LOAD_MARK(LOAD_LOG);
+  #endif
+
+  #if SCAN_RATE_HZ
+  scanFinish();
+  #endif
 
-  // Move to Next State
-  state = nextState;
-}
\ No newline at end of file
+  // Perform any Blocking Debounce the State Machine Requested
+  if (outputs.delayMs > 0) {
+    #ifdef SERIAL_TEXT
+    if (outputs.handled == controlState::RESET) {
+      uartPrintln("Delay for Debounce.");
+    }
+    #endif
+    #if SCAN_RATE_HZ
+    scanDelay(outputs.delayMs);
+    LOAD_MARK(LOAD_IDLE);
+    #else
+    delay(outputs.delayMs);
+    #endif
+    #ifdef SERIAL_TEXT
+    if (outputs.handled == controlState::RESET) {
+      uartPrintln("Delay Expired.");
+    }
+    #endif
+  }
+}
@@ -0,0 +1,186 @@
+/*******************************************************************************
+ * ScentAssist - Block Qualification Benchmark
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Host counterpart of the BENCH firmware build. Times
+ *        qualifyAnalogBlock<N>() against N separate qualifyAnalog() calls
+ *        for several block sizes, in nanoseconds and (on x86) TSC cycles
+ *        per sample, and checks that both leave identical filter state and
+ *        detection counts. Absolute numbers are the host's; the ratios show
+ *        what batching saves. The median prefilter networks are timed and
+ *        checked against a general sort the same way. Flash the
+ *        nano_every_bench environment for cycle counts on the board itself.
+ *
+ * BUILD: pio run -e blockbench
+ *
+ * USAGE: blockbench [--samples=N] [--averaging]
+ ******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#include <ScentCore.h>
+
+static volatile uint32_t sink; // Keeps results observable.
+
+struct Timing {
+  double ns;       // Nanoseconds per sample.
+  double cycles;   // TSC cycles per sample (0 when unavailable).
+};
+
+static inline uint64_t cycleCount() {
+#ifdef HAVE_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+template <typename Body>
+static Timing timeRun(size_t samples, Body body) {
+  /*******      Best of several runs to reduce scheduling noise.        *******/
+  Timing best = {1e30, 1e30};
+  for (int rep = 0; rep < 5; rep++) {
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t c0 = cycleCount();
+    body();
+    uint64_t c1 = cycleCount();
+    auto t1 = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    if (ns / samples < best.ns) {
+      best.ns = ns / samples;
+      best.cycles = double(c1 - c0) / samples;
+    }
+  }
+  return best;
+}
+
+template <uint8_t N>
+static bool benchBlock(const std::vector<uint16_t> &trace,
+                       const FilterParams &params) {
+  size_t blocks = trace.size() / N;
+  size_t samples = blocks * N;
+  FilterState single = {}, batched = {};
+  uint32_t singleHits = 0, batchedHits = 0;
+
+  // Equivalence: same detections and same filter history.
+  for (size_t i = 0; i < samples; i++) {
+    singleHits += qualifyAnalog(single, params, trace[i]);
+  }
+  for (size_t b = 0; b < blocks; b++) {
+    batchedHits += qualifyAnalogBlock<N>(batched, params, &trace[b * N]);
+  }
+  bool same = (singleHits == batchedHits) &&
+              (single.total == batched.total) &&
+              (single.readingIndex == batched.readingIndex) &&
+              (memcmp(single.readings, batched.readings,
+                      sizeof(single.readings)) == 0);
+
+  Timing one = timeRun(samples, [&]() {
+    FilterState f = {};
+    uint32_t hits = 0;
+    for (size_t i = 0; i < samples; i++) {
+      hits += qualifyAnalog(f, params, trace[i]);
+    }
+    sink = hits;
+  });
+  Timing block = timeRun(samples, [&]() {
+    FilterState f = {};
+    uint32_t hits = 0;
+    for (size_t b = 0; b < blocks; b++) {
+      hits += qualifyAnalogBlock<N>(f, params, &trace[b * N]);
+    }
+    sink = hits;
+  });
+
+  printf("  %5u  %8.2f  %8.2f  %7.1f  %7.1f  %6.2fx  %s\n", N, one.ns,
+         block.ns, one.cycles, block.cycles, one.ns / block.ns,
+         same ? "match" : "MISMATCH");
+  return same;
+}
+
+template <uint8_t K>
+static bool benchMedian(const std::vector<uint16_t> &trace) {
+  size_t samples = trace.size();
+  MedianWindow<K> median = {};
+  uint16_t window[K] = {};
+  bool same = true;
+
+  // Equivalence: the network's median against a general selection.
+  for (size_t i = 0; i < samples; i++) {
+    uint16_t got = medianPush(median, trace[i]);
+    uint16_t sorted[K];
+    window[i % K] = trace[i];
+    std::copy(window, window + K, sorted);
+    std::nth_element(sorted, sorted + K / 2, sorted + K);
+    same &= (got == sorted[K / 2]);
+  }
+
+  Timing t = timeRun(samples, [&]() {
+    MedianWindow<K> m = {};
+    uint32_t sum = 0;
+    for (size_t i = 0; i < samples; i++) {
+      sum += medianPush(m, trace[i]);
+    }
+    sink = sum;
+  });
+
+  printf("  %5u  %8.2f  %7.1f  %s\n", K, t.ns, t.cycles,
+         same ? "match" : "MISMATCH");
+  return same;
+}
+
+int main(int argc, char **argv) {
+  size_t samples = 1 << 22;
+  FilterParams params = c_FILTER_PARAMS;
+
+  for (int a = 1; a < argc; a++) {
+    if (strncmp(argv[a], "--samples=", 10) == 0) {
+      samples = size_t(atol(argv[a] + 10));
+    } else if (strcmp(argv[a], "--averaging") == 0) {
+      params.averaging = true;
+    } else {
+      fprintf(stderr, "usage: blockbench [--samples=N] [--averaging]\n");
+      return 2;
+    }
+  }
+  if (samples < 16) samples = 16;
+
+  // Quiet baseline with occasional bursts, like a sensor trace.
+  std::vector<uint16_t> trace(samples);
+  uint32_t rng = 0x2545F491;
+  for (size_t i = 0; i < samples; i++) {
+    rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+    trace[i] = uint16_t(8 + rng % 9 + (((i >> 12) % 7 == 0) ? 180 : 0));
+  }
+
+  printf("ScentAssist Block Benchmark (%zu samples, averaging %s)\n", samples,
+         params.averaging ? "on" : "off");
+  printf("  block  ns/samp   ns/samp   cyc/smp  cyc/smp  speedup\n");
+  printf("         single    block     single   block\n");
+  bool ok = true;
+  ok &= benchBlock<1>(trace, params);
+  ok &= benchBlock<2>(trace, params);
+  ok &= benchBlock<4>(trace, params);
+  ok &= benchBlock<8>(trace, params);
+  ok &= benchBlock<16>(trace, params);
+
+  printf("Median Prefilter (sorting network)\n");
+  printf("   taps  ns/samp   cyc/smp\n");
+  ok &= benchMedian<3>(trace);
+  ok &= benchMedian<5>(trace);
+  ok &= benchMedian<7>(trace);
+  return ok ? 0 : 1;
+}
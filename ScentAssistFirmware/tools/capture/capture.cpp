@@ -0,0 +1,302 @@
+/*******************************************************************************
+ * ScentAssist - Serial Capture Decoder
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Host side of the CAPTURE firmware build. Reads the framed sample
+ *        stream from the serial port (or a saved byte dump), reconstructs
+ *        the samples and writes them as text or as a ".sat" trace, starting
+ *        a new trace segment wherever frames were lost or time skipped.
+ *
+ * BUILD: pio run -e capture
+ *
+ * USAGE: capture [--out=FILE.sat] [--timestamps] [--baud=N] SOURCE
+ *        capture --selftest
+ *
+ *        SOURCE is a serial device (configured raw at --baud, default
+ *        115200), a file, or "-" for stdin. Without --out the samples are
+ *        printed one per line. Stop a live capture with Ctrl-C.
+ ******************************************************************************/
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <ScentCapture.h>
+#include <ScentTrace.h>
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) {
+  stopRequested = 1;
+}
+
+static const char *argValue(const char *arg, const char *name) {
+  size_t len = strlen(name);
+  if (strncmp(arg, name, len) == 0 && arg[len] == '=') return arg + len + 1;
+  return nullptr;
+}
+
+static speed_t baudConstant(long baud) {
+  switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+  }
+  return 0;
+}
+
+static int openSource(const char *path, long baud) {
+  if (strcmp(path, "-") == 0) return STDIN_FILENO;
+  int fd = open(path, O_RDONLY | O_NOCTTY);
+  if (fd < 0) return -1;
+  if (isatty(fd)) {
+    struct termios tio;
+    speed_t speed = baudConstant(baud);
+    if (speed == 0 || tcgetattr(fd, &tio) != 0) {
+      close(fd);
+      return -1;
+    }
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  return fd;
+}
+
+/******************************* STREAM SINK **********************************/
+struct Sink {
+  TraceWriter trace;
+  bool toTrace;
+  bool timestamps;
+  bool started;
+  uint8_t nextSequence;
+  uint64_t nextTime;     // Expected time of the next frame's first sample.
+  uint64_t time;         // Unwrapped time of the last frame.
+  uint32_t lastStamp;    // Raw 32-bit stamp of the last frame.
+  uint64_t samples;
+  uint32_t gaps;
+};
+
+static bool emitFrame(Sink &s, const CaptureFrame &frame) {
+  // Unwrap the device's 32-bit microsecond clock.
+  if (!s.started) {
+    s.time = frame.timestampUs;
+  } else {
+    s.time += uint32_t(frame.timestampUs - s.lastStamp);
+  }
+  s.lastStamp = frame.timestampUs;
+
+  uint64_t slack = frame.periodUs / 2;
+  bool contiguous = s.started && (frame.sequence == s.nextSequence) &&
+                    (s.time + slack >= s.nextTime) &&
+                    (s.time <= s.nextTime + slack);
+  if (!contiguous) {
+    if (s.started) s.gaps++;
+    if (s.toTrace && !traceSegment(s.trace, s.time)) return false;
+  }
+  s.started = true;
+  s.nextSequence = uint8_t(frame.sequence + 1);
+  s.nextTime = s.time + uint64_t(frame.count) * frame.periodUs;
+
+  if (s.toTrace) {
+    if (!traceAppend(s.trace, frame.samples, frame.count)) return false;
+  } else {
+    for (uint8_t i = 0; i < frame.count; i++) {
+      if (s.timestamps) {
+        printf("%llu,%u\n",
+               (unsigned long long)(s.time + uint64_t(i) * frame.periodUs),
+               frame.samples[i]);
+      } else {
+        printf("%u\n", frame.samples[i]);
+      }
+    }
+  }
+  s.samples += frame.count;
+  return true;
+}
+
+/********************************* SELF TEST **********************************/
+static int selftest() {
+  /*******    Encode a synthetic stream, damage it, decode it back.     *******/
+  const uint16_t period = 250;
+  const uint32_t total = 200000;
+  CaptureEncoder enc;
+  std::vector<uint16_t> expected;
+  std::vector<uint8_t> wire;
+  uint32_t rng = 0x1234567;
+  uint32_t now = 0xFFF00000u; // Exercise clock wrap.
+  int32_t value = 40;
+  uint32_t corruptAt = 0;
+
+  captureBegin(enc, period);
+  for (uint32_t i = 0; i < total; i++) {
+    rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+    value += int32_t(rng % 7) - 3;
+    if (rng % 997 == 0) value = int32_t((rng >> 8) % 1024); // Spike
+    value = (value < 0) ? 0 : (value > 1023 ? 1023 : value);
+
+    if (rng % 20011 == 0) {
+      captureFlush(enc);   // Simulated missed sample slots.
+      now += 10 * period;
+    }
+    capturePush(enc, uint16_t(value), now);
+    expected.push_back(uint16_t(value));
+    now += period;
+
+    // Drain like the firmware: a few bytes at a time.
+    const uint8_t *data;
+    uint8_t n = capturePending(enc, &data);
+    n = (n > 8) ? 8 : n;
+    wire.insert(wire.end(), data, data + n);
+    captureConsume(enc, n);
+    if (i == total / 2) {
+      static const char noise[] = "State: DETECTED\r\n\xA5\x5A junk";
+      wire.insert(wire.end(), noise, noise + sizeof(noise) - 1);
+      corruptAt = uint32_t(wire.size()) + 40;
+    }
+  }
+  captureFlush(enc);
+  for (;;) {
+    const uint8_t *data;
+    uint8_t n = capturePending(enc, &data);
+    if (n == 0) break;
+    wire.insert(wire.end(), data, data + n);
+    captureConsume(enc, n);
+  }
+  if (enc.dropped) {
+    fprintf(stderr, "selftest: encoder dropped %u frames\n", enc.dropped);
+    return 1;
+  }
+  wire[corruptAt] ^= 0x10; // One bit flip inside some frame.
+
+  // Decode in odd-sized chunks to exercise resumption.
+  CaptureStats stats = {};
+  CaptureFrame frame;
+  std::vector<uint16_t> decoded;
+  std::vector<uint8_t> pending;
+  size_t fed = 0;
+  while (fed < wire.size() || !pending.empty()) {
+    size_t chunk = std::min<size_t>(37, wire.size() - fed);
+    pending.insert(pending.end(), wire.begin() + fed, wire.begin() + fed + chunk);
+    fed += chunk;
+    uint32_t consumed;
+    bool got;
+    do {
+      got = captureParse(pending.data(), uint32_t(pending.size()), consumed,
+                         frame, stats);
+      if (got) decoded.insert(decoded.end(), frame.samples,
+                              frame.samples + frame.count);
+      pending.erase(pending.begin(), pending.begin() + consumed);
+    } while (got);
+    if (chunk == 0) break;
+  }
+
+  // Exactly one frame (the corrupted one) must be missing.
+  size_t missing = expected.size() - decoded.size();
+  size_t a = 0, b = 0, mismatches = 0;
+  while (a < expected.size() && b < decoded.size()) {
+    if (expected[a] == decoded[b]) { a++; b++; continue; }
+    a++;
+    mismatches++;
+  }
+  double bytesPerSample = double(wire.size()) / total;
+  printf("selftest: %u samples, %zu wire bytes (%.2f bits/sample)\n", total,
+         wire.size(), 8.0 * bytesPerSample);
+  printf("selftest: %u frames, %u rejected, %u bytes skipped, %zu samples "
+         "lost\n", stats.frames, stats.rejected, stats.skipped, missing);
+  printf("selftest: 115200 baud carries ~%.0f samples/s\n",
+         11520.0 / bytesPerSample);
+  bool ok = (b == decoded.size()) && (missing > 0) &&
+            (missing <= CAPTURE_FRAME_SAMPLES) && (mismatches == missing);
+  printf("selftest: %s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  const char *source = nullptr;
+  const char *out = nullptr;
+  long baud = 115200;
+  Sink sink = {};
+
+  for (int a = 1; a < argc; a++) {
+    const char *v;
+    if (strcmp(argv[a], "--selftest") == 0) return selftest();
+    if ((v = argValue(argv[a], "--out"))) out = v;
+    else if ((v = argValue(argv[a], "--baud"))) baud = atol(v);
+    else if (strcmp(argv[a], "--timestamps") == 0) sink.timestamps = true;
+    else if (!source) source = argv[a];
+    else {
+      fprintf(stderr, "Unknown argument: %s\n", argv[a]);
+      return 2;
+    }
+  }
+  if (!source) {
+    fprintf(stderr, "usage: capture [--out=FILE.sat] [--timestamps] "
+                    "[--baud=N] SOURCE | --selftest\n");
+    return 2;
+  }
+
+  int fd = openSource(source, baud);
+  if (fd < 0) {
+    fprintf(stderr, "Cannot open %s\n", source);
+    return 1;
+  }
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  std::vector<uint8_t> pending;
+  CaptureStats stats = {};
+  CaptureFrame frame;
+  uint8_t chunk[4096];
+  bool ok = true;
+
+  while (ok && !stopRequested) {
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n <= 0) break;
+    pending.insert(pending.end(), chunk, chunk + n);
+
+    uint32_t consumed;
+    bool got;
+    do {
+      got = captureParse(pending.data(), uint32_t(pending.size()), consumed,
+                         frame, stats);
+      if (got) {
+        if (out && !sink.toTrace) {
+          uint32_t rate = (1000000 + frame.periodUs / 2) / frame.periodUs;
+          if (!traceCreate(sink.trace, out, rate)) {
+            fprintf(stderr, "Cannot create %s\n", out);
+            return 1;
+          }
+          sink.toTrace = true;
+        }
+        ok = emitFrame(sink, frame);
+      }
+      pending.erase(pending.begin(), pending.begin() + consumed);
+    } while (got && ok);
+  }
+  if (fd != STDIN_FILENO) close(fd);
+
+  if (sink.toTrace && !traceFinish(sink.trace)) ok = false;
+  fprintf(stderr, "%llu samples, %u frames, %u gaps, %u rejected, "
+          "%u bytes skipped\n", (unsigned long long)sink.samples,
+          stats.frames, sink.gaps, stats.rejected, stats.skipped);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+/*******************************************************************************
+ * ScentAssist - CIC Decimator Response
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Host check of the oversampling front end (CIC_RATIO builds). Feeds
+ *        quantized sine tones at the ADC rate through cicPush() exactly as
+ *        the ADC interrupt does and measures the gain of the decimated
+ *        stream against plain decimation (keeping every RATIO-th reading,
+ *        which is what sampling at the output rate amounts to). Tones near
+ *        multiples of the output rate fold down into the detector's band;
+ *        the table shows how far each order pushes them down; about -51 dB
+ *        is the floor set by truncating to 10 bits at the default amplitude.
+ *        Also checks unity gain at DC and that full-scale input cannot
+ *        overflow.
+ *
+ * BUILD: pio run -e cicresponse
+ *
+ * USAGE: cicresponse [--output-hz=HZ] [--amplitude=LSB]
+ ******************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <ScentCore.h>
+
+const uint8_t c_RATIO = 8;          // As the nano_every build would use.
+const uint32_t c_OUTPUTS = 4096;    // Decimated samples measured per tone.
+
+static double gainDb(const std::vector<double> &out, double amplitude) {
+  /*******      Output RMS about its mean, relative to the input tone.    *******/
+  double mean = 0, power = 0;
+  for (double v : out) mean += v;
+  mean /= out.size();
+  for (double v : out) power += (v - mean) * (v - mean);
+  double rms = std::sqrt(power / out.size());
+  return 20.0 * std::log10(std::max(rms, 1e-3) / (amplitude / std::sqrt(2.0)));
+}
+
+static uint16_t tone(uint32_t i, double freq, double adcHz, double amplitude) {
+  return uint16_t(std::lround(512.0 + amplitude *
+                              std::sin(2.0 * M_PI * freq * i / adcHz)));
+}
+
+template <uint8_t ORDER>
+static double cicGain(double freq, double adcHz, double amplitude) {
+  CicDecimator<ORDER, c_RATIO> cic = {};
+  std::vector<double> out;
+  uint16_t output;
+  // Settle the combs for a few outputs before measuring.
+  for (uint32_t i = 0; out.size() < c_OUTPUTS + 8; i++) {
+    if (cicPush(cic, tone(i, freq, adcHz, amplitude), output)) {
+      out.push_back(output);
+    }
+  }
+  out.erase(out.begin(), out.begin() + 8);
+  return gainDb(out, amplitude);
+}
+
+static double plainGain(double freq, double adcHz, double amplitude) {
+  std::vector<double> out;
+  for (uint32_t n = 0; n < c_OUTPUTS; n++) {
+    out.push_back(tone(n * c_RATIO, freq, adcHz, amplitude));
+  }
+  return gainDb(out, amplitude);
+}
+
+template <uint8_t ORDER>
+static bool checkLimits() {
+  /*******  DC passes at unity; alternating rails never wrap the output. *******/
+  CicDecimator<ORDER, c_RATIO> dc = {}, rails = {};
+  uint16_t output = 0;
+  bool ok = true;
+  for (uint32_t i = 0; i < 64u * c_RATIO; i++) {
+    if (cicPush(dc, 700, output) && i > 8u * c_RATIO) ok &= (output == 700);
+    if (cicPush(rails, (i & 1) ? 1023 : 0, output)) ok &= (output <= 1023);
+  }
+  for (uint32_t i = 0; i < 64u * c_RATIO; i++) {
+    if (cicPush(rails, 1023, output) && i > 8u * c_RATIO) {
+      ok &= (output == 1023);
+    }
+  }
+  printf("  order %u  DC and full scale: %s\n", ORDER, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  double outputHz = 4000; // SCAN_RATE_HZ 1000 x SAMPLE_BLOCK 4
+  double amplitude = 256;
+
+  for (int a = 1; a < argc; a++) {
+    if (strncmp(argv[a], "--output-hz=", 12) == 0) {
+      outputHz = atof(argv[a] + 12);
+    } else if (strncmp(argv[a], "--amplitude=", 12) == 0) {
+      amplitude = atof(argv[a] + 12);
+    } else {
+      fprintf(stderr, "usage: cicresponse [--output-hz=HZ] [--amplitude=LSB]\n");
+      return 2;
+    }
+  }
+  if (outputHz <= 0 || amplitude <= 0 || amplitude > 511) {
+    fprintf(stderr, "output-hz must be positive and amplitude 1..511.\n");
+    return 2;
+  }
+  double adcHz = outputHz * c_RATIO;
+
+  printf("ScentAssist CIC Response (ADC %.0f Hz, %u:1, output %.0f Hz)\n",
+         adcHz, c_RATIO, outputHz);
+  printf("   tone Hz  lands at   plain dB  order1  order2  order3  order4\n");
+  const double tones[] = {0.0125, 0.05, 0.125, 0.25, 0.45, 0.95, 1.05,
+                          1.5,    1.98, 2.02,  3.01, 4.5,  7.02};
+  for (double t : tones) {
+    double freq = t * outputHz;
+    double folded = std::fabs(freq - std::round(freq / outputHz) * outputHz);
+    printf("  %8.0f  %8.0f  %8.1f  %6.1f  %6.1f  %6.1f  %6.1f\n", freq, folded,
+           plainGain(freq, adcHz, amplitude), cicGain<1>(freq, adcHz, amplitude),
+           cicGain<2>(freq, adcHz, amplitude), cicGain<3>(freq, adcHz, amplitude),
+           cicGain<4>(freq, adcHz, amplitude));
+  }
+
+  bool ok = true;
+  ok &= checkLimits<1>();
+  ok &= checkLimits<2>();
+  ok &= checkLimits<3>();
+  ok &= checkLimits<4>();
+  return ok ? 0 : 1;
+}
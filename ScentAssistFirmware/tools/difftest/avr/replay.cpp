@@ -0,0 +1,75 @@
+/*******************************************************************************
+ * ScentAssist - Differential Test Replay Firmware
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Device half of tools/difftest. Bare firmware (no Arduino core)
+ *        which reads scans from USART0, runs them through diffStep() and
+ *        writes each record back. A stop command sleeps with interrupts off,
+ *        which simavr takes as the end of the run.
+ *
+ *        simavr has no ATmega4809 model, so this is built for the ATmega328P
+ *        it does model. The core never touches hardware, and avr-gcc
+ *        generates the same 8-bit arithmetic for both parts (16-bit int,
+ *        identical promotions and libgcc helpers), so what holds here holds
+ *        on the Nano Every built with the same flags.
+ *
+ * BUILD: pio run -e difftest_avr
+ ******************************************************************************/
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+
+#include <ScentCore.h>
+
+#include "../diffscan.h"
+
+static void uartPut(uint8_t byte) {
+  while (!(UCSR0A & _BV(UDRE0))) {}
+  UDR0 = byte;
+}
+
+static uint8_t uartGet() {
+  while (!(UCSR0A & _BV(RXC0))) {}
+  return UDR0;
+}
+
+static DiffRig rig;
+
+int main() {
+  uint8_t input[DIFF_INPUT_BYTES];
+  uint8_t record[DIFF_RECORD_BYTES];
+  ScanInputs in;
+
+  // Fastest rate the USART has; simavr paces bytes by it.
+  UCSR0A = _BV(U2X0);
+  UBRR0 = 0;
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+  UCSR0B = _BV(RXEN0) | _BV(TXEN0);
+
+  diffBegin(rig);
+  uartPut(DIFF_HELLO);
+  uartPut(SAMPLE_BLOCK);
+  uartPut(MEDIAN_TAPS);
+  uartPut(DIFF_RECORD_BYTES);
+
+  while (uartGet() == DIFF_SCAN) {
+    for (uint8_t n = 0; n < DIFF_INPUT_BYTES; n++) {
+      input[n] = uartGet();
+    }
+    diffUnpack(input, in);
+    diffStep(rig, in, record);
+    for (uint8_t n = 0; n < DIFF_RECORD_BYTES; n++) {
+      uartPut(record[n]);
+    }
+  }
+
+  cli();
+  set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+  sleep_enable();
+  sleep_cpu();
+  return 0;
+}
@@ -0,0 +1,159 @@
+/*******************************************************************************
+ * ScentAssist - Differential Test Step
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: The one scan step both sides of tools/difftest run: the replay
+ *        firmware under simavr and the host harness include this same file,
+ *        so the only thing that differs between them is the compiler and
+ *        the machine. Inputs and records are packed byte by byte
+ *        (little-endian), never copied as structs, so padding and byte
+ *        order cannot differ either.
+ *
+ *        Each scan pushes its samples one at a time through qualifyAnalog()
+ *        on a filter of its own, recording the filter after every sample,
+ *        then runs the whole block through controllerScan() and records the
+ *        outputs, the FSM state and every timer.
+ *
+ *        PROTOCOL (host -> device)
+ *          'S' now u32 | manual u8 | samples u16 x SAMPLE_BLOCK   one scan
+ *          'Q'                                                  stop
+ *        (device -> host)
+ *          DIFF_HELLO | SAMPLE_BLOCK | MEDIAN_TAPS | DIFF_RECORD_BYTES
+ *          then one record of DIFF_RECORD_BYTES per scan.
+ ******************************************************************************/
+
+#ifndef DIFFSCAN_H
+#define DIFFSCAN_H
+
+#include <stdint.h>
+
+#include <ScentCore.h>
+
+#define DIFF_HELLO 0xD1
+#define DIFF_SCAN 'S'
+#define DIFF_QUIT 'Q'
+#define DIFF_INPUT_BYTES (5 + 2 * SAMPLE_BLOCK)
+#define DIFF_SAMPLE_BYTES 4
+#define DIFF_SCAN_BYTES 40
+#define DIFF_RECORD_BYTES \
+  (SAMPLE_BLOCK * DIFF_SAMPLE_BYTES + DIFF_SCAN_BYTES)
+#define DIFF_DELAY_OFFSET 7 // delayMs within the per-scan part.
+
+/********************************* RECORD *************************************/
+// Where each value sits in a record, for naming the first difference.
+struct DiffField {
+  const char *name;
+  uint8_t offset;  // Within the per-sample or per-scan part.
+  uint8_t bytes;
+};
+
+// Per sample, after qualifyAnalog().
+static const DiffField c_DIFF_SAMPLE_FIELDS[] = {
+  {"filter.average", 0, 1}, {"filter.sample", 1, 1},
+  {"filter.floor", 2, 1},   {"detect", 3, 1},
+};
+
+// Per scan, after controllerScan().
+static const DiffField c_DIFF_SCAN_FIELDS[] = {
+  {"state", 0, 1},          {"handled", 1, 1},
+  {"flags", 2, 1},          {"motion", 3, 1},
+  {"presence", 4, 1},       {"learned", 5, 1},
+  {"faults", 6, 1},         {"delayMs", DIFF_DELAY_OFFSET, 2},
+  {"timeRemaining", 9, 2},  {"motionRate.refillIn", 11, 2},
+  {"fanTimeRemain", 13, 2}, {"blockMotionIn", 15, 2},
+  {"vacantIn", 17, 2},      {"fallbackIn", 19, 2},
+  {"thresholdQ4", 21, 2},   {"multiplier", 23, 1},
+  {"block average", 24, 1}, {"block sample", 25, 1},
+  {"clock.subMs", 26, 2},   {"clock.subSecond", 28, 2},
+  {"motionRate.tokens", 30, 1},       {"manualRate.tokens", 31, 1},
+  {"manualRate.refillIn", 32, 2},     {"motionRate.suppressed", 34, 2},
+  {"manualRate.suppressed", 36, 2},  {"motionPending", 38, 1},
+  {"manualPending", 39, 1},
+};
+// flags: bit 0 detect, 1 relay, 2 LED, 3 saveLearned, 4 faultsChanged,
+//        5 fanRunning, 6 occupied, 7 motion.
+
+/********************************** STEP **************************************/
+struct DiffRig {
+  ControllerState ctrl;   // Fed a block per scan.
+  FilterState filter;     // Fed the same samples one at a time.
+};
+
+static inline void diffBegin(DiffRig &rig) {
+  controllerInit(rig.ctrl, 0);
+  rig.filter = FilterState();
+}
+
+static inline uint8_t *diffPut16(uint8_t *p, uint16_t value) {
+  p[0] = uint8_t(value);
+  p[1] = uint8_t(value >> 8);
+  return p + 2;
+}
+
+static inline uint16_t diffGet16(const uint8_t *p) {
+  return uint16_t(p[0] | (uint16_t(p[1]) << 8));
+}
+
+static inline void diffUnpack(const uint8_t *bytes, ScanInputs &in) {
+  /*******            One scan's inputs from the wire format.           *******/
+  in.now = uint32_t(diffGet16(bytes)) | (uint32_t(diffGet16(bytes + 2)) << 16);
+  in.manualActivate = (bytes[4] != 0);
+  for (uint8_t n = 0; n < SAMPLE_BLOCK; n++) {
+    in.samples[n] = diffGet16(bytes + 5 + 2 * n);
+  }
+}
+
+static inline void diffStep(DiffRig &rig, const ScanInputs &in,
+                            uint8_t *record) {
+  /*******          Run one scan and pack everything it changed.        *******/
+  const ControllerState &c = rig.ctrl;
+  ScanOutputs out;
+  uint8_t *p = record;
+
+  for (uint8_t n = 0; n < SAMPLE_BLOCK; n++) {
+    bool detect = qualifyAnalog(rig.filter, c_FILTER_PARAMS, in.samples[n]);
+    *p++ = rig.filter.average;
+    *p++ = rig.filter.sample;
+    *p++ = rig.filter.floor;
+    *p++ = detect;
+  }
+
+  controllerScan(rig.ctrl, in, out);
+  *p++ = uint8_t(c.state);
+  *p++ = uint8_t(out.handled);
+  *p++ = uint8_t((out.detect ? 0x01 : 0) | (out.relay ? 0x02 : 0) |
+                 (out.led ? 0x04 : 0) | (out.saveLearned ? 0x08 : 0) |
+                 (out.faultsChanged ? 0x10 : 0) |
+                 (c.fanRunning ? 0x20 : 0) |
+                 (c.presence.occupied ? 0x40 : 0) |
+                 (c.detector.motion ? 0x80 : 0));
+  *p++ = uint8_t(out.motion);
+  *p++ = uint8_t(out.presence);
+  *p++ = uint8_t(out.learned);
+  *p++ = out.faults;
+  p = diffPut16(p, out.delayMs);
+  p = diffPut16(p, c.timeRemaining);
+  p = diffPut16(p, c.motionRate.refillIn);
+  p = diffPut16(p, c.fanTimeRemain);
+  p = diffPut16(p, c.blockMotionIn);
+  p = diffPut16(p, c.presence.vacantIn);
+  p = diffPut16(p, c.fallbackIn);
+  p = diffPut16(p, c.learn.thresholdQ4);
+  *p++ = c.learn.multiplier;
+  *p++ = c.filter.average;
+  *p++ = c.filter.sample;
+  p = diffPut16(p, c.clock.subMs);
+  p = diffPut16(p, c.clock.subSecond);
+  *p++ = c.motionRate.tokens;
+  *p++ = c.manualRate.tokens;
+  p = diffPut16(p, c.manualRate.refillIn);
+  p = diffPut16(p, c.motionRate.suppressed);
+  p = diffPut16(p, c.manualRate.suppressed);
+  *p++ = c.motionPending;
+  *p++ = c.manualPending;
+}
+
+#endif // DIFFSCAN_H
@@ -0,0 +1,352 @@
+/*******************************************************************************
+ * ScentAssist - AVR/Host Differential Test
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Proves that the host build of ScentCore computes exactly what the
+ *        AVR build does, so tuning done at host speed (filtersweep, fleetsim)
+ *        carries over to the device. The replay firmware (avr/replay.cpp)
+ *        runs inside simavr; every scan of a trace is sent to it over its
+ *        UART and also stepped natively through the same diffStep(). The
+ *        two records must match byte for byte: per-sample filter output and
+ *        detection, then the scan's outputs, FSM state and timers. The run
+ *        stops at the first difference, naming the scan, sample and field.
+ *
+ *        Without a trace, a synthetic one is generated: noise, motion bursts,
+ *        spikes and button presses. Debounce delays the FSM requests skip
+ *        trace time exactly as the firmware's blocking delay does.
+ *
+ * BUILD: pio run -e difftest_avr && pio run -e difftest
+ *        (needs simavr's library and headers, e.g. libsimavr-dev)
+ *
+ * USAGE: difftest [--elf=PATH] [--mcu=NAME] [--rate=HZ] [--minutes=M]
+ *                 [--seed=S] [TRACE]
+ *
+ *        TRACE is a .sat recording (see tracetool) or plain text with one
+ *        sample per line at --rate (default 4000 Hz).
+ ******************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+#include <avr_uart.h>
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_irq.h>
+
+#include <ScentCore.h>
+#include <ScentTrace.h>
+
+#include "diffscan.h"
+
+const uint64_t c_IDLE_LIMIT = 200000000; // Cycles without an answer: hung.
+
+/******************************** SAMPLE TRACE ********************************/
+static inline uint64_t splitmix(uint64_t &x) {
+  uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+struct Trace {
+  std::vector<uint16_t> samples;
+  std::vector<uint8_t> pressed;  // Button held at this sample.
+  uint32_t rateHz;
+};
+
+static bool loadTrace(const char *path, Trace &t) {
+  /*******      A .sat recording, else one decimal sample per line.     *******/
+  size_t len = strlen(path);
+  if ((len > 4) && (strcmp(path + len - 4, ".sat") == 0)) {
+    TraceReader r;
+    if (!traceOpen(r, path)) {
+      return false;
+    }
+    std::vector<uint16_t> block(r.blockSamples);
+    t.rateHz = r.sampleRateHz;
+    for (uint32_t b = 0; b < r.blockCount; b++) {
+      uint32_t n = traceDecodeBlock(r, b, block.data());
+      t.samples.insert(t.samples.end(), block.begin(), block.begin() + n);
+    }
+    traceClose(r);
+  } else {
+    FILE *in = fopen(path, "r");
+    unsigned value;
+    if (!in) {
+      return false;
+    }
+    while (fscanf(in, "%u", &value) == 1) {
+      t.samples.push_back(uint16_t(value > 1023 ? 1023 : value));
+    }
+    fclose(in);
+  }
+  t.pressed.assign(t.samples.size(), 0);
+  return !t.samples.empty();
+}
+
+static void synthTrace(Trace &t, double minutes, uint64_t seed) {
+  /*******  Quiet baseline with visits, spikes and the odd button press *******/
+  uint64_t count = uint64_t(minutes * 60.0 * t.rateHz);
+  uint64_t rng = seed;
+  uint64_t burstEnd = 0, pressEnd = 0;
+  uint16_t burstLevel = 0;
+
+  t.samples.resize(count);
+  t.pressed.assign(count, 0);
+  for (uint64_t i = 0; i < count; i++) {
+    uint64_t r = splitmix(rng);
+    int32_t value = 10 + int32_t(r & 7) - int32_t((r >> 3) & 7);
+    if ((i >= burstEnd) && ((r >> 8) % (20ull * t.rateHz) == 0)) {
+      burstEnd = i + t.rateHz / 2 + (r >> 24) % (3ull * t.rateHz);
+      burstLevel = uint16_t(100 + (r >> 40) % 300);
+    }
+    if (i < burstEnd) {
+      value += burstLevel;
+    }
+    if ((r >> 16) % (600ull * t.rateHz) == 0) {
+      value = int32_t(300 + (r >> 48) % 724); // Electrical spike.
+    }
+    if ((i >= pressEnd) && ((r >> 20) % (900ull * t.rateHz) == 0)) {
+      pressEnd = i + t.rateHz * 6 / 10;
+    }
+    t.samples[i] = uint16_t(value < 0 ? 0 : (value > 1023 ? 1023 : value));
+    t.pressed[i] = (i < pressEnd);
+  }
+}
+
+/********************************** SIMAVR ************************************/
+struct Link {
+  avr_t *avr;
+  avr_irq_t *rx;                // Bytes into the device's UART.
+  std::deque<uint8_t> toDevice;
+  std::vector<uint8_t> fromDevice;
+  bool xon = true;              // The device's receive FIFO has room.
+};
+
+static void onOutput(avr_irq_t *, uint32_t value, void *param) {
+  static_cast<Link *>(param)->fromDevice.push_back(uint8_t(value));
+}
+
+static void onXon(avr_irq_t *, uint32_t, void *param) {
+  static_cast<Link *>(param)->xon = true;
+}
+
+static void onXoff(avr_irq_t *, uint32_t, void *param) {
+  static_cast<Link *>(param)->xon = false;
+}
+
+static bool linkOpen(Link &link, const char *elf, const char *mcu) {
+  elf_firmware_t fw;
+  memset(&fw, 0, sizeof(fw));
+  if (elf_read_firmware(elf, &fw) != 0) {
+    fprintf(stderr, "Cannot load %s (pio run -e difftest_avr)\n", elf);
+    return false;
+  }
+  link.avr = avr_make_mcu_by_name(mcu);
+  if (!link.avr) {
+    fprintf(stderr, "simavr does not know the %s\n", mcu);
+    return false;
+  }
+  avr_init(link.avr);
+  link.avr->frequency = 16000000;
+  avr_load_firmware(link.avr, &fw);
+
+  // Raw bytes only: no echo of the device's output to stdout.
+  uint32_t flags = 0;
+  avr_ioctl(link.avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+  flags &= ~AVR_UART_FLAG_STDIO;
+  avr_ioctl(link.avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+
+  link.rx = avr_io_getirq(link.avr, AVR_IOCTL_UART_GETIRQ('0'),
+                          UART_IRQ_INPUT);
+  avr_irq_register_notify(avr_io_getirq(link.avr, AVR_IOCTL_UART_GETIRQ('0'),
+                                        UART_IRQ_OUTPUT), onOutput, &link);
+  avr_irq_register_notify(avr_io_getirq(link.avr, AVR_IOCTL_UART_GETIRQ('0'),
+                                        UART_IRQ_OUT_XON), onXon, &link);
+  avr_irq_register_notify(avr_io_getirq(link.avr, AVR_IOCTL_UART_GETIRQ('0'),
+                                        UART_IRQ_OUT_XOFF), onXoff, &link);
+  return true;
+}
+
+static bool linkAwait(Link &link, size_t bytes) {
+  /*******  Run the device until it has sent `bytes`; false if it died. *******/
+  uint64_t start = link.avr->cycle;
+  while (link.fromDevice.size() < bytes) {
+    if (link.xon && !link.toDevice.empty()) {
+      avr_raise_irq(link.rx, link.toDevice.front());
+      link.toDevice.pop_front();
+    }
+    int state = avr_run(link.avr);
+    if ((state == cpu_Done) || (state == cpu_Crashed)) {
+      return false;
+    }
+    if (link.avr->cycle - start > c_IDLE_LIMIT) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/******************************** COMPARISON **********************************/
+static uint16_t fieldValue(const uint8_t *part, const DiffField &f) {
+  return (f.bytes == 2) ? diffGet16(part + f.offset) : part[f.offset];
+}
+
+static void reportDivergence(uint64_t scan, const ScanInputs &in,
+                             const uint8_t *host, const uint8_t *device) {
+  /*******     Name the first byte that differs, and what led to it.    *******/
+  size_t at = 0;
+  while (host[at] == device[at]) at++;
+
+  const DiffField *fields = c_DIFF_SCAN_FIELDS;
+  size_t fieldCount = sizeof(c_DIFF_SCAN_FIELDS) / sizeof(DiffField);
+  size_t base = SAMPLE_BLOCK * DIFF_SAMPLE_BYTES;
+  int sample = -1;
+  if (at < base) {
+    sample = int(at / DIFF_SAMPLE_BYTES);
+    base = size_t(sample) * DIFF_SAMPLE_BYTES;
+    fields = c_DIFF_SAMPLE_FIELDS;
+    fieldCount = sizeof(c_DIFF_SAMPLE_FIELDS) / sizeof(DiffField);
+  }
+  const DiffField *field = &fields[0];
+  for (size_t f = 0; f < fieldCount; f++) {
+    if ((at - base) >= fields[f].offset) field = &fields[f];
+  }
+
+  printf("DIVERGED at scan %llu (now %lu us)", (unsigned long long)scan,
+         (unsigned long)in.now);
+  if (sample >= 0) printf(", sample %d", sample);
+  printf(": %s host %u, avr %u\n", field->name,
+         fieldValue(host + base, *field), fieldValue(device + base, *field));
+  printf("  inputs: button %d, samples", in.manualActivate ? 1 : 0);
+  for (uint8_t n = 0; n < SAMPLE_BLOCK; n++) printf(" %u", in.samples[n]);
+  printf("\n  host:");
+  for (size_t n = 0; n < DIFF_RECORD_BYTES; n++) printf(" %02x", host[n]);
+  printf("\n  avr: ");
+  for (size_t n = 0; n < DIFF_RECORD_BYTES; n++) printf(" %02x", device[n]);
+  printf("\n");
+}
+
+/*********************************** MAIN *************************************/
+int main(int argc, char **argv) {
+  const char *elf = ".pio/build/difftest_avr/firmware.elf";
+  const char *mcu = "atmega328p";
+  const char *tracePath = nullptr;
+  double minutes = 10; // --minutes=75 also crosses the us clock's wrap.
+  uint64_t seed = 0x5CE27A55u;
+  Trace trace;
+  trace.rateHz = 4000;
+
+  for (int a = 1; a < argc; a++) {
+    if (strncmp(argv[a], "--elf=", 6) == 0) elf = argv[a] + 6;
+    else if (strncmp(argv[a], "--mcu=", 6) == 0) mcu = argv[a] + 6;
+    else if (strncmp(argv[a], "--rate=", 7) == 0) {
+      trace.rateHz = uint32_t(atol(argv[a] + 7));
+    } else if (strncmp(argv[a], "--minutes=", 10) == 0) {
+      minutes = atof(argv[a] + 10);
+    } else if (strncmp(argv[a], "--seed=", 7) == 0) {
+      seed = strtoull(argv[a] + 7, nullptr, 0);
+    } else if (argv[a][0] != '-' && !tracePath) tracePath = argv[a];
+    else {
+      fprintf(stderr, "usage: difftest [--elf=PATH] [--mcu=NAME] "
+                      "[--rate=HZ] [--minutes=M] [--seed=S] [TRACE]\n");
+      return 2;
+    }
+  }
+  if (trace.rateHz == 0 || minutes <= 0) {
+    fprintf(stderr, "rate and minutes must be positive.\n");
+    return 2;
+  }
+  if (tracePath) {
+    if (!loadTrace(tracePath, trace)) {
+      fprintf(stderr, "Cannot read trace %s\n", tracePath);
+      return 1;
+    }
+  } else {
+    synthTrace(trace, minutes, seed);
+  }
+
+  Link link;
+  if (!linkOpen(link, elf, mcu)) {
+    return 1;
+  }
+  if (!linkAwait(link, 4)) {
+    fprintf(stderr, "The device never said hello.\n");
+    return 1;
+  }
+  if ((link.fromDevice[0] != DIFF_HELLO) ||
+      (link.fromDevice[1] != SAMPLE_BLOCK) ||
+      (link.fromDevice[2] != MEDIAN_TAPS) ||
+      (link.fromDevice[3] != DIFF_RECORD_BYTES)) {
+    fprintf(stderr, "Firmware built with SAMPLE_BLOCK %u, MEDIAN_TAPS %u; "
+            "this harness with %u, %u. Build both from one env.\n",
+            link.fromDevice[1], link.fromDevice[2], SAMPLE_BLOCK, MEDIAN_TAPS);
+    return 1;
+  }
+  link.fromDevice.clear();
+
+  printf("ScentAssist Differential Test (%s, SAMPLE_BLOCK %u, "
+         "MEDIAN_TAPS %u)\n", mcu, SAMPLE_BLOCK, MEDIAN_TAPS);
+  printf("  %zu samples at %u Hz from %s\n", trace.samples.size(),
+         trace.rateHz, tracePath ? tracePath : "the synthetic generator");
+
+  DiffRig rig;
+  diffBegin(rig);
+  ScanInputs in;
+  uint8_t packet[1 + DIFF_INPUT_BYTES];
+  uint8_t record[DIFF_RECORD_BYTES];
+  uint64_t scans = 0;
+  size_t at = 0;
+  bool same = true;
+
+  while (at + SAMPLE_BLOCK <= trace.samples.size()) {
+    // The clock at the scan's last sample, wrapping as micros() does.
+    uint64_t us = (uint64_t(at + SAMPLE_BLOCK) * 1000000) / trace.rateHz;
+    packet[0] = DIFF_SCAN;
+    diffPut16(&packet[1], uint16_t(us));
+    diffPut16(&packet[3], uint16_t(us >> 16));
+    packet[5] = trace.pressed[at + SAMPLE_BLOCK - 1];
+    for (uint8_t n = 0; n < SAMPLE_BLOCK; n++) {
+      diffPut16(&packet[6 + 2 * n], trace.samples[at + n]);
+    }
+    link.toDevice.insert(link.toDevice.end(), packet, packet + sizeof(packet));
+
+    diffUnpack(&packet[1], in);
+    diffStep(rig, in, record);
+    if (!linkAwait(link, DIFF_RECORD_BYTES)) {
+      printf("Device stopped answering at scan %llu.\n",
+             (unsigned long long)scans);
+      return 1;
+    }
+    if (memcmp(record, link.fromDevice.data(), DIFF_RECORD_BYTES) != 0) {
+      reportDivergence(scans, in, record, link.fromDevice.data());
+      same = false;
+      break;
+    }
+    link.fromDevice.clear();
+    scans++;
+
+    // A requested debounce passes without samples on the device too.
+    uint16_t delayMs = diffGet16(&record[SAMPLE_BLOCK * DIFF_SAMPLE_BYTES +
+                                         DIFF_DELAY_OFFSET]);
+    at += SAMPLE_BLOCK + (uint64_t(delayMs) * trace.rateHz) / 1000;
+  }
+
+  link.toDevice.push_back(DIFF_QUIT);
+  linkAwait(link, 1); // Runs until the device sleeps for good.
+  double deviceS = double(link.avr->cycle) / link.avr->frequency;
+  avr_terminate(link.avr);
+
+  if (same) {
+    printf("  %llu scans (%llu samples) bit-identical; %.1f s of device "
+           "time\n", (unsigned long long)scans,
+           (unsigned long long)(scans * SAMPLE_BLOCK), deviceS);
+  }
+  return same ? 0 : 1;
+}
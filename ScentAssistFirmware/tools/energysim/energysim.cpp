@@ -0,0 +1,354 @@
+/*******************************************************************************
+ * ScentAssist - Energy Model and Battery-Life Estimator
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Host tool for battery and solar installs. Drives one ScentAssist
+ *        controller on virtual time against the fleet simulator's cat-visit
+ *        model and integrates the charge drawn by each consumer: the MCU
+ *        (active and standby), ADC conversions, the indicator LEDs as blink()
+ *        drives them, the relay coil and the fan itself.
+ *
+ *        The controller's behavior is the same in every firmware mode; only
+ *        the time the MCU and ADC spend awake differs. Each scan is therefore
+ *        simulated once and charged three ways:
+ *
+ *          polling   loop() spins continuously (the shipping firmware).
+ *          tickless  the MCU sleeps between scans and an RTC interrupt wakes
+ *                    it once per scan period.
+ *          window    the MCU sleeps while the controller is at rest; the ADC
+ *                    free-runs in standby and its window comparator wakes the
+ *                    MCU only for samples the filter would flag. Whenever a
+ *                    timer, visit or blink edge is pending it scans as in
+ *                    tickless mode.
+ *
+ *        The currents below are typical figures for a Nano Every at 5 V and
+ *        a small 5 V relay; measure your own hardware and pass them in.
+ *
+ * BUILD: pio run -e energysim
+ *
+ * USAGE: energysim [--days=D] [--scan-ms=MS] [--seed=S] [--visits=PER_DAY]
+ *                  [--spikes=PER_HOUR] [--noise=LSB] [--battery-wh=WH]
+ *                  [--volts=V] [--active-ma=MA] [--standby-ua=UA]
+ *                  [--board-ma=MA] [--sensor-ma=MA] [--led-ma=MA]
+ *                  [--relay-ma=MA] [--fan-w=W]
+ ******************************************************************************/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <ScentCore.h>
+
+/***************************** SIMULATION SETUP *******************************/
+struct SimParams {
+  double days = 7.0;             // Simulated duration.
+  uint32_t scanUs = 10000;       // Scan period (tickless wake interval).
+  uint64_t seed = 0x5CE27A55u;   // Random seed.
+  double visitsPerDay = 6.0;     // Mean litter box visits.
+  double spikesPerHour = 2.0;    // Single-scan electrical spikes.
+  uint16_t noise = 4;            // Peak baseline noise (ADC counts).
+  double batteryWh = 20.0;       // Usable battery energy.
+};
+
+struct PowerModel {
+  double volts = 5.0;            // Supply rail all currents are drawn from.
+  double activeMa = 6.0;         // ATmega4809 running at 16 MHz.
+  double standbyUa = 5.0;        // Standby with the RTC (and ADC) enabled.
+  double boardMa = 0.0;          // Regulator, power LED, USB bridge.
+  double sensorMa = 0.1;         // Motion sensor, always powered.
+  double adcMa = 0.4;            // ADC while converting.
+  double ledMa = 8.0;            // Indicator LED on LED_OUTPUT_PIN.
+  double builtinMa = 2.0;        // LED_BUILTIN, lit while motion detected.
+  double relayMa = 70.0;         // Relay coil while the fan runs.
+  double fanW = 1.8;             // Fan load switched by the relay.
+  uint32_t readUs = 104;         // One analogRead() from start to result.
+  uint32_t scanCpuUs = 60;       // controllerScan() and pin updates.
+  uint32_t wakeUs = 10;          // Standby to running, including ISR.
+  uint32_t windowHz = 100;       // Free-running ADC rate in window mode.
+  uint32_t convUs = 14;          // One hardware conversion (no analogRead).
+};
+
+const uint64_t c_VISIT_MIN = 20000000;        // 20 Seconds
+const uint64_t c_VISIT_MAX = 600000000;       // 10 Minutes
+const uint64_t c_BURST_MIN = 500000;          // 0.5 Seconds
+const uint64_t c_BURST_MAX = 3000000;         // 3 Seconds
+const double c_BURST_GAP_MEAN = 2000000.0;    // 2 Seconds
+
+/*************************** RANDOM NUMBER SOURCE *****************************/
+static inline uint64_t splitmix(uint64_t &x) {
+  uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static inline double uniform(uint64_t &rng) {
+  return double(splitmix(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static inline uint64_t uniformSpan(uint64_t &rng, uint64_t lo, uint64_t hi) {
+  return lo + uint64_t(uniform(rng) * double(hi - lo));
+}
+
+static inline uint64_t exponential(uint64_t &rng, double mean) {
+  return uint64_t(-mean * __builtin_log(1.0 - uniform(rng)));
+}
+
+/****************************** SENSOR MODEL **********************************/
+struct Environment {
+  uint64_t rng;
+  uint8_t baseline;
+  uint64_t nextVisit;
+  uint64_t visitEnd = 0;
+  uint64_t nextBurst = 0;
+  uint64_t burstEnd = 0;
+  uint16_t burstLevel = 0;
+  uint64_t nextSpike;
+  uint32_t visits = 0;
+};
+
+static void initEnvironment(Environment &env, const SimParams &p) {
+  env.rng = p.seed;
+  env.baseline = uint8_t(uniformSpan(env.rng, 4, 16));
+  env.nextVisit = exponential(env.rng, 86400e6 / p.visitsPerDay);
+  env.nextSpike = (p.spikesPerHour > 0) ?
+    exponential(env.rng, 3600e6 / p.spikesPerHour) : UINT64_MAX;
+}
+
+static uint16_t sampleSensor(Environment &env, uint64_t t,
+                             const SimParams &p) {
+  /*******     One ADC reading at t; same model as tools/fleetsim.      *******/
+  int32_t value = env.baseline;
+
+  if (p.noise) {
+    uint64_t r = splitmix(env.rng);
+    value += int32_t(r & 0xFF) % (p.noise + 1);
+    value -= int32_t((r >> 8) & 0xFF) % (p.noise + 1);
+  }
+  if (t >= env.nextVisit) {
+    env.visitEnd = t + uniformSpan(env.rng, c_VISIT_MIN, c_VISIT_MAX);
+    env.nextBurst = t + uniformSpan(env.rng, 0, 1000000);
+    env.nextVisit = env.visitEnd +
+                    exponential(env.rng, 86400e6 / p.visitsPerDay);
+    env.visits++;
+  }
+  if (t < env.visitEnd) {
+    if ((t >= env.nextBurst) && (t >= env.burstEnd)) {
+      env.burstEnd = t + uniformSpan(env.rng, c_BURST_MIN, c_BURST_MAX);
+      env.burstLevel = uint16_t(uniformSpan(env.rng, 150, 400));
+      env.nextBurst = env.burstEnd + exponential(env.rng, c_BURST_GAP_MEAN);
+    }
+    if (t < env.burstEnd) {
+      value += env.burstLevel;
+    }
+  }
+  if (t >= env.nextSpike) {
+    value = int32_t(uniformSpan(env.rng, 300, 1024));
+    env.nextSpike = t + exponential(env.rng, 3600e6 / p.spikesPerHour);
+  }
+
+  return uint16_t(std::min(std::max(value, int32_t(0)), int32_t(1023)));
+}
+
+/****************************** ENERGY LEDGER *********************************/
+enum firmwareMode {
+  POLLING = 0,
+  TICKLESS,
+  WINDOW,
+  MODE_COUNT
+};
+
+const char *const c_MODE_NAMES[MODE_COUNT] = {"polling", "tickless", "window"};
+
+struct ModeLedger {
+  double mcuUc = 0;     // Microcoulombs drawn by the MCU core.
+  double adcUc = 0;     // ... by ADC conversions.
+  uint64_t awakeUs = 0; // MCU time out of standby.
+  uint64_t wakeups = 0; // Standby exits.
+};
+
+struct Ledger {
+  ModeLedger mode[MODE_COUNT];
+  double commonUc = 0;  // Board overhead and sensor: the same in all modes.
+  double ledUc = 0;     // Both indicator LEDs.
+  double relayUc = 0;   // Relay coil.
+  uint64_t fanUs = 0;   // Fan running time.
+  uint64_t scans = 0;
+  uint64_t simUs = 0;
+};
+
+static bool atRest(const ControllerState &ctrl) {
+  /*******  Nothing but a sensor event can change what the scan does.   *******/
+  return (ctrl.state == controlState::IDLE) && !ctrl.fanRunning &&
+         (ctrl.timeRemaining == 0) && (ctrl.motionRate.refillIn == 0) &&
+         (ctrl.blockMotionIn == 0) && !ctrl.detector.active &&
+         !ctrl.motionPending && !ctrl.manualPending &&
+         !ctrl.presence.occupied;
+}
+
+static void chargeScan(Ledger &led, const PowerModel &pm, uint64_t dtUs,
+                       uint32_t delayUs, bool needed) {
+  /*******        Charge one scan interval to each firmware mode.       *******/
+  const double standbyMa = pm.standbyUa / 1000.0;
+  const uint32_t readsUs = SAMPLE_BLOCK * pm.readUs;
+  const uint32_t scanUs = pm.wakeUs + readsUs + pm.scanCpuUs + delayUs;
+  const uint64_t busyUs = std::min<uint64_t>(scanUs, dtUs);
+  ModeLedger &poll = led.mode[POLLING];
+  ModeLedger &tick = led.mode[TICKLESS];
+  ModeLedger &win = led.mode[WINDOW];
+
+  // Polling: always running; the ADC busy for its share of each loop().
+  poll.mcuUc += pm.activeMa * dtUs;
+  poll.adcUc += pm.adcMa * dtUs * readsUs / double(readsUs + pm.scanCpuUs);
+  poll.awakeUs += dtUs;
+
+  // Tickless: one wake per scan; delay() still busy-waits.
+  tick.mcuUc += pm.activeMa * busyUs + standbyMa * (dtUs - busyUs);
+  tick.adcUc += pm.adcMa * readsUs;
+  tick.awakeUs += busyUs;
+  tick.wakeups++;
+
+  // Window: asleep unless this scan had work; ADC free-runs meanwhile.
+  if (needed) {
+    win.mcuUc += pm.activeMa * busyUs + standbyMa * (dtUs - busyUs);
+    win.adcUc += pm.adcMa * readsUs;
+    win.awakeUs += busyUs;
+    win.wakeups++;
+  } else {
+    win.mcuUc += standbyMa * dtUs;
+    win.adcUc += pm.adcMa * pm.convUs * (dtUs * pm.windowHz / 1e6);
+  }
+}
+
+static void simulate(const SimParams &p, const PowerModel &pm, Ledger &led) {
+  /*******      Run one controller and charge every scan interval.      *******/
+  Environment env;
+  ControllerState ctrl;
+  ScanInputs in;
+  ScanOutputs out;
+  uint64_t end = uint64_t(p.days * 86400e6);
+  uint64_t t = 0;
+  bool ledWas = false;
+
+  initEnvironment(env, p);
+  controllerInit(ctrl, 0);
+  in.manualActivate = false;
+
+  while (t < end) {
+    bool restBefore = atRest(ctrl);
+    in.now = uint32_t(t);
+    for (uint8_t k = 0; k < SAMPLE_BLOCK; k++) {
+      in.samples[k] = sampleSensor(env, t, p);
+    }
+    controllerScan(ctrl, in, out);
+    led.scans++;
+
+    // The window wakes for flagged samples; the RTC for LED edges and timers.
+    bool needed = !restBefore || out.detect || (out.led != ledWas) ||
+                  !atRest(ctrl);
+    ledWas = out.led;
+
+    uint32_t delayUs = uint32_t(out.delayMs) * 1000;
+    uint64_t dt = p.scanUs + delayUs;
+    chargeScan(led, pm, dt, delayUs, needed);
+    led.commonUc += (pm.boardMa + pm.sensorMa) * dt;
+    led.ledUc += (out.led ? pm.ledMa : 0.0) * dt;
+    led.ledUc += (out.detect ? pm.builtinMa : 0.0) * dt;
+    if (out.relay) {
+      led.relayUc += pm.relayMa * dt;
+      led.fanUs += dt;
+    }
+    t += dt;
+  }
+  led.simUs = t;
+}
+
+/********************************* REPORTING **********************************/
+static bool parseArg(const char *arg, const char *name, double &value) {
+  size_t len = strlen(name);
+  if (strncmp(arg, name, len) == 0 && arg[len] == '=') {
+    value = atof(arg + len + 1);
+    return true;
+  }
+  return false;
+}
+
+static double lifeDays(double batteryWh, double whPerDay) {
+  return (whPerDay > 0) ? batteryWh / whPerDay : 0.0;
+}
+
+int main(int argc, char **argv) {
+  SimParams p;
+  PowerModel pm;
+  Ledger led;
+
+  for (int a = 1; a < argc; a++) {
+    double v;
+    if (parseArg(argv[a], "--days", v)) p.days = v;
+    else if (parseArg(argv[a], "--scan-ms", v)) p.scanUs = uint32_t(v * 1000);
+    else if (parseArg(argv[a], "--seed", v)) p.seed = uint64_t(v);
+    else if (parseArg(argv[a], "--visits", v)) p.visitsPerDay = v;
+    else if (parseArg(argv[a], "--spikes", v)) p.spikesPerHour = v;
+    else if (parseArg(argv[a], "--noise", v)) p.noise = uint16_t(v);
+    else if (parseArg(argv[a], "--battery-wh", v)) p.batteryWh = v;
+    else if (parseArg(argv[a], "--volts", v)) pm.volts = v;
+    else if (parseArg(argv[a], "--active-ma", v)) pm.activeMa = v;
+    else if (parseArg(argv[a], "--standby-ua", v)) pm.standbyUa = v;
+    else if (parseArg(argv[a], "--board-ma", v)) pm.boardMa = v;
+    else if (parseArg(argv[a], "--sensor-ma", v)) pm.sensorMa = v;
+    else if (parseArg(argv[a], "--led-ma", v)) pm.ledMa = v;
+    else if (parseArg(argv[a], "--relay-ma", v)) pm.relayMa = v;
+    else if (parseArg(argv[a], "--fan-w", v)) pm.fanW = v;
+    else {
+      fprintf(stderr, "Unknown argument: %s\n", argv[a]);
+      return 2;
+    }
+  }
+  if (p.days <= 0 || p.scanUs == 0 || p.visitsPerDay <= 0) {
+    fprintf(stderr, "days, scan-ms and visits must be positive.\n");
+    return 2;
+  }
+
+  simulate(p, pm, led);
+
+  // Microcoulombs (mA * us / 1000) to watt-hours per simulated day.
+  double days = led.simUs / 86400e6;
+  double toWhDay = pm.volts / 1000.0 / 3600e6 / days;
+  double commonWh = led.commonUc * toWhDay;
+  double ledWh = led.ledUc * toWhDay;
+  double relayWh = led.relayUc * toWhDay;
+  double fanWh = pm.fanW * (led.fanUs / 3600e6) / days;
+
+  printf("ScentAssist Energy Model\n");
+  printf("  Simulated:           %.2f days @ %.1f ms scan, %u sample(s)\n",
+         days, p.scanUs / 1000.0, SAMPLE_BLOCK);
+  printf("  Visits:              %.1f/day\n", p.visitsPerDay);
+  printf("  Fan Duty:            %.2f%% (%.2f h/day)\n",
+         100.0 * led.fanUs / led.simUs, led.fanUs / 3600e6 / days);
+  printf("Shared Loads (mWh/day)\n");
+  printf("  Board + Sensor:      %9.3f\n", 1000.0 * commonWh);
+  printf("  LEDs:                %9.3f\n", 1000.0 * ledWh);
+  printf("  Relay Coil:          %9.3f\n", 1000.0 * relayWh);
+  printf("  Fan:                 %9.3f\n", 1000.0 * fanWh);
+  printf("Per Mode               MCU mWh   ADC mWh   Awake   Wakes/s  "
+         "Ctrl Life  +Fan Life\n");
+  for (uint8_t m = 0; m < MODE_COUNT; m++) {
+    const ModeLedger &ml = led.mode[m];
+    double mcuWh = ml.mcuUc * toWhDay;
+    double adcWh = ml.adcUc * toWhDay;
+    double ctrlWh = mcuWh + adcWh + commonWh + ledWh;
+    double allWh = ctrlWh + relayWh + fanWh;
+    printf("  %-10s         %9.3f %9.3f  %5.2f%%  %7.1f  %7.1f d  %7.1f d\n",
+           c_MODE_NAMES[m], 1000.0 * mcuWh, 1000.0 * adcWh,
+           100.0 * ml.awakeUs / led.simUs, ml.wakeups / (led.simUs / 1e6),
+           lifeDays(p.batteryWh, ctrlWh), lifeDays(p.batteryWh, allWh));
+  }
+  printf("  (Life on a %.1f Wh battery; Ctrl excludes the relay and fan.)\n",
+         p.batteryWh);
+
+  return 0;
+}
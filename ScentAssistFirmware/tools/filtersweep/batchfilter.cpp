@@ -0,0 +1,157 @@
+/*******************************************************************************
+ * ScentAssist - Batched Filter Kernels
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ ******************************************************************************/
+
+#include <immintrin.h>
+
+#include "batchfilter.h"
+
+const size_t c_BLOCK = 1024; // Samples between counter flushes.
+
+static_assert(MEDIAN_TAPS == 1, "the batch kernels model no median prefilter");
+
+/****************************** SCALAR REFERENCE ******************************/
+static void scalarLane(const BatchLane &lane, size_t samples,
+                       uint32_t decimate, BatchResult &result,
+                       uint16_t *masks, size_t bit) {
+  FilterState filter = {};
+  uint8_t detectionSet = 0;
+  bool prevFull = false;
+  uint32_t sinceShift = 0;
+
+  result.detections = 0;
+  result.qualified = 0;
+  result.firstQualified = -1;
+
+  for (size_t i = 0; i < samples; i++) {
+    bool detect = qualifyAnalog(filter, lane.params, lane.trace[i]);
+    result.detections += detect;
+    if (masks) {
+      masks[i] |= uint16_t(detect) << bit;
+    }
+    if (sinceShift == 0) {
+      detectionSet = uint8_t((detectionSet << 1) | uint8_t(detect));
+      bool full = (detectionSet == 0xFF);
+      if (full && !prevFull) {
+        result.qualified++;
+        if (result.firstQualified < 0) {
+          result.firstQualified = int64_t(i);
+        }
+      }
+      prevFull = full;
+    }
+    sinceShift = (sinceShift + 1 >= decimate) ? 0 : sinceShift + 1;
+  }
+}
+
+/********************************* SSE2 KERNEL ********************************/
+namespace sse2 {
+typedef __m128i V;
+const size_t LANES = 8;
+static inline V load(const uint16_t *p) { return _mm_loadu_si128((const V *)p); }
+static inline void store(uint16_t *p, V a) { _mm_storeu_si128((V *)p, a); }
+static inline V set1(int16_t x) { return _mm_set1_epi16(x); }
+static inline V zero() { return _mm_setzero_si128(); }
+static inline V add(V a, V b) { return _mm_add_epi16(a, b); }
+static inline V sub(V a, V b) { return _mm_sub_epi16(a, b); }
+static inline V mullo(V a, V b) { return _mm_mullo_epi16(a, b); }
+static inline V mulhi(V a, V b) { return _mm_mulhi_epu16(a, b); }
+static inline V srli8(V a) { return _mm_srli_epi16(a, 8); }
+static inline V srli15(V a) { return _mm_srli_epi16(a, 15); }
+static inline V slli1(V a) { return _mm_slli_epi16(a, 1); }
+static inline V andv(V a, V b) { return _mm_and_si128(a, b); }
+static inline V orv(V a, V b) { return _mm_or_si128(a, b); }
+static inline V xorv(V a, V b) { return _mm_xor_si128(a, b); }
+static inline V andnot(V a, V b) { return _mm_andnot_si128(a, b); }
+static inline V maxs(V a, V b) { return _mm_max_epi16(a, b); }
+static inline V cmpgt(V a, V b) { return _mm_cmpgt_epi16(a, b); }
+static inline V cmpeq(V a, V b) { return _mm_cmpeq_epi16(a, b); }
+static inline bool any(V a) { return _mm_movemask_epi8(a) != 0; }
+static inline uint16_t movemask(V a) {
+  return uint16_t(_mm_movemask_epi8(_mm_packs_epi16(a, _mm_setzero_si128())));
+}
+#include "batchkernel.inl"
+} // namespace sse2
+
+/********************************* AVX2 KERNEL ********************************/
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace avx2 {
+typedef __m256i V;
+const size_t LANES = 16;
+static inline V load(const uint16_t *p) {
+  return _mm256_loadu_si256((const V *)p);
+}
+static inline void store(uint16_t *p, V a) { _mm256_storeu_si256((V *)p, a); }
+static inline V set1(int16_t x) { return _mm256_set1_epi16(x); }
+static inline V zero() { return _mm256_setzero_si256(); }
+static inline V add(V a, V b) { return _mm256_add_epi16(a, b); }
+static inline V sub(V a, V b) { return _mm256_sub_epi16(a, b); }
+static inline V mullo(V a, V b) { return _mm256_mullo_epi16(a, b); }
+static inline V mulhi(V a, V b) { return _mm256_mulhi_epu16(a, b); }
+static inline V srli8(V a) { return _mm256_srli_epi16(a, 8); }
+static inline V srli15(V a) { return _mm256_srli_epi16(a, 15); }
+static inline V slli1(V a) { return _mm256_slli_epi16(a, 1); }
+static inline V andv(V a, V b) { return _mm256_and_si256(a, b); }
+static inline V orv(V a, V b) { return _mm256_or_si256(a, b); }
+static inline V xorv(V a, V b) { return _mm256_xor_si256(a, b); }
+static inline V andnot(V a, V b) { return _mm256_andnot_si256(a, b); }
+static inline V maxs(V a, V b) { return _mm256_max_epi16(a, b); }
+static inline V cmpgt(V a, V b) { return _mm256_cmpgt_epi16(a, b); }
+static inline V cmpeq(V a, V b) { return _mm256_cmpeq_epi16(a, b); }
+static inline bool any(V a) { return !_mm256_testz_si256(a, a); }
+static inline uint16_t movemask(V a) {
+  // packs works per 128-bit half; permute the halves back into lane order.
+  V packed = _mm256_packs_epi16(a, _mm256_setzero_si256());
+  packed = _mm256_permute4x64_epi64(packed, 0xD8);
+  return uint16_t(_mm256_movemask_epi8(packed));
+}
+#include "batchkernel.inl"
+} // namespace avx2
+#pragma GCC pop_options
+
+/******************************** DISPATCHING *********************************/
+size_t batchWidth(BatchIsa isa) {
+  switch (isa) {
+    case ISA_SCALAR: return 1;
+    case ISA_SSE2:   return sse2::LANES;
+    case ISA_AVX2:   return avx2::LANES;
+  }
+  return 1;
+}
+
+BatchIsa batchDetectIsa() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return ISA_AVX2;
+  }
+  return ISA_SSE2;
+}
+
+void batchRun(BatchIsa isa, const BatchLane *lanes, size_t count,
+              size_t samples, uint32_t decimate, BatchResult *results,
+              uint16_t *masks) {
+  if (decimate == 0) {
+    decimate = 1;
+  }
+  switch (isa) {
+    case ISA_SCALAR:
+      if (masks) {
+        for (size_t i = 0; i < samples; i++) masks[i] = 0;
+      }
+      for (size_t l = 0; l < count; l++) {
+        scalarLane(lanes[l], samples, decimate, results[l], masks, l);
+      }
+      break;
+    case ISA_SSE2:
+      sse2::kernel(lanes, count, samples, decimate, results, masks);
+      break;
+    case ISA_AVX2:
+      avx2::kernel(lanes, count, samples, decimate, results, masks);
+      break;
+  }
+}
@@ -0,0 +1,55 @@
+/*******************************************************************************
+ * ScentAssist - Batched Filter Kernels
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Evaluates the qualifyAnalog() pipeline (IIR, moving average, scaled
+ *        threshold) plus the detectionSet shift register for a batch of
+ *        lanes at once. Each lane carries its own FilterParams and trace.
+ *        SSE2 handles 8 lanes and AVX2 handles 16 lanes of 16-bit state;
+ *        both are bit-exact with the fixed-point reference in ScentCore.
+ ******************************************************************************/
+
+#ifndef BATCHFILTER_H
+#define BATCHFILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ScentCore.h>
+
+#define BATCH_MAX_LANES 16
+
+struct BatchLane {
+  FilterParams params;    // Parameters for this lane.
+  const uint16_t *trace;  // Raw ADC samples for this lane.
+};
+
+struct BatchResult {
+  uint32_t detections;    // Samples where the filter flagged a spike.
+  uint32_t qualified;     // Rising edges of a full detectionSet.
+  int64_t firstQualified; // Sample index of the first edge, -1 if none.
+};
+
+enum BatchIsa {
+  ISA_SCALAR = 0,
+  ISA_SSE2,
+  ISA_AVX2
+};
+
+// Lanes processed per call for the given instruction set.
+size_t batchWidth(BatchIsa isa);
+
+// Best instruction set supported by the running processor.
+BatchIsa batchDetectIsa();
+
+// Run `count` (<= batchWidth(isa)) lanes over `samples` samples each. The
+// detectionSet is shifted on every `decimate`-th sample. When `masks` is not
+// null, the per-sample detection bits (bit n = lane n) are written there.
+void batchRun(BatchIsa isa, const BatchLane *lanes, size_t count,
+              size_t samples, uint32_t decimate, BatchResult *results,
+              uint16_t *masks);
+
+#endif // BATCHFILTER_H
@@ -0,0 +1,133 @@
+/*******************************************************************************
+ * ScentAssist - Batched Filter Kernel Body
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Included once per instruction set by batchfilter.cpp, inside a
+ *        namespace which supplies the vector type `V`, the lane count
+ *        `LANES` and the primitive operations used below. No include guard
+ *        on purpose.
+ ******************************************************************************/
+
+static void kernel(const BatchLane *lanes, size_t count, size_t samples,
+                   uint32_t decimate, BatchResult *results, uint16_t *masks) {
+  alignas(32) uint16_t tmp[LANES];
+  alignas(32) uint16_t block[LANES * c_BLOCK];
+  V hist[FILTER_LENGTH];
+  uint32_t detections[LANES] = {0};
+  uint32_t qualified[LANES] = {0};
+  int64_t first[LANES];
+  bool shared = true;
+  uint32_t sinceShift = 0;
+  uint8_t index = 0;
+
+  // Unused lanes mirror lane 0 and are discarded at the end.
+  const BatchLane *lane[LANES];
+  for (size_t l = 0; l < LANES; l++) {
+    lane[l] = &lanes[(l < count) ? l : 0];
+    shared = shared && (lane[l]->trace == lanes[0].trace);
+    first[l] = -1;
+  }
+
+  // Broadcast Parameters into Lanes
+  for (size_t l = 0; l < LANES; l++) tmp[l] = lane[l]->params.iirCoef;
+  const V coef = load(tmp);
+  for (size_t l = 0; l < LANES; l++) tmp[l] = 256 - lane[l]->params.iirCoef;
+  const V coefInv = load(tmp);
+  for (size_t l = 0; l < LANES; l++) tmp[l] = lane[l]->params.minThreshold;
+  const V minThr = load(tmp);
+  for (size_t l = 0; l < LANES; l++) tmp[l] = lane[l]->params.multiplier;
+  const V mult = load(tmp);
+  for (size_t l = 0; l < LANES; l++) {
+    tmp[l] = lane[l]->params.averaging ? 0xFFFF : 0;
+  }
+  const V avgMask = load(tmp);
+
+  const V byteMask = set1(0x00FF);
+  const V bias = set1(int16_t(0x8000));
+  const V div10 = set1(int16_t(6554)); // (x * 6554) >> 16 == x / 10, x < 2560
+  V total = zero();
+  V detectionSet = zero();
+  V prevFull = zero();
+  V detCount = zero();
+  V qualCount = zero();
+  for (size_t k = 0; k < FILTER_LENGTH; k++) hist[k] = zero();
+
+  for (size_t base = 0; base < samples; base += c_BLOCK) {
+    size_t n = (samples - base < c_BLOCK) ? (samples - base) : c_BLOCK;
+
+    // Interleave independent traces so each step is one vector load.
+    if (!shared) {
+      for (size_t i = 0; i < n; i++) {
+        for (size_t l = 0; l < LANES; l++) {
+          block[i * LANES + l] = lane[l]->trace[base + i];
+        }
+      }
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      V raw = shared ? set1(int16_t(lanes[0].trace[base + i]))
+                     : load(&block[i * LANES]);
+      V sample = andv(raw, byteMask);
+
+      // Evaluate Average
+      V average = andv(mulhi(total, div10), avgMask);
+
+      // Run Sample through Filter
+      sample = srli8(add(mullo(average, coef), mullo(sample, coefInv)));
+
+      // Load the Most Recent Sample
+      total = add(sub(total, hist[index]), sample);
+      hist[index] = sample;
+      index = (index >= FILTER_LENGTH - 1) ? 0 : index + 1;
+
+      // Compare Sample to Scaled Average (unsigned compare via bias)
+      V floor = maxs(average, minThr);
+      V detect = cmpgt(xorv(sample, bias), xorv(mullo(mult, floor), bias));
+      detCount = sub(detCount, detect);
+
+      if (masks) {
+        masks[base + i] = movemask(detect);
+      }
+
+      // Shift the detectionSet at the qualifying rate
+      if (sinceShift == 0) {
+        detectionSet = andv(orv(slli1(detectionSet), srli15(detect)),
+                            byteMask);
+        V full = cmpeq(detectionSet, byteMask);
+        V rising = andnot(prevFull, full);
+        prevFull = full;
+        qualCount = sub(qualCount, rising);
+        if (any(rising)) {
+          uint16_t bits = movemask(rising);
+          for (size_t l = 0; l < LANES; l++) {
+            if ((bits >> l & 1) && (first[l] < 0)) {
+              first[l] = int64_t(base + i);
+            }
+          }
+        }
+      }
+      sinceShift = (sinceShift + 1 >= decimate) ? 0 : sinceShift + 1;
+    }
+
+    // Flush 16-bit Counters
+    store(tmp, detCount);
+    for (size_t l = 0; l < LANES; l++) detections[l] += tmp[l];
+    store(tmp, qualCount);
+    for (size_t l = 0; l < LANES; l++) qualified[l] += tmp[l];
+    detCount = zero();
+    qualCount = zero();
+  }
+
+  for (size_t l = 0; l < count; l++) {
+    results[l].detections = detections[l];
+    results[l].qualified = qualified[l];
+    results[l].firstQualified = first[l];
+  }
+  if (masks) {
+    uint16_t keep = uint16_t((1u << count) - 1);
+    for (size_t i = 0; i < samples; i++) masks[i] &= keep;
+  }
+}
@@ -0,0 +1,501 @@
+/*******************************************************************************
+ * ScentAssist - Fleet Simulator
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Host tool which runs thousands of independent ScentAssist controllers
+ *        against stochastic cat-visit and sensor-noise models, so changes to
+ *        the defaults can be judged across a whole fleet before they ship.
+ *        With --frozen a share of the units have their sensor freeze at a
+ *        mid-scale code partway through, to see the health check report it.
+ *
+ *        Controller and model state is kept in a struct-of-arrays layout.
+ *        Simulated time advances in epochs; inside each epoch every worker
+ *        thread steps its own contiguous slice of units through the shared
+ *        ScentCore scan, then records fleet-wide figures for that epoch.
+ *
+ * BUILD: pio run -e fleetsim
+ *
+ * USAGE: fleetsim [--units=N] [--days=D] [--scan-ms=MS] [--threads=T]
+ *                 [--seed=S] [--visits=PER_DAY] [--spikes=PER_HOUR]
+ *                 [--noise=LSB] [--profile=INDEX] [--frozen=FRACTION]
+ ******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <ScentCore.h>
+
+/***************************** SIMULATION SETUP *******************************/
+struct SimParams {
+  uint32_t units = 2000;         // Number of simulated closets.
+  double days = 1.0;             // Simulated duration.
+  uint32_t scanUs = 10000;       // Virtual period of loop().
+  uint32_t epochUs = 60000000;   // Fleet bookkeeping interval.
+  uint32_t threads = 0;          // 0 -> all cores.
+  uint64_t seed = 0x5CE27A55u;   // Base random seed.
+  double visitsPerDay = 6.0;     // Mean litter box visits per unit.
+  double spikesPerHour = 2.0;    // Single-scan electrical spikes.
+  uint16_t noise = 4;            // Peak baseline noise (ADC counts).
+  uint32_t profile = 0;          // c_FACTORY_PROFILES entry every unit runs.
+  double frozen = 0.0;           // Share of units whose sensor freezes.
+};
+
+const uint32_t c_LATENCY_BINS = 601;          // 1 second bins, last overflows.
+const uint64_t c_VISIT_GRACE = 10000000;      // Detection allowed after visit.
+const uint64_t c_VISIT_MIN = 20000000;        // 20 Seconds
+const uint64_t c_VISIT_MAX = 600000000;       // 10 Minutes
+const uint64_t c_BURST_MIN = 500000;          // 0.5 Seconds
+const uint64_t c_BURST_MAX = 3000000;         // 3 Seconds
+const double c_BURST_GAP_MEAN = 2000000.0;    // 2 Seconds
+const uint16_t c_FROZEN_LEVEL = 512;          // Mid-scale code held when dead.
+
+/*************************** RANDOM NUMBER SOURCE *****************************/
+static inline uint64_t splitmix(uint64_t &x) {
+  uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static inline double uniform(uint64_t &rng) {
+  return double(splitmix(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static inline uint64_t uniformSpan(uint64_t &rng, uint64_t lo, uint64_t hi) {
+  return lo + uint64_t(uniform(rng) * double(hi - lo));
+}
+
+static inline uint64_t exponential(uint64_t &rng, double mean) {
+  return uint64_t(-mean * __builtin_log(1.0 - uniform(rng)));
+}
+
+static_assert(SAMPLE_BLOCK == 1, "fleetsim models one sample per scan");
+
+/***************************** FLEET STATE (SoA) ******************************/
+// Every ControllerState member but the profile pointer, as (storage type,
+// name); one array per member. Flags are stored as bytes, since
+// std::vector<bool> packs neighbouring units into words shared between
+// threads. load()/store() and the layout check below all expand this list.
+#define FLEET_CONTROLLER_FIELDS(X) \
+  X(controlState, state)           \
+  X(TickClock, clock)              \
+  X(uint16_t, timeRemaining)       \
+  X(RateLimiter, motionRate)       \
+  X(RateLimiter, manualRate)       \
+  X(uint16_t, fanTimeRemain)       \
+  X(uint16_t, blockMotionIn)       \
+  X(DetectorState, detector)       \
+  X(uint8_t, motionPending)        \
+  X(uint8_t, manualPending)        \
+  X(PresenceState, presence)       \
+  X(uint8_t, fanRunning)           \
+  X(FilterState, filter)           \
+  X(LearnState, learn)             \
+  X(HealthState, health)           \
+  X(uint16_t, fallbackIn)          \
+  X(BlinkState, blink)
+
+#define FLEET_ARRAY(type, name) std::vector<type> name;
+#define FLEET_SIZE(type, name) name(n),
+#define FLEET_LOAD(type, name) c.name = name[i];
+#define FLEET_STORE(type, name) name[i] = c.name;
+#define FLEET_MIRROR(type, name) decltype(ControllerState::name) name;
+#define FLEET_OFFSET(type, name) \
+  static_assert(offsetof(ControllerMirror, name) ==                        \
+                offsetof(ControllerState, name), "fleet misses before " #name);
+#define FLEET_BIND(type, name) , name
+
+// ControllerState rebuilt from the list, so fleetsim stops building if the
+// two disagree: the binding needs exactly one name per member (a flag can
+// hide in padding), the offsets catch order and type.
+struct ControllerMirror {
+  const ControllerProfile *profile;
+  FLEET_CONTROLLER_FIELDS(FLEET_MIRROR)
+};
+FLEET_CONTROLLER_FIELDS(FLEET_OFFSET)
+static_assert(sizeof(ControllerMirror) == sizeof(ControllerState),
+              "ControllerState has a member FLEET_CONTROLLER_FIELDS lacks");
+
+[[maybe_unused]] static void fleetCoversController(ControllerState &c) {
+  [[maybe_unused]] auto &[profile FLEET_CONTROLLER_FIELDS(FLEET_BIND)] = c;
+}
+
+struct Fleet {
+  // Controller (loop() statics)
+  std::vector<uint8_t> profile;       // Index into c_FACTORY_PROFILES.
+  FLEET_CONTROLLER_FIELDS(FLEET_ARRAY)
+  // Environment Model
+  std::vector<uint64_t> now;          // Simulated microseconds.
+  std::vector<uint64_t> rng;
+  std::vector<uint8_t> baseline;
+  std::vector<uint64_t> nextVisit;
+  std::vector<uint64_t> visitStart;
+  std::vector<uint64_t> visitEnd;
+  std::vector<uint64_t> nextBurst;
+  std::vector<uint64_t> burstEnd;
+  std::vector<uint16_t> burstLevel;
+  std::vector<uint64_t> nextSpike;
+  std::vector<uint64_t> freezeAt;     // Sensor dies here (UINT64_MAX never).
+  std::vector<uint8_t> visitOpen;     // Visit not yet detected nor missed.
+  std::vector<uint8_t> armedFalse;    // Countdown started without a cat.
+  std::vector<uint8_t> awaitFan;      // Visit not yet followed by the fan.
+  // Statistics
+  std::vector<uint64_t> fanUs;
+  std::vector<uint32_t> visits;
+  std::vector<uint32_t> detected;
+  std::vector<uint32_t> falseDetections;
+  std::vector<uint32_t> falseTrips;
+  std::vector<uint32_t> activations;
+  std::vector<uint64_t> faultAt;      // First fault reported (UINT64_MAX none).
+
+  explicit Fleet(uint32_t n)
+    : profile(n), FLEET_CONTROLLER_FIELDS(FLEET_SIZE)
+      now(n), rng(n), baseline(n), nextVisit(n), visitStart(n), visitEnd(n),
+      nextBurst(n), burstEnd(n), burstLevel(n), nextSpike(n), freezeAt(n),
+      visitOpen(n), armedFalse(n), awaitFan(n), fanUs(n), visits(n),
+      detected(n), falseDetections(n), falseTrips(n), activations(n),
+      faultAt(n) {}
+
+  void load(uint32_t i, ControllerState &c) const {
+    c.profile = &c_FACTORY_PROFILES[profile[i]];
+    FLEET_CONTROLLER_FIELDS(FLEET_LOAD)
+  }
+
+  void store(uint32_t i, const ControllerState &c) {
+    profile[i] = uint8_t(c.profile - c_FACTORY_PROFILES);
+    FLEET_CONTROLLER_FIELDS(FLEET_STORE)
+  }
+};
+
+/****************************** PER-THREAD TALLY ******************************/
+struct Tally {
+  std::vector<uint32_t> latency;      // Detection latency histogram.
+  std::vector<uint32_t> afterVisit;   // Visit end to fan start histogram.
+  uint64_t midVisit = 0;              // Fan started while cat present.
+  std::vector<uint32_t> fansRunning;  // Units with fan on, per epoch.
+  uint64_t scans = 0;
+};
+
+/******************************* UNIT MODEL ***********************************/
+static void initUnit(Fleet &f, uint32_t i, const SimParams &p) {
+  ControllerState ctrl;
+  uint64_t &rng = f.rng[i];
+
+  rng = p.seed ^ (uint64_t(i) * 0xD1B54A32D192ED03ull);
+  f.now[i] = uniformSpan(rng, 0, p.scanUs); // Stagger scan phase.
+  f.baseline[i] = uint8_t(uniformSpan(rng, 4, 16));
+  f.nextVisit[i] = exponential(rng, 86400e6 / p.visitsPerDay);
+  f.nextSpike[i] = (p.spikesPerHour > 0) ?
+    exponential(rng, 3600e6 / p.spikesPerHour) : UINT64_MAX;
+  // Frozen sensors die somewhere in the first half of the run.
+  f.freezeAt[i] = ((p.frozen > 0) && (uniform(rng) < p.frozen)) ?
+    uniformSpan(rng, 0, uint64_t(p.days * 86400e6 / 2)) : UINT64_MAX;
+  f.faultAt[i] = UINT64_MAX;
+
+  controllerInit(ctrl, uint32_t(f.now[i]));
+  controllerSetProfile(ctrl, &c_FACTORY_PROFILES[p.profile]);
+  f.store(i, ctrl);
+}
+
+static uint16_t sampleSensor(Fleet &f, uint32_t i, uint64_t t,
+                             const SimParams &p) {
+  /*******         Produce one ADC reading for this unit at t.          *******/
+  uint64_t &rng = f.rng[i];
+  int32_t value = f.baseline[i];
+
+  // Baseline Noise (triangular)
+  if (p.noise) {
+    uint64_t r = splitmix(rng);
+    value += int32_t(r & 0xFF) % (p.noise + 1);
+    value -= int32_t((r >> 8) & 0xFF) % (p.noise + 1);
+  }
+
+  // Visit Arrival and Departure
+  if (t >= f.nextVisit[i]) {
+    f.visitStart[i] = t;
+    f.visitEnd[i] = t + uniformSpan(rng, c_VISIT_MIN, c_VISIT_MAX);
+    f.nextBurst[i] = t + uniformSpan(rng, 0, 1000000);
+    f.nextVisit[i] = f.visitEnd[i] + exponential(rng, 86400e6 / p.visitsPerDay);
+    f.visitOpen[i] = 1;
+    f.awaitFan[i] = 1;
+    f.visits[i]++;
+  }
+
+  // Motion Bursts while the Cat is Present
+  if (t < f.visitEnd[i]) {
+    if ((t >= f.nextBurst[i]) && (t >= f.burstEnd[i])) {
+      f.burstEnd[i] = t + uniformSpan(rng, c_BURST_MIN, c_BURST_MAX);
+      f.burstLevel[i] = uint16_t(uniformSpan(rng, 150, 400));
+      f.nextBurst[i] = f.burstEnd[i] + exponential(rng, c_BURST_GAP_MEAN);
+    }
+    if (t < f.burstEnd[i]) {
+      value += f.burstLevel[i];
+    }
+  }
+
+  // Isolated Electrical Spikes
+  if (t >= f.nextSpike[i]) {
+    value = int32_t(uniformSpan(rng, 300, 1024));
+    f.nextSpike[i] = t + exponential(rng, 3600e6 / p.spikesPerHour);
+  }
+
+  // A Dead Sensor (the visits go on, unseen)
+  if (t >= f.freezeAt[i]) {
+    return c_FROZEN_LEVEL;
+  }
+
+  return uint16_t(std::min(std::max(value, int32_t(0)), int32_t(1023)));
+}
+
+static void stepUnit(Fleet &f, uint32_t i, uint64_t epochEnd,
+                     const SimParams &p, Tally &tally) {
+  /*******       Advance one unit to the end of the present epoch.      *******/
+  ControllerState ctrl;
+  ScanInputs in;
+  ScanOutputs out;
+  uint64_t t = f.now[i];
+
+  f.load(i, ctrl);
+  in.manualActivate = false;
+
+  while (t < epochEnd) {
+    in.now = uint32_t(t);
+    in.samples[0] = sampleSensor(f, i, t, p);
+    bool wasRunning = ctrl.fanRunning;
+    controllerScan(ctrl, in, out);
+    tally.scans++;
+    if (out.faultsChanged && out.faults && (f.faultAt[i] == UINT64_MAX)) {
+      f.faultAt[i] = t;
+    }
+
+    if (out.handled == controlState::DETECTED) {
+      bool present = t < (f.visitEnd[i] + c_VISIT_GRACE);
+      if (present && f.visitOpen[i]) {
+        uint64_t sec = (t - f.visitStart[i]) / 1000000;
+        tally.latency[std::min<uint64_t>(sec, c_LATENCY_BINS - 1)]++;
+        f.visitOpen[i] = 0;
+        f.detected[i]++;
+      } else if (!present) {
+        f.falseDetections[i]++;
+      }
+      if (!ctrl.fanRunning) {
+        f.armedFalse[i] = !present;
+      }
+    } else if (out.handled == controlState::ACTIVATE) {
+      f.activations[i]++;
+      if (!wasRunning && f.awaitFan[i]) {
+        if (t < f.visitEnd[i]) {
+          tally.midVisit++;
+        } else {
+          uint64_t sec = (t - f.visitEnd[i]) / 1000000;
+          tally.afterVisit[std::min<uint64_t>(sec, c_LATENCY_BINS - 1)]++;
+        }
+        f.awaitFan[i] = 0;
+      }
+      f.falseTrips[i] += f.armedFalse[i];
+      f.armedFalse[i] = 0;
+    }
+
+    // Close out visits which were never picked up
+    if (f.visitOpen[i] && (t >= f.visitEnd[i] + c_VISIT_GRACE)) {
+      f.visitOpen[i] = 0;
+    }
+
+    uint64_t dt = p.scanUs + uint64_t(out.delayMs) * 1000;
+    if (out.relay) {
+      f.fanUs[i] += dt;
+    }
+    t += dt;
+  }
+
+  f.now[i] = t;
+  f.store(i, ctrl);
+}
+
+static void worker(Fleet &f, uint32_t first, uint32_t last,
+                   const SimParams &p, uint32_t epochs, Tally &tally) {
+  for (uint32_t i = first; i < last; i++) {
+    initUnit(f, i, p);
+  }
+  for (uint32_t e = 0; e < epochs; e++) {
+    uint64_t epochEnd = uint64_t(e + 1) * p.epochUs;
+    uint32_t running = 0;
+    for (uint32_t i = first; i < last; i++) {
+      stepUnit(f, i, epochEnd, p, tally);
+    }
+    for (uint32_t i = first; i < last; i++) {
+      running += f.fanRunning[i];
+    }
+    tally.fansRunning[e] = running;
+  }
+}
+
+/********************************* REPORTING **********************************/
+static double percentile(const std::vector<uint32_t> &hist, double q) {
+  uint64_t total = 0, seen = 0;
+  for (uint32_t c : hist) total += c;
+  if (total == 0) return 0.0;
+  for (size_t b = 0; b < hist.size(); b++) {
+    seen += hist[b];
+    if (double(seen) >= q * double(total)) return double(b);
+  }
+  return double(hist.size() - 1);
+}
+
+static bool parseArg(const char *arg, const char *name, double &value) {
+  size_t len = strlen(name);
+  if (strncmp(arg, name, len) == 0 && arg[len] == '=') {
+    value = atof(arg + len + 1);
+    return true;
+  }
+  return false;
+}
+
+int main(int argc, char **argv) {
+  SimParams p;
+
+  for (int a = 1; a < argc; a++) {
+    double v;
+    if (parseArg(argv[a], "--units", v)) p.units = uint32_t(v);
+    else if (parseArg(argv[a], "--days", v)) p.days = v;
+    else if (parseArg(argv[a], "--scan-ms", v)) p.scanUs = uint32_t(v * 1000);
+    else if (parseArg(argv[a], "--threads", v)) p.threads = uint32_t(v);
+    else if (parseArg(argv[a], "--seed", v)) p.seed = uint64_t(v);
+    else if (parseArg(argv[a], "--visits", v)) p.visitsPerDay = v;
+    else if (parseArg(argv[a], "--spikes", v)) p.spikesPerHour = v;
+    else if (parseArg(argv[a], "--noise", v)) p.noise = uint16_t(v);
+    else if (parseArg(argv[a], "--profile", v)) p.profile = uint32_t(v);
+    else if (parseArg(argv[a], "--frozen", v)) p.frozen = v;
+    else {
+      fprintf(stderr, "Unknown argument: %s\n", argv[a]);
+      return 2;
+    }
+  }
+  if (p.units == 0 || p.scanUs == 0 || p.visitsPerDay <= 0) {
+    fprintf(stderr, "units, scan-ms and visits must be positive.\n");
+    return 2;
+  }
+  if (p.profile >= PROFILE_COUNT) {
+    fprintf(stderr, "profile must be 0 to %u.\n", PROFILE_COUNT - 1);
+    return 2;
+  }
+  if (p.threads == 0) {
+    p.threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  p.threads = std::min(p.threads, p.units);
+
+  uint32_t epochs = uint32_t((p.days * 86400e6) / p.epochUs);
+  epochs = std::max(epochs, 1u);
+  Fleet fleet(p.units);
+  std::vector<Tally> tallies(p.threads);
+  std::vector<std::thread> pool;
+
+  auto started = std::chrono::steady_clock::now();
+  for (uint32_t w = 0; w < p.threads; w++) {
+    uint32_t first = uint32_t(uint64_t(p.units) * w / p.threads);
+    uint32_t last = uint32_t(uint64_t(p.units) * (w + 1) / p.threads);
+    tallies[w].latency.assign(c_LATENCY_BINS, 0);
+    tallies[w].afterVisit.assign(c_LATENCY_BINS, 0);
+    tallies[w].fansRunning.assign(epochs, 0);
+    pool.emplace_back(worker, std::ref(fleet), first, last, std::cref(p),
+                      epochs, std::ref(tallies[w]));
+  }
+  for (std::thread &t : pool) {
+    t.join();
+  }
+  double wall = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - started).count();
+
+  // Merge Per-Thread Results
+  std::vector<uint32_t> latency(c_LATENCY_BINS, 0);
+  std::vector<uint32_t> afterVisit(c_LATENCY_BINS, 0);
+  std::vector<uint32_t> running(epochs, 0);
+  uint64_t scans = 0, midVisit = 0;
+  for (const Tally &t : tallies) {
+    for (uint32_t b = 0; b < c_LATENCY_BINS; b++) {
+      latency[b] += t.latency[b];
+      afterVisit[b] += t.afterVisit[b];
+    }
+    midVisit += t.midVisit;
+    for (uint32_t e = 0; e < epochs; e++) running[e] += t.fansRunning[e];
+    scans += t.scans;
+  }
+  uint64_t fanUs = 0, visits = 0, detected = 0, falseDet = 0, falseTrips = 0;
+  uint64_t activations = 0;
+  for (uint32_t i = 0; i < p.units; i++) {
+    fanUs += fleet.fanUs[i];
+    visits += fleet.visits[i];
+    detected += fleet.detected[i];
+    falseDet += fleet.falseDetections[i];
+    falseTrips += fleet.falseTrips[i];
+    activations += fleet.activations[i];
+  }
+  uint64_t runningSum = 0;
+  for (uint32_t r : running) runningSum += r;
+
+  // Sensor Health: every frozen sensor reported, and no live one
+  std::vector<uint32_t> toFault(c_LATENCY_BINS * 2, 0);
+  uint32_t frozen = 0, reported = 0, liveFaulted = 0;
+  for (uint32_t i = 0; i < p.units; i++) {
+    if (fleet.freezeAt[i] == UINT64_MAX) {
+      liveFaulted += (fleet.faultAt[i] != UINT64_MAX);
+      continue;
+    }
+    frozen++;
+    if ((fleet.faultAt[i] != UINT64_MAX) &&
+        (fleet.faultAt[i] >= fleet.freezeAt[i])) {
+      uint64_t sec = (fleet.faultAt[i] - fleet.freezeAt[i]) / 1000000;
+      toFault[std::min<uint64_t>(sec, toFault.size() - 1)]++;
+      reported++;
+    }
+  }
+
+  double simDays = double(epochs) * p.epochUs / 86400e6;
+  double unitDays = simDays * p.units;
+  printf("ScentAssist Fleet Simulation\n");
+  printf("  Units:               %u\n", p.units);
+  printf("  Profile:             %.*s\n", PROFILE_NAME_LENGTH,
+         c_FACTORY_PROFILES[p.profile].name);
+  printf("  Simulated:           %.2f days @ %.1f ms scan\n", simDays,
+         p.scanUs / 1000.0);
+  printf("  Wall Time:           %.2f s on %u threads (%.1f M scans/s)\n",
+         wall, p.threads, scans / wall / 1e6);
+  printf("Fan Usage\n");
+  printf("  Fan-Hours (total):   %.1f\n", fanUs / 3600e6);
+  printf("  Fan-Hours/Unit/Day:  %.3f\n", fanUs / 3600e6 / unitDays);
+  printf("  Activations:         %llu\n", (unsigned long long)activations);
+  printf("  Concurrent Fans:     mean %.1f, peak %u\n",
+         double(runningSum) / epochs,
+         *std::max_element(running.begin(), running.end()));
+  printf("  Visit End to Fan:    p50 %.0f / p90 %.0f s\n",
+         percentile(afterVisit, 0.50), percentile(afterVisit, 0.90));
+  printf("  Started Mid-Visit:   %llu\n", (unsigned long long)midVisit);
+  printf("Detection\n");
+  printf("  Visits:              %llu\n", (unsigned long long)visits);
+  printf("  Detected:            %llu (%.2f%%)\n", (unsigned long long)detected,
+         visits ? 100.0 * detected / visits : 0.0);
+  printf("  Latency p50/p90/p99: %.0f / %.0f / %.0f s\n",
+         percentile(latency, 0.50), percentile(latency, 0.90),
+         percentile(latency, 0.99));
+  printf("  False Detections:    %llu (%.3f/unit/day)\n",
+         (unsigned long long)falseDet, falseDet / unitDays);
+  printf("  False Trips:         %llu (%.3f/unit/day)\n",
+         (unsigned long long)falseTrips, falseTrips / unitDays);
+  printf("Sensor Health\n");
+  printf("  Live Units Faulted:  %u\n", liveFaulted);
+  if (frozen) {
+    printf("  Frozen Reported:     %u of %u (p50 %.0f / max %.0f s after)\n",
+           reported, frozen, percentile(toFault, 0.50),
+           percentile(toFault, 1.0));
+  }
+  return 0;
+}
@@ -0,0 +1,263 @@
+/*******************************************************************************
+ * ScentAssist - Control FSM Fuzz Target
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Coverage-guided fuzz target for controllerScan(). Each input is a
+ *        sequence of 4-byte steps, every one a scan of loop():
+ *
+ *          bytes 0-1  time since the previous scan (little-endian). Bit 15
+ *                     selects milliseconds, otherwise microseconds.
+ *          bytes 2-3  bits 0-9 sensor sample, bit 15 pushbutton.
+ *
+ *        Bits 12-13 of the first step pick the c_FACTORY_PROFILES entry the
+ *        whole input runs under; the limits below are that profile's.
+ *
+ *        Any blocking debounce the FSM requests is added to virtual time, as
+ *        delay() would on the board. After every scan the invariants below
+ *        are checked and a violation aborts with a description.
+ *
+ * BUILD: libFuzzer (clang):
+ *          clang++ -std=c++17 -O1 -g -fsanitize=fuzzer,address,undefined \
+ *            -Ilib/ScentCore tools/fuzz_fsm/fuzz_fsm.cpp \
+ *            lib/ScentCore/ScentCore.cpp -o fuzz_fsm
+ *          ./fuzz_fsm -max_len=4096 corpus/
+ *        Standalone replay/random driver (any compiler):
+ *          pio run -e fuzz_fsm
+ *          fuzz_fsm [CRASH_FILE...]     (no files: 20000 random inputs)
+ ******************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <ScentCore.h>
+
+static void violation(const char *what, size_t step, uint64_t t) {
+  fprintf(stderr, "INVARIANT VIOLATED at step %zu (t=%llu us): %s\n", step,
+          (unsigned long long)t, what);
+  abort();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  ControllerState ctrl;
+  ScanInputs in;
+  ScanOutputs out;
+  uint64_t t = 0x100000000ull - 60000000ull; // Start near the micros() wrap.
+  uint64_t prevScan = t;
+  uint64_t lastTrigger = 0;
+  bool triggered = false;
+  uint8_t scansOutOfIdle = 0;
+  bool inMotion = false;
+  bool startPending = false;
+  bool pressPending = false;
+
+  controllerInit(ctrl, uint32_t(t));
+  if (size >= 4) {
+    controllerSetProfile(ctrl, &c_FACTORY_PROFILES[(data[3] >> 4) & 0x03]);
+  }
+  const ControllerProfile &profile = *ctrl.profile;
+
+  for (size_t step = 0; size >= 4; step++, size -= 4, data += 4) {
+    uint16_t dt = uint16_t(data[0] | (data[1] << 8));
+    uint16_t io = uint16_t(data[2] | (data[3] << 8));
+
+    t += (dt & 0x8000) ? uint64_t(dt & 0x7FFF) * 1000 : dt;
+    in.now = uint32_t(t);
+    for (uint8_t k = 0; k < SAMPLE_BLOCK; k++) {
+      in.samples[k] = io & 0x03FF;
+    }
+    in.manualActivate = (io & 0x8000) != 0;
+
+    controllerScan(ctrl, in, out);
+
+    if ((out.handled == controlState::ACTIVATE) ||
+        (out.handled == controlState::DETECTED) ||
+        (out.presence == presenceEvent::PRESENCE_LEFT)) {
+      lastTrigger = t;
+      triggered = true;
+    }
+
+    /***********************       INVARIANTS       **************************/
+    // The relay never outlives the run time past the last trigger: it may
+    // only still be on if the previous scan had not yet reached the deadline.
+    if (out.relay && (!triggered ||
+                      (prevScan >= lastTrigger + profile.runS * 1000000ull))) {
+      violation("relay on more than the run time after last trigger", step, t);
+    }
+    if (out.relay != ctrl.fanRunning) {
+      violation("relay output disagrees with fanRunning", step, t);
+    }
+    if (out.delayMs > profile.blockDetectionMs) {
+      violation("transition blocked longer than allowed", step, t);
+    }
+    if ((ctrl.timeRemaining > 0) && ctrl.fanRunning) {
+      violation("start countdown running while fan already on", step, t);
+    }
+    if (ctrl.presence.occupied && (ctrl.timeRemaining > 0)) {
+      violation("countdown running while the box is occupied", step, t);
+    }
+    if ((ctrl.timeRemaining > profile.delayS) ||
+        (ctrl.presence.vacantIn > profile.presence.vacantS) ||
+        (ctrl.presence.occupancyLeft > profile.presence.maxOccupiedS) ||
+        (ctrl.fanTimeRemain > profile.runS) ||
+        (ctrl.motionRate.refillIn > profile.blockDetectionMs) ||
+        (ctrl.manualRate.refillIn > c_MANUAL_RATE_PARAMS.refillMs) ||
+        (ctrl.blockMotionIn > profile.blockMotionMs) ||
+        (ctrl.detector.quietMs >= profile.detector.holdMs) ||
+        (ctrl.clock.subMs >= 1000) || (ctrl.clock.subSecond >= 1000)) {
+      violation("timer above its maximum", step, t);
+    }
+    if ((ctrl.motionRate.tokens > MOTION_BURST) ||
+        (ctrl.manualRate.tokens > c_MANUAL_RATE_PARAMS.burst) ||
+        ((ctrl.motionRate.tokens == MOTION_BURST) !=
+         (ctrl.motionRate.refillIn == 0))) {
+      violation("rate budget out of step with its refill", step, t);
+    }
+    // Motion edges alternate and track the detector's own level.
+    if ((out.motion == motionEvent::MOTION_START && inMotion) ||
+        (out.motion == motionEvent::MOTION_END && !inMotion)) {
+      violation("motion edges out of order", step, t);
+    }
+    if (out.motion != motionEvent::MOTION_NONE) {
+      inMotion = (out.motion == motionEvent::MOTION_START);
+    }
+    if (inMotion != ctrl.detector.motion) {
+      violation("motion edge missing for detector change", step, t);
+    }
+    // A start edge waits for IDLE, whatever state it arrived in; only a
+    // sensor fault forgets it.
+    if (out.motion == motionEvent::MOTION_START) {
+      startPending = true;
+    }
+    if (out.faultsChanged && out.faults) {
+      startPending = false;
+    }
+    if (out.handled == controlState::IDLE) {
+      if ((ctrl.state == controlState::DETECTED) && !startPending) {
+        violation("DETECTED without a motion start edge", step, t);
+      }
+      startPending = false;
+    }
+    if (startPending != ctrl.motionPending) {
+      violation("motion start lost before IDLE", step, t);
+    }
+    // So does a press, unless a motion start takes IDLE first.
+    if (in.manualActivate) {
+      pressPending = true;
+    }
+    if ((out.handled == controlState::IDLE) &&
+        (ctrl.state != controlState::DETECTED)) {
+      pressPending = false;
+    }
+    if (pressPending != ctrl.manualPending) {
+      violation("button press lost before IDLE", step, t);
+    }
+    // A faulted sensor is never trusted for detection.
+    if (ctrl.health.faults && (out.detect || ctrl.detector.active ||
+                               ctrl.presence.occupied)) {
+      violation("motion qualified from a faulted sensor", step, t);
+    }
+    if ((ctrl.fallbackIn > c_FALLBACK_S) ||
+        ((ctrl.health.faults == 0) && (ctrl.fallbackIn != 0)) ||
+        (ctrl.health.recoverIn > c_HEALTH_PARAMS.recoverS)) {
+      violation("fallback timer inconsistent with sensor health", step, t);
+    }
+    // Learned sensitivity never leaves its bounds.
+    if ((ctrl.learn.thresholdQ4 < c_LEARN_PARAMS.minThresholdQ4) ||
+        (ctrl.learn.thresholdQ4 > c_LEARN_PARAMS.maxThresholdQ4) ||
+        (ctrl.learn.multiplier < c_LEARN_PARAMS.minMultiplier) ||
+        (ctrl.learn.multiplier > c_LEARN_PARAMS.maxMultiplier) ||
+        (ctrl.learn.cancelIn > c_LEARN_PARAMS.cancelS) ||
+        (ctrl.learn.decayIn > c_LEARN_PARAMS.decayS) ||
+        (ctrl.learn.saveIn > c_LEARN_PARAMS.saveS)) {
+      violation("learned sensitivity out of bounds", step, t);
+    }
+    // Save as the firmware does; the record must restore to the same values.
+    if (out.saveLearned) {
+      LearnRecord record;
+      LearnState restored;
+      learnStore(ctrl.learn, record);
+      learnDefaults(restored, profile.filter);
+      if (!learnRestore(restored, c_LEARN_PARAMS, record) ||
+          (restored.thresholdQ4 != ctrl.learn.thresholdQ4) ||
+          (restored.multiplier != ctrl.learn.multiplier)) {
+        violation("saved sensitivity does not restore", step, t);
+      }
+    }
+    if (ctrl.filter.readingIndex >= FILTER_LENGTH) {
+      violation("filter index outside readings[]", step, t);
+    }
+    // Transient states always settle back to IDLE within two scans.
+    scansOutOfIdle = (ctrl.state == controlState::IDLE) ? 0 : scansOutOfIdle + 1;
+    if (scansOutOfIdle > 2) {
+      violation("FSM stuck outside IDLE", step, t);
+    }
+
+    prevScan = t;
+    t += uint64_t(out.delayMs) * 1000; // delay() blocks the next scan.
+  }
+  return 0;
+}
+
+/***************************** STANDALONE DRIVER ******************************/
+#ifdef FUZZ_STANDALONE
+static void runExact(const uint8_t *bytes, size_t size) {
+  /*******      An exact-size heap copy, as libFuzzer passes it.        *******/
+  // The sanitizers then catch any read past the end of the input.
+  uint8_t *copy = static_cast<uint8_t *>(malloc(size ? size : 1));
+  if (!copy) {
+    abort();
+  }
+  for (size_t n = 0; n < size; n++) {
+    copy[n] = bytes[n];
+  }
+  LLVMFuzzerTestOneInput(copy, size);
+  free(copy);
+}
+
+int main(int argc, char **argv) {
+  static uint8_t buffer[1 << 16];
+
+  if (argc > 1) {
+    // Replay the given inputs (e.g. crashes saved by libFuzzer).
+    for (int a = 1; a < argc; a++) {
+      FILE *f = fopen(argv[a], "rb");
+      if (!f) {
+        fprintf(stderr, "Cannot read %s\n", argv[a]);
+        return 1;
+      }
+      size_t n = fread(buffer, 1, sizeof(buffer), f);
+      fclose(f);
+      runExact(buffer, n);
+      printf("%s: OK\n", argv[a]);
+    }
+    return 0;
+  }
+
+  // Unguided random inputs biased toward interesting timings and values.
+  uint64_t rng = 0x9E3779B97F4A7C15ull;
+  const uint32_t runs = 20000;
+  for (uint32_t run = 0; run < runs; run++) {
+    size_t steps = 1 + (rng >> 40) % 4096;
+    for (size_t s = 0; s < steps; s++) {
+      rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+      uint16_t dt = (rng & 3) ? uint16_t(rng >> 8) & 0x7FFF
+                              : uint16_t(0x8000 | ((rng >> 8) % 20000));
+      uint16_t io = uint16_t((rng >> 24) & 0x3FF);
+      if (((rng >> 40) & 0xFF) < 4) io |= 0x8000;
+      if (s == 0) io |= uint16_t((rng >> 48) & 0x3000); // Profile.
+      buffer[4 * s] = uint8_t(dt);
+      buffer[4 * s + 1] = uint8_t(dt >> 8);
+      buffer[4 * s + 2] = uint8_t(io);
+      buffer[4 * s + 3] = uint8_t(io >> 8);
+    }
+    runExact(buffer, steps * 4);
+  }
+  printf("%u random inputs: OK\n", runs);
+  return 0;
+}
+#endif
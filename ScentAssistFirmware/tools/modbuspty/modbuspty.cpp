@@ -0,0 +1,343 @@
+/*******************************************************************************
+ * ScentAssist - Modbus RTU Pseudo-Terminal Harness
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Runs one controller in real time behind a Linux pseudo-terminal,
+ *        serving the same ScentModbus register map as the MODBUS firmware
+ *        build: bytes are read without blocking once per 1 ms scan, stamped
+ *        and fed to modbusReceive(), and each reply is written out no faster
+ *        than a 64-byte UART buffer would take it. The sensor is a quiet
+ *        baseline with a short burst of activity every so often.
+ *
+ *        By default a built-in master opens the terminal and runs a set of
+ *        transactions against the unit: block reads of every register, single
+ *        and multiple writes, an all-or-nothing rejected write, a threshold
+ *        write read back as the learned level in use, a profile switch, a
+ *        broadcast, and malformed requests (bad CRC, another unit's address,
+ *        unknown function, out-of-range block). Each check prints PASS or
+ *        FAIL; the exit status is non-zero on any failure.
+ *
+ *        With --serve the unit just runs, printing the terminal's path, so an
+ *        external master can poll it, e.g.
+ *          mbpoll -m rtu -a 1 -b 115200 -t 3 -r 1 -c 27 /dev/pts/N
+ *
+ * BUILD: pio run -e modbuspty
+ *
+ * USAGE: modbuspty [--serve] [--seconds=S] [--address=A]
+ ******************************************************************************/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <ScentCore.h>
+#include <ScentModbus.h>
+
+const uint32_t c_BAUD = 115200;       // Only sets t3.5 here; a pty has no rate.
+const uint32_t c_SCAN_US = 1000;      // Unit scan period.
+const uint8_t c_UART_TX_BYTES = 64;   // Reply bytes written per scan at most.
+const int c_REPLY_TIMEOUT_MS = 200;   // Master gives up on a reply.
+const int c_REPLY_GAP_MS = 10;        // Silence that ends a reply.
+
+static std::atomic<bool> running(true);
+
+static uint32_t microsNow() {
+  using namespace std::chrono;
+  return uint32_t(duration_cast<microseconds>(
+    steady_clock::now().time_since_epoch()).count());
+}
+
+/******************************** THE UNIT ************************************/
+static void runUnit(int fd, uint8_t address) {
+  /*******   The firmware's loop(): scan, then service the Modbus slave. *******/
+  ControllerProfile profiles[PROFILE_COUNT];
+  ControllerState ctrl;
+  ModbusSlave slave;
+  UnitCounters counters = {};
+  ScanInputs in;
+  ScanOutputs out;
+  uint8_t active = 0;
+  uint32_t rng = 0x1234567;
+
+  memcpy(profiles, c_FACTORY_PROFILES, sizeof(profiles));
+  controllerInit(ctrl, microsNow());
+  controllerSetProfile(ctrl, &profiles[active]);
+  modbusBegin(slave, address, c_BAUD);
+  in.manualActivate = false;
+
+  uint32_t next = microsNow();
+  for (uint32_t scan = 0; running; scan++) {
+    // Quiet baseline, with a burst of motion for 2 s out of every 30 s.
+    for (uint8_t n = 0; n < SAMPLE_BLOCK; n++) {
+      rng ^= rng << 13; rng ^= rng >> 17; rng ^= rng << 5;
+      bool burst = ((scan / 1000) % 30) == 5 || ((scan / 1000) % 30) == 6;
+      in.samples[n] = uint16_t(8 + rng % 5 + (burst ? 200 : 0));
+    }
+    in.now = microsNow();
+    controllerScan(ctrl, in, out);
+    countersUpdate(counters, out);
+
+    uint8_t byte;
+    while (read(fd, &byte, 1) == 1) {
+      modbusReceive(slave, byte, microsNow());
+    }
+    ModbusMap map = {&ctrl, &profiles[active], active, &counters};
+    ModbusActions actions;
+    modbusPoll(slave, microsNow(), map, actions);
+    if (actions.filterChanged) {
+      controllerSetProfile(ctrl, &profiles[active]); // As the firmware does.
+    }
+    if (actions.selectProfile && (actions.selectIndex != active)) {
+      active = actions.selectIndex;
+      controllerSetProfile(ctrl, &profiles[active]);
+    }
+    uint8_t count = modbusPending(slave);
+    if (count > c_UART_TX_BYTES) {
+      count = c_UART_TX_BYTES;
+    }
+    if (count > 0) {
+      ssize_t sent = write(fd, &slave.reply[slave.replySent], count);
+      if (sent > 0) {
+        modbusSent(slave, uint8_t(sent));
+      }
+    }
+
+    next += c_SCAN_US;
+    int32_t wait = int32_t(next - microsNow());
+    if (wait > 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(wait));
+    }
+  }
+}
+
+/******************************* THE MASTER ***********************************/
+static std::vector<uint8_t> frameOf(std::vector<uint8_t> body, bool badCrc) {
+  uint16_t crc = modbusCrc(body.data(), uint8_t(body.size()));
+  if (badCrc) crc ^= 0x0101;
+  body.push_back(uint8_t(crc));
+  body.push_back(uint8_t(crc >> 8));
+  return body;
+}
+
+static std::vector<uint8_t> transact(int fd, const std::vector<uint8_t> &req) {
+  /*******   Send a request; collect the reply until the line goes quiet. *******/
+  std::vector<uint8_t> reply;
+  if (write(fd, req.data(), req.size()) != ssize_t(req.size())) {
+    return reply;
+  }
+  int timeout = c_REPLY_TIMEOUT_MS;
+  for (;;) {
+    struct pollfd p = {fd, POLLIN, 0};
+    if (poll(&p, 1, timeout) <= 0) break;
+    uint8_t buffer[256];
+    ssize_t n = read(fd, buffer, sizeof(buffer));
+    if (n <= 0) break;
+    reply.insert(reply.end(), buffer, buffer + n);
+    timeout = c_REPLY_GAP_MS;
+  }
+  return reply;
+}
+
+static bool replyIntact(const std::vector<uint8_t> &reply) {
+  if (reply.size() < 5) return false;
+  uint16_t crc = modbusCrc(reply.data(), uint8_t(reply.size() - 2));
+  return (reply[reply.size() - 2] == uint8_t(crc)) &&
+         (reply[reply.size() - 1] == uint8_t(crc >> 8));
+}
+
+static std::vector<uint8_t> readRequest(uint8_t unit, uint8_t function,
+                                        uint16_t start, uint16_t count) {
+  return frameOf({unit, function, uint8_t(start >> 8), uint8_t(start),
+                  uint8_t(count >> 8), uint8_t(count)}, false);
+}
+
+// Read `count` registers; empty on any error.
+static std::vector<uint16_t> readRegisters(int fd, uint8_t unit,
+                                           uint8_t function, uint16_t start,
+                                           uint16_t count) {
+  std::vector<uint16_t> values;
+  auto reply = transact(fd, readRequest(unit, function, start, count));
+  if (!replyIntact(reply) || (reply[1] != function) ||
+      (reply[2] != 2 * count) || (reply.size() != 5u + 2 * count)) {
+    return values;
+  }
+  for (uint16_t n = 0; n < count; n++) {
+    values.push_back(uint16_t((reply[3 + 2 * n] << 8) | reply[4 + 2 * n]));
+  }
+  return values;
+}
+
+static std::vector<uint8_t> writeMultiple(uint8_t unit, uint16_t start,
+                                          const std::vector<uint16_t> &values) {
+  std::vector<uint8_t> body = {unit, 16, uint8_t(start >> 8), uint8_t(start),
+                               0, uint8_t(values.size()),
+                               uint8_t(2 * values.size())};
+  for (uint16_t v : values) {
+    body.push_back(uint8_t(v >> 8));
+    body.push_back(uint8_t(v));
+  }
+  return frameOf(body, false);
+}
+
+static bool isException(const std::vector<uint8_t> &reply, uint8_t function,
+                        uint8_t code) {
+  return replyIntact(reply) && (reply.size() == 5) &&
+         (reply[1] == (function | 0x80)) && (reply[2] == code);
+}
+
+static int failures = 0;
+
+static void check(const char *what, bool ok) {
+  printf("  %-52s %s\n", what, ok ? "PASS" : "FAIL");
+  if (!ok) failures++;
+}
+
+static void runMaster(int fd, uint8_t unit) {
+  /*******          Exercise every function and error path.            *******/
+  const ControllerProfile &factory = c_FACTORY_PROFILES[0];
+
+  auto inputs = readRegisters(fd, unit, 4, 0, MODBUS_INPUT_COUNT);
+  check("read all input registers in one block",
+        inputs.size() == MODBUS_INPUT_COUNT && inputs[14] == 0);
+
+  auto holding = readRegisters(fd, unit, 3, 0, MODBUS_HOLDING_COUNT);
+  check("read all holding registers in one block",
+        holding.size() == MODBUS_HOLDING_COUNT &&
+        holding[0] == factory.delayS && holding[1] == factory.runS &&
+        holding[14] == (('D' << 8) | 'e'));
+
+  auto reply = transact(fd, frameOf({unit, 6, 0, 1, 0x01, 0x2C}, false));
+  holding = readRegisters(fd, unit, 3, 1, 1);
+  check("write single register (runS = 300) and read back",
+        replyIntact(reply) && reply.size() == 8 &&
+        holding.size() == 1 && holding[0] == 300);
+
+  reply = transact(fd, writeMultiple(unit, 0, {90, 600}));
+  holding = readRegisters(fd, unit, 3, 0, 2);
+  check("write multiple registers (delayS, runS)",
+        replyIntact(reply) && reply.size() == 8 && holding.size() == 2 &&
+        holding[0] == 90 && holding[1] == 600);
+
+  reply = transact(fd, frameOf({unit, 6, 0, 5, 0, 35}, false));
+  inputs = readRegisters(fd, unit, 4, 12, 1);
+  check("threshold write (minThreshold = 35) used for detection",
+        replyIntact(reply) && inputs.size() == 1 && inputs[0] == 35 * 16);
+
+  reply = transact(fd, writeMultiple(unit, 0, {45, 0}));
+  holding = readRegisters(fd, unit, 3, 0, 2);
+  check("invalid block write rejected as a whole",
+        isException(reply, 16, MODBUS_ILLEGAL_VALUE) && holding.size() == 2 &&
+        holding[0] == 90 && holding[1] == 600);
+
+  reply = transact(fd, frameOf({unit, 6, 0, 13, 0, 2}, false));
+  inputs = readRegisters(fd, unit, 4, 14, 1);
+  holding = readRegisters(fd, unit, 3, 14, 1);
+  check("profile select through holding register 13",
+        replyIntact(reply) && inputs.size() == 1 && inputs[0] == 2 &&
+        holding.size() == 1 && holding[0] == (('K' << 8) | 'i'));
+
+  reply = transact(fd, frameOf({0, 6, 0, 11, 0, 50}, false));
+  holding = readRegisters(fd, unit, 3, 11, 1);
+  check("broadcast write applied without a reply",
+        reply.empty() && holding.size() == 1 && holding[0] == 50);
+
+  inputs = readRegisters(fd, unit, 4, 23, 1);
+  reply = transact(fd, frameOf({unit, 4, 0, 0, 0, 1}, true));
+  auto after = readRegisters(fd, unit, 4, 23, 1);
+  check("bad CRC ignored and counted",
+        reply.empty() && inputs.size() == 1 && after.size() == 1 &&
+        after[0] == uint16_t(inputs[0] + 1));
+
+  reply = transact(fd, readRequest(uint8_t(unit + 1), 4, 0, 1));
+  check("another unit's request ignored", reply.empty());
+
+  reply = transact(fd, frameOf({unit, 5, 0, 0, 0xFF, 0}, false));
+  check("unknown function answered with exception 01",
+        isException(reply, 5, MODBUS_ILLEGAL_FUNCTION));
+
+  reply = transact(fd, readRequest(unit, 4, 20, 10));
+  check("block past the map answered with exception 02",
+        isException(reply, 4, MODBUS_ILLEGAL_ADDRESS));
+
+  reply = transact(fd, readRequest(unit, 3, 0, MODBUS_MAX_REGISTERS + 1));
+  check("oversized block answered with exception 03",
+        isException(reply, 3, MODBUS_ILLEGAL_VALUE));
+
+  inputs = readRegisters(fd, unit, 4, 22, 3);
+  check("frame and exception counters advance",
+        inputs.size() == 3 && inputs[0] >= 14 && inputs[2] == 4);
+}
+
+/*********************************** MAIN *************************************/
+int main(int argc, char **argv) {
+  bool serve = false;
+  double seconds = 0;
+  uint8_t address = 1;
+
+  for (int a = 1; a < argc; a++) {
+    if (strcmp(argv[a], "--serve") == 0) {
+      serve = true;
+    } else if (strncmp(argv[a], "--seconds=", 10) == 0) {
+      seconds = atof(argv[a] + 10);
+    } else if (strncmp(argv[a], "--address=", 10) == 0) {
+      address = uint8_t(atoi(argv[a] + 10));
+    } else {
+      fprintf(stderr, "usage: modbuspty [--serve] [--seconds=S] "
+                      "[--address=A]\n");
+      return 2;
+    }
+  }
+  if (address < 1 || address > 247) {
+    fprintf(stderr, "address must be 1 to 247.\n");
+    return 2;
+  }
+
+  // The unit holds the controlling side; masters open the terminal.
+  int unitFd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if (unitFd < 0 || grantpt(unitFd) != 0 || unlockpt(unitFd) != 0) {
+    perror("posix_openpt");
+    return 1;
+  }
+  const char *path = ptsname(unitFd);
+  int masterFd = open(path, O_RDWR | O_NOCTTY);
+  if (masterFd < 0) {
+    perror(path);
+    return 1;
+  }
+  struct termios raw;
+  tcgetattr(masterFd, &raw);
+  cfmakeraw(&raw);
+  tcsetattr(masterFd, TCSANOW, &raw);
+
+  std::thread unit(runUnit, unitFd, address);
+  if (serve) {
+    printf("ScentAssist unit %u on %s\n", address, path);
+    fflush(stdout);
+    auto end = std::chrono::steady_clock::now() +
+               std::chrono::duration<double>(seconds > 0 ? seconds : 1e9);
+    while (std::chrono::steady_clock::now() < end) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+  } else {
+    printf("ScentAssist Modbus RTU Checks (unit %u on %s)\n", address, path);
+    runMaster(masterFd, address);
+    printf("%s\n", failures ? "FAILURES" : "ALL CHECKS PASS");
+  }
+  running = false;
+  unit.join();
+  close(masterFd);
+  close(unitFd);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,601 @@
+/*******************************************************************************
+ * ScentAssist - Controller Model Checker
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Exhaustively explores the control FSM with its timers abstracted to
+ *        zero/non-zero. An abstract state is the FSM state, fanRunning,
+ *        box occupancy, one flag per timer, a pending motion start and a
+ *        pending button press;
+ *        every scan may see a motion start or end edge, the pushbutton and
+ *        any subset of the running timers expiring. Each abstract transition
+ *        is evaluated by running the real controllerScan() on a concrete
+ *        state built to match, so the model cannot drift from the firmware.
+ *
+ *        Reachable states and (state, input) pairs are tracked in bitsets.
+ *        Safety properties are checked on every transition; liveness
+ *        properties look for fair cycles (every timer either expires or is
+ *        re-armed infinitely often) that avoid the required outcome. Any
+ *        failure prints a counterexample trace from power-on.
+ *
+ * BUILD: pio run -e modelcheck
+ *
+ * USAGE: modelcheck [--verbose]
+ ******************************************************************************/
+
+#include <bitset>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include <ScentCore.h>
+
+static_assert(MOTION_BURST == 1, "the model abstracts a one-token budget");
+
+/***************************** ABSTRACT MODEL *********************************/
+// State bits: FSM state (2) | fanRunning | occupied | timeRemaining |
+//             motion hold-off | fanTimeRemain | blockMotionIn | vacantIn |
+//             occupancyLeft | motion start pending | button press pending
+// With a burst of one the motion budget is a single timer: the bucket is
+// empty exactly while it refills. The button budget is held full, so every
+// press reaches the FSM (refused presses are left to the fuzzer).
+#define TIMER_COUNT 6
+#define STATE_BITS (6 + TIMER_COUNT)
+#define STATE_COUNT (1 << STATE_BITS)
+// Input bits: motion start | motion end | button | expire mask (per timer)
+#define INPUT_BITS (3 + TIMER_COUNT)
+#define INPUT_COUNT (1 << INPUT_BITS)
+
+enum Timer {
+  T_COUNTDOWN = 0, T_STOP_DETECT, T_FAN, T_BLOCK_IN, T_VACANT, T_OCCUPANCY
+};
+
+static const char *c_TIMER_NAMES[TIMER_COUNT] = {
+  "countdown", "motionHoldOff", "fanTime", "blockMotionIn", "vacantIn",
+  "occupancyLeft"
+};
+static const uint16_t c_TIMER_FULL[TIMER_COUNT] = {
+  c_DELAY_S, c_BLOCK_DETECTION_MS, c_RUN_S, c_BLOCK_MOTION_MS, c_VACANT_S,
+  c_MAX_OCCUPIED_S
+};
+// Concrete value for a running timer that does not expire this scan; chosen
+// so a decrement can never land on a full (re-armed) value.
+const uint16_t c_TIMER_RUNNING = 0xFFFF;
+// Scan spacing: one tick of every timebase, so timers loaded with 1 expire.
+const uint32_t c_SCAN_US = 1000000;
+
+static inline controlState fsmOf(uint16_t s) { return controlState(s & 3); }
+static inline bool fanOf(uint16_t s) { return (s >> 2) & 1; }
+static inline bool occupiedOf(uint16_t s) { return (s >> 3) & 1; }
+static inline bool timerOf(uint16_t s, int t) { return (s >> (4 + t)) & 1; }
+static inline bool pendingOf(uint16_t s) {
+  return (s >> (4 + TIMER_COUNT)) & 1;
+}
+static inline bool pressedOf(uint16_t s) {
+  return (s >> (5 + TIMER_COUNT)) & 1;
+}
+static inline bool startOf(uint16_t i) { return i & 1; }
+static inline bool endOf(uint16_t i) { return (i >> 1) & 1; }
+static inline bool buttonOf(uint16_t i) { return (i >> 2) & 1; }
+static inline bool expiresOf(uint16_t i, int t) { return (i >> (3 + t)) & 1; }
+
+struct Transition {
+  uint16_t next;      // Abstract successor.
+  uint16_t rearmed;   // Timers loaded to their full value by this scan.
+  ScanOutputs out;
+};
+
+static uint16_t *timerField(ControllerState &c, int t) {
+  switch (t) {
+    case T_COUNTDOWN:   return &c.timeRemaining;
+    case T_STOP_DETECT: return &c.motionRate.refillIn;
+    case T_FAN:         return &c.fanTimeRemain;
+    case T_BLOCK_IN:    return &c.blockMotionIn;
+    case T_VACANT:      return &c.presence.vacantIn;
+    default:            return &c.presence.occupancyLeft;
+  }
+}
+
+static uint16_t abstractOf(ControllerState &c) {
+  uint16_t s = uint16_t(c.state) | uint16_t(c.fanRunning << 2) |
+               uint16_t(c.presence.occupied << 3);
+  for (int t = 0; t < TIMER_COUNT; t++) {
+    s |= uint16_t((*timerField(c, t) != 0) << (4 + t));
+  }
+  return s | uint16_t(c.motionPending << (4 + TIMER_COUNT)) |
+         uint16_t(c.manualPending << (5 + TIMER_COUNT));
+}
+
+// Inputs that only differ in expiry of stopped timers are duplicates; a
+// motion edge cannot both start and end in one scan.
+static bool canonicalInput(uint16_t s, uint16_t i) {
+  if (startOf(i) && endOf(i)) return false;
+  for (int t = 0; t < TIMER_COUNT; t++) {
+    if (expiresOf(i, t) && !timerOf(s, t)) return false;
+  }
+  return true;
+}
+
+static Transition step(uint16_t s, uint16_t i) {
+  /*******     Run one real scan from a concrete image of (s, i).       *******/
+  ControllerState c;
+  ScanInputs in;
+  Transition tr;
+  const uint32_t start = 1000;
+
+  controllerInit(c, start);
+  c.state = fsmOf(s);
+  c.fanRunning = fanOf(s);
+  c.presence.occupied = occupiedOf(s);
+  c.motionPending = pendingOf(s);
+  c.manualPending = pressedOf(s);
+  for (int t = 0; t < TIMER_COUNT; t++) {
+    *timerField(c, t) = !timerOf(s, t) ? 0 :
+                        (expiresOf(i, t) ? 1 : c_TIMER_RUNNING);
+  }
+  c.motionRate.tokens = (c.motionRate.refillIn == 0) ? MOTION_BURST : 0;
+
+  // Edges are presented as a detector one scan away from them: active just
+  // long enough with a flagged sample (start), or in motion and about to
+  // finish its hold time on a quiet sample (end).
+  c.detector.active = startOf(i) || endOf(i);
+  c.detector.motion = endOf(i);
+  c.detector.activeMs = startOf(i) ? c_DETECTOR_PARAMS.qualifyMs : 0;
+  c.detector.quietMs = 0;
+  for (uint8_t k = 0; k < SAMPLE_BLOCK; k++) {
+    in.samples[k] = startOf(i) ? 0x00FF : 0;
+  }
+  for (uint8_t k = 0; k < MEDIAN_TAPS; k++) {
+    c.filter.median.recent[k] = in.samples[0]; // Sustained, not a spike.
+  }
+  in.manualActivate = buttonOf(i);
+  in.now = start + c_SCAN_US; // Expires exactly the timers loaded with 1.
+
+  controllerScan(c, in, tr.out);
+  tr.next = abstractOf(c);
+  tr.rearmed = 0;
+  for (int t = 0; t < TIMER_COUNT; t++) {
+    if (*timerField(c, t) == c_TIMER_FULL[t]) tr.rearmed |= uint16_t(1 << t);
+  }
+  return tr;
+}
+
+/******************************** REPORTING ***********************************/
+static void describeState(uint16_t s, char *buf, size_t len) {
+  int n = snprintf(buf, len, "%-8s fan=%d%s", stateName(fsmOf(s)), fanOf(s),
+                   occupiedOf(s) ? " occupied" : "");
+  for (int t = 0; t < TIMER_COUNT; t++) {
+    if (timerOf(s, t)) n += snprintf(buf + n, len - n, " %s", c_TIMER_NAMES[t]);
+  }
+  if (pendingOf(s)) n += snprintf(buf + n, len - n, " start-pending");
+  if (pressedOf(s)) snprintf(buf + n, len - n, " press-pending");
+}
+
+static void describeInput(uint16_t s, uint16_t i, char *buf, size_t len) {
+  int n = 0;
+  buf[0] = '\0';
+  if (startOf(i)) n += snprintf(buf + n, len - n, "motion-start");
+  if (endOf(i)) n += snprintf(buf + n, len - n, "motion-end");
+  if (buttonOf(i)) n += snprintf(buf + n, len - n, "%sbutton", n ? " " : "");
+  for (int t = 0; t < TIMER_COUNT; t++) {
+    if (timerOf(s, t) && expiresOf(i, t)) {
+      n += snprintf(buf + n, len - n, "%s%s-expires", n ? " " : "",
+                    c_TIMER_NAMES[t]);
+    }
+  }
+  if (n == 0) snprintf(buf, len, "quiet");
+}
+
+struct Step {
+  uint16_t input;
+  uint16_t state;
+};
+
+static void printTrace(const char *title, uint16_t from,
+                       const std::vector<Step> &steps) {
+  char sbuf[128], ibuf[128];
+  describeState(from, sbuf, sizeof(sbuf));
+  printf("    %s\n      start: %s\n", title, sbuf);
+  for (const Step &st : steps) {
+    describeInput(from, st.input, ibuf, sizeof(ibuf));
+    describeState(st.state, sbuf, sizeof(sbuf));
+    printf("      [%s] -> %s\n", ibuf, sbuf);
+    from = st.state;
+  }
+}
+
+/******************************** EXPLORATION *********************************/
+struct Model {
+  std::bitset<STATE_COUNT> reachable;
+  std::bitset<STATE_COUNT * INPUT_COUNT> explored;
+  Transition edge[STATE_COUNT][INPUT_COUNT];
+  int16_t parent[STATE_COUNT];
+  uint16_t parentInput[STATE_COUNT];
+  uint16_t initial;
+};
+
+typedef std::function<bool(uint16_t)> StatePred;
+typedef std::function<bool(uint16_t)> InputPred;
+
+// Shortest path between states using only allowed states and inputs.
+static bool findPath(const Model &m, uint16_t from, uint16_t to,
+                     const StatePred &allowState, const InputPred &allowInput,
+                     bool nonEmpty, std::vector<Step> &path) {
+  int16_t prev[STATE_COUNT];
+  uint16_t prevInput[STATE_COUNT];
+  std::deque<uint16_t> queue;
+  std::bitset<STATE_COUNT> seen;
+
+  queue.push_back(from);
+  if (!nonEmpty) seen.set(from);
+  prev[from] = -1;
+  while (!queue.empty()) {
+    uint16_t s = queue.front();
+    queue.pop_front();
+    for (int i = 0; i < INPUT_COUNT; i++) {
+      if (!canonicalInput(s, uint16_t(i)) || !allowInput(uint16_t(i))) continue;
+      uint16_t n = m.edge[s][i].next;
+      if (!allowState(n) || seen.test(n)) continue;
+      seen.set(n);
+      prev[n] = s;
+      prevInput[n] = uint16_t(i);
+      if (n == to) {
+        path.clear();
+        uint16_t at = to;
+        do { // A loop back to `from` still records at least one step.
+          path.insert(path.begin(), Step{prevInput[at], at});
+          at = uint16_t(prev[at]);
+        } while (at != from);
+        return true;
+      }
+      queue.push_back(n);
+    }
+  }
+  return false;
+}
+
+static std::vector<Step> pathFromInitial(const Model &m, uint16_t to) {
+  std::vector<Step> path;
+  for (int s = to; m.parent[s] >= 0; s = m.parent[s]) {
+    path.insert(path.begin(), Step{m.parentInput[s], uint16_t(s)});
+  }
+  return path;
+}
+
+static void explore(Model &m) {
+  std::deque<uint16_t> queue;
+  ControllerState c;
+
+  controllerInit(c, 0);
+  m.initial = abstractOf(c);
+  for (int s = 0; s < STATE_COUNT; s++) m.parent[s] = -1;
+  m.reachable.set(m.initial);
+  queue.push_back(m.initial);
+
+  while (!queue.empty()) {
+    uint16_t s = queue.front();
+    queue.pop_front();
+    for (int i = 0; i < INPUT_COUNT; i++) {
+      if (!canonicalInput(s, uint16_t(i))) continue;
+      m.explored.set(size_t(s) * INPUT_COUNT + i);
+      Transition tr = step(s, uint16_t(i));
+      m.edge[s][i] = tr;
+      if (!m.reachable.test(tr.next)) {
+        m.reachable.set(tr.next);
+        m.parent[tr.next] = s;
+        m.parentInput[tr.next] = uint16_t(i);
+        queue.push_back(tr.next);
+      }
+    }
+  }
+  // Fill edges of unreachable states too, for path searches that never use
+  // them but index the table.
+  for (int s = 0; s < STATE_COUNT; s++) {
+    if (m.reachable.test(s)) continue;
+    for (int i = 0; i < INPUT_COUNT; i++) m.edge[s][i].next = uint16_t(s);
+  }
+}
+
+/****************************** SAFETY CHECKS *********************************/
+typedef const char *(*SafetyCheck)(uint16_t s, uint16_t i, const Transition &tr);
+
+static const char *checkRelay(uint16_t, uint16_t, const Transition &tr) {
+  return (tr.out.relay == fanOf(tr.next)) ? nullptr :
+    "relay output disagrees with fanRunning";
+}
+
+static const char *checkCountdown(uint16_t, uint16_t, const Transition &tr) {
+  return (timerOf(tr.next, T_COUNTDOWN) && fanOf(tr.next)) ?
+    "start countdown running while the fan is on" : nullptr;
+}
+
+static const char *checkBlocking(uint16_t, uint16_t, const Transition &tr) {
+  return (tr.out.delayMs > c_BLOCK_DETECTION_MS) ?
+    "transition blocks longer than c_BLOCK_DETECTION_DELAY" : nullptr;
+}
+
+static const char *checkHoldOff(uint16_t s, uint16_t i, const Transition &tr) {
+  bool stopActive = timerOf(s, T_STOP_DETECT) && !expiresOf(i, T_STOP_DETECT);
+  if (fsmOf(tr.next) != controlState::DETECTED) return nullptr;
+  if (!startOf(i) && !pendingOf(s)) return "DETECTED without a motion start";
+  // A pending start was qualified before any block began.
+  if (!pendingOf(s) && timerOf(s, T_BLOCK_IN)) {
+    return "DETECTED while motion input blocked";
+  }
+  if (stopActive) return "DETECTED during the motion hold-off";
+  return nullptr;
+}
+
+static const char *checkManualOff(uint16_t s, uint16_t i, const Transition &tr) {
+  if (fsmOf(s) != controlState::IDLE || !fanOf(s) ||
+      !(buttonOf(i) || pressedOf(s))) {
+    return nullptr;
+  }
+  if (fsmOf(tr.next) == controlState::DETECTED) return nullptr; // Motion wins
+  return (fsmOf(tr.next) == controlState::RESET) ? nullptr :
+    "button press with the fan on did not lead to RESET";
+}
+
+static const char *checkSettles(uint16_t s, uint16_t, const Transition &tr) {
+  controlState a = fsmOf(s), b = fsmOf(tr.next);
+  if (a == controlState::IDLE || b == controlState::IDLE) return nullptr;
+  if (a == controlState::DETECTED && b == controlState::ACTIVATE) return nullptr;
+  return "transient state did not settle toward IDLE";
+}
+
+static const char *checkOccupied(uint16_t, uint16_t, const Transition &tr) {
+  return (occupiedOf(tr.next) && timerOf(tr.next, T_COUNTDOWN)) ?
+    "start countdown running while the box is occupied" : nullptr;
+}
+
+static const char *checkLeft(uint16_t s, uint16_t, const Transition &tr) {
+  if (!occupiedOf(s) || occupiedOf(tr.next)) return nullptr;
+  if (fsmOf(s) == controlState::RESET) return nullptr; // Cancelled by hand
+  return (fanOf(tr.next) || timerOf(tr.next, T_COUNTDOWN) ||
+          (fsmOf(tr.next) == controlState::ACTIVATE)) ? nullptr :
+    "visit ended without arming the fan";
+}
+
+static const char *checkPending(uint16_t s, uint16_t, const Transition &tr) {
+  if (fsmOf(s) == controlState::IDLE) {
+    return pendingOf(tr.next) ? "IDLE left a motion start pending" : nullptr;
+  }
+  if (tr.out.faultsChanged && tr.out.faults) return nullptr; // Forgotten
+  return ((pendingOf(s) || tr.out.motion == motionEvent::MOTION_START) &&
+          !pendingOf(tr.next)) ?
+    "motion start outside IDLE was dropped" : nullptr;
+}
+
+static const char *checkPress(uint16_t s, uint16_t i, const Transition &tr) {
+  if ((fsmOf(s) == controlState::IDLE) &&
+      (fsmOf(tr.next) != controlState::DETECTED)) {
+    return pressedOf(tr.next) ? "IDLE left a button press pending" : nullptr;
+  }
+  // Outside IDLE, or while a motion start takes this IDLE scan.
+  return ((pressedOf(s) || buttonOf(i)) && !pressedOf(tr.next)) ?
+    "button press outside IDLE was dropped" : nullptr;
+}
+
+struct SafetyProperty {
+  const char *name;
+  SafetyCheck check;
+};
+
+static const SafetyProperty c_SAFETY[] = {
+  {"S1 relay follows fanRunning", checkRelay},
+  {"S2 no countdown while fan runs", checkCountdown},
+  {"S3 bounded blocking per transition", checkBlocking},
+  {"S4 motion respects hold-offs", checkHoldOff},
+  {"S5 button turns a running fan off", checkManualOff},
+  {"S6 transient states settle in <= 2 scans", checkSettles},
+  {"S7 no countdown while the box is occupied", checkOccupied},
+  {"S8 every visit leads to a fan run", checkLeft},
+  {"S9 a motion start waits for IDLE", checkPending},
+  {"S10 a button press waits for IDLE", checkPress},
+};
+
+/***************************** LIVENESS CHECKS ********************************/
+struct LivenessProperty {
+  const char *name;
+  const char *description;
+  StatePred start;  // States the obligation begins in.
+  StatePred goal;   // Outcome that must eventually happen.
+};
+
+static bool quiet(uint16_t i) {
+  return !startOf(i) && !endOf(i) && !buttonOf(i);
+}
+
+// Search for a fair cycle among reachable non-goal states under quiet inputs
+// that is reachable from a start state. Returns true (with a lasso) if found.
+static bool fairCycle(const Model &m, const LivenessProperty &p,
+                      uint16_t &entry, std::vector<Step> &stem,
+                      std::vector<Step> &loop) {
+  auto inRegion = [&](uint16_t s) { return m.reachable.test(s) && !p.goal(s); };
+
+  // Tarjan's SCC over the region.
+  int index[STATE_COUNT], low[STATE_COUNT], counter = 0;
+  bool onStack[STATE_COUNT] = {false};
+  std::vector<uint16_t> stack;
+  std::vector<std::vector<uint16_t>> sccs;
+  for (int s = 0; s < STATE_COUNT; s++) index[s] = -1;
+
+  std::function<void(uint16_t)> strong = [&](uint16_t v) {
+    index[v] = low[v] = counter++;
+    stack.push_back(v);
+    onStack[v] = true;
+    for (int i = 0; i < INPUT_COUNT; i++) {
+      if (!canonicalInput(v, uint16_t(i)) || !quiet(uint16_t(i))) continue;
+      uint16_t w = m.edge[v][i].next;
+      if (!inRegion(w)) continue;
+      if (index[w] < 0) {
+        strong(w);
+        if (low[w] < low[v]) low[v] = low[w];
+      } else if (onStack[w] && index[w] < low[v]) {
+        low[v] = index[w];
+      }
+    }
+    if (low[v] == index[v]) {
+      std::vector<uint16_t> scc;
+      uint16_t w;
+      do {
+        w = stack.back();
+        stack.pop_back();
+        onStack[w] = false;
+        scc.push_back(w);
+      } while (w != v);
+      sccs.push_back(scc);
+    }
+  };
+  for (int s = 0; s < STATE_COUNT; s++) {
+    if (inRegion(uint16_t(s)) && index[s] < 0) strong(uint16_t(s));
+  }
+
+  for (const std::vector<uint16_t> &scc : sccs) {
+    std::bitset<STATE_COUNT> member;
+    for (uint16_t s : scc) member.set(s);
+
+    // Fairness: each timer is seen stopped or re-armed inside the cycle.
+    bool internal = false;
+    uint16_t satisfied = 0;
+    for (uint16_t s : scc) {
+      for (int t = 0; t < TIMER_COUNT; t++) {
+        if (!timerOf(s, t)) satisfied |= uint16_t(1 << t);
+      }
+      for (int i = 0; i < INPUT_COUNT; i++) {
+        if (!canonicalInput(s, uint16_t(i)) || !quiet(uint16_t(i))) continue;
+        const Transition &tr = m.edge[s][i];
+        if (!member.test(tr.next)) continue;
+        internal = true;
+        satisfied |= tr.rearmed;
+      }
+    }
+    if (!internal || satisfied != (1 << TIMER_COUNT) - 1) continue;
+
+    // The cycle must be reachable from a start state inside the region.
+    for (int s = 0; s < STATE_COUNT; s++) {
+      if (!inRegion(uint16_t(s)) || !p.start(uint16_t(s))) continue;
+      std::vector<Step> reach;
+      uint16_t target = scc[0];
+      if (uint16_t(s) != target &&
+          !findPath(m, uint16_t(s), target,
+                    [&](uint16_t x) { return inRegion(x); }, quiet, false,
+                    reach)) {
+        continue;
+      }
+      stem = pathFromInitial(m, uint16_t(s));
+      stem.insert(stem.end(), reach.begin(), reach.end());
+      entry = target;
+      findPath(m, target, target,
+               [&](uint16_t x) { return member.test(x); }, quiet, true, loop);
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char **argv) {
+  bool verbose = (argc > 1) && (strcmp(argv[1], "--verbose") == 0);
+  static Model m;
+  int failures = 0;
+
+  explore(m);
+  printf("ScentAssist Model Check\n");
+  printf("  Reachable abstract states: %zu of %d\n", m.reachable.count(),
+         STATE_COUNT);
+  printf("  Explored (state, input):   %zu\n", m.explored.count());
+  if (verbose) {
+    char buf[128];
+    for (int s = 0; s < STATE_COUNT; s++) {
+      if (!m.reachable.test(s)) continue;
+      describeState(uint16_t(s), buf, sizeof(buf));
+      printf("    %s\n", buf);
+    }
+  }
+
+  printf("Safety\n");
+  for (const SafetyProperty &p : c_SAFETY) {
+    bool ok = true;
+    for (int s = 0; s < STATE_COUNT && ok; s++) {
+      if (!m.reachable.test(s)) continue;
+      for (int i = 0; i < INPUT_COUNT && ok; i++) {
+        if (!canonicalInput(uint16_t(s), uint16_t(i))) continue;
+        const char *why = p.check(uint16_t(s), uint16_t(i), m.edge[s][i]);
+        if (why) {
+          ok = false;
+          printf("  FAIL  %s: %s\n", p.name, why);
+          std::vector<Step> trace = pathFromInitial(m, uint16_t(s));
+          trace.push_back(Step{uint16_t(i), m.edge[s][i].next});
+          printTrace("counterexample:", m.initial, trace);
+        }
+      }
+    }
+    if (ok) printf("  PASS  %s\n", p.name);
+    failures += !ok;
+  }
+
+  // Scenario: the cat arrives on the very scan a button press stops the fan.
+  bool seen = false, ok = true;
+  for (int s = 0; s < STATE_COUNT && ok; s++) {
+    if (!m.reachable.test(s) || fsmOf(uint16_t(s)) != controlState::RESET ||
+        timerOf(uint16_t(s), T_STOP_DETECT)) {
+      continue;
+    }
+    const Transition &reset = m.edge[s][1]; // Motion start, nothing expires.
+    if (reset.out.motion != motionEvent::MOTION_START) continue;
+    const Transition &idle = m.edge[reset.next][0]; // Quiet.
+    seen = true;
+    if (fsmOf(idle.next) != controlState::DETECTED) {
+      ok = false;
+      printf("  FAIL  S11 a start during RESET is detected in IDLE\n");
+      std::vector<Step> trace = pathFromInitial(m, uint16_t(s));
+      trace.push_back(Step{1, reset.next});
+      trace.push_back(Step{0, idle.next});
+      printTrace("counterexample:", m.initial, trace);
+    }
+  }
+  if (!seen) {
+    ok = false;
+    printf("  FAIL  S11 a start during RESET is detected in IDLE (no case)\n");
+  }
+  if (ok) printf("  PASS  S11 a start during RESET is detected in IDLE\n");
+  failures += !ok;
+
+  const LivenessProperty liveness[] = {
+    {"L1 fan eventually stops", "quiet inputs, fan running",
+     [](uint16_t s) { return fanOf(s); },
+     [](uint16_t s) { return !fanOf(s); }},
+    {"L2 armed countdown starts the fan", "quiet inputs, countdown running",
+     [](uint16_t s) { return timerOf(s, T_COUNTDOWN); },
+     [](uint16_t s) { return fanOf(s); }},
+    {"L3 a visit always ends", "quiet inputs, box occupied",
+     [](uint16_t s) { return occupiedOf(s); },
+     [](uint16_t s) { return !occupiedOf(s); }},
+    {"L4 quiet controller returns to rest", "quiet inputs, any state",
+     [](uint16_t) { return true; },
+     [](uint16_t s) {
+       return fsmOf(s) == controlState::IDLE && !fanOf(s) && !occupiedOf(s) &&
+              !timerOf(s, T_COUNTDOWN) && !timerOf(s, T_FAN);
+     }},
+  };
+  printf("Liveness (fair: running timers expire unless re-armed)\n");
+  for (const LivenessProperty &p : liveness) {
+    uint16_t entry;
+    std::vector<Step> stem, loop;
+    if (fairCycle(m, p, entry, stem, loop)) {
+      printf("  FAIL  %s (%s)\n", p.name, p.description);
+      printTrace("stem:", m.initial, stem);
+      printTrace("loop (repeats forever):", entry, loop);
+      failures++;
+    } else {
+      printf("  PASS  %s\n", p.name);
+    }
+  }
+
+  printf("%s\n", failures ? "PROPERTIES VIOLATED" : "ALL PROPERTIES HOLD");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,222 @@
+/*******************************************************************************
+ * ScentAssist - Trace File Utility
+ *
+ * LICENSE: MIT
+ *
+ * AUTHOR: Joe Stanley - Stanley Solutions
+ *
+ * ABOUT: Converts motion sensor recordings to and from the compressed ".sat"
+ *        trace format (see ScentTrace.h), seeks within them by timestamp
+ *        and measures decode throughput against the recording's own rate.
+ *
+ * BUILD: pio run -e tracetool
+ *
+ * USAGE: tracetool encode --rate=HZ [--block=N] [--raw] IN OUT.sat
+ *        tracetool decode [--from=US] [--to=US] [--timestamps] IN.sat
+ *        tracetool info IN.sat
+ *        tracetool bench IN.sat
+ *
+ *        Plain-text input/output holds one decimal sample per line; --raw
+ *        input is little-endian uint16.
+ ******************************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <ScentTrace.h>
+
+static const char *argValue(const char *arg, const char *name) {
+  size_t len = strlen(name);
+  if (strncmp(arg, name, len) == 0 && arg[len] == '=') return arg + len + 1;
+  return nullptr;
+}
+
+static int usage() {
+  fprintf(stderr,
+    "usage: tracetool encode --rate=HZ [--block=N] [--raw] IN OUT.sat\n"
+    "       tracetool decode [--from=US] [--to=US] [--timestamps] IN.sat\n"
+    "       tracetool info IN.sat\n"
+    "       tracetool bench IN.sat\n");
+  return 2;
+}
+
+/********************************** ENCODE ************************************/
+static int encode(int argc, char **argv) {
+  uint32_t rate = 0;
+  uint32_t block = TRACE_DEFAULT_BLOCK;
+  bool raw = false;
+  const char *paths[2] = {nullptr, nullptr};
+  int npaths = 0;
+
+  for (int a = 0; a < argc; a++) {
+    const char *v;
+    if ((v = argValue(argv[a], "--rate"))) rate = uint32_t(atol(v));
+    else if ((v = argValue(argv[a], "--block"))) block = uint32_t(atol(v));
+    else if (strcmp(argv[a], "--raw") == 0) raw = true;
+    else if (npaths < 2) paths[npaths++] = argv[a];
+    else return usage();
+  }
+  if (npaths != 2 || rate == 0 || block == 0 || block > TRACE_MAX_BLOCK) {
+    return usage();
+  }
+
+  FILE *in = fopen(paths[0], raw ? "rb" : "r");
+  TraceWriter w;
+  if (!in) {
+    fprintf(stderr, "Cannot read %s\n", paths[0]);
+    return 1;
+  }
+  if (!traceCreate(w, paths[1], rate, uint16_t(block))) {
+    fprintf(stderr, "Cannot create %s\n", paths[1]);
+    fclose(in);
+    return 1;
+  }
+
+  std::vector<uint16_t> chunk;
+  chunk.reserve(block);
+  bool ok = true;
+  for (;;) {
+    chunk.clear();
+    if (raw) {
+      uint8_t pair[2];
+      while (chunk.size() < block && fread(pair, 1, 2, in) == 2) {
+        chunk.push_back(uint16_t(pair[0] | (pair[1] << 8)));
+      }
+    } else {
+      long value;
+      while (chunk.size() < block && fscanf(in, "%ld", &value) == 1) {
+        chunk.push_back(uint16_t(value));
+      }
+    }
+    if (chunk.empty()) break;
+    ok = ok && traceAppend(w, chunk.data(), chunk.size());
+  }
+  fclose(in);
+  uint64_t samples = w.sampleCount;
+  ok = traceFinish(w) && ok;
+  if (!ok) {
+    fprintf(stderr, "Write to %s failed\n", paths[1]);
+    return 1;
+  }
+
+  TraceReader r;
+  if (traceOpen(r, paths[1])) {
+    fprintf(stderr, "%llu samples -> %zu bytes (%.2f bits/sample)\n",
+            (unsigned long long)samples, r.size,
+            samples ? 8.0 * r.size / samples : 0.0);
+    traceClose(r);
+  }
+  return 0;
+}
+
+/********************************** DECODE ************************************/
+static int decode(int argc, char **argv) {
+  uint64_t from = 0, to = UINT64_MAX;
+  bool timestamps = false;
+  const char *path = nullptr;
+
+  for (int a = 0; a < argc; a++) {
+    const char *v;
+    if ((v = argValue(argv[a], "--from"))) from = strtoull(v, nullptr, 10);
+    else if ((v = argValue(argv[a], "--to"))) to = strtoull(v, nullptr, 10);
+    else if (strcmp(argv[a], "--timestamps") == 0) timestamps = true;
+    else if (!path) path = argv[a];
+    else return usage();
+  }
+  if (!path) return usage();
+
+  TraceReader r;
+  if (!traceOpen(r, path)) {
+    fprintf(stderr, "Cannot open trace %s\n", path);
+    return 1;
+  }
+  std::vector<uint16_t> samples(r.blockSamples);
+  for (uint32_t b = traceFindBlock(r, from); b < r.blockCount; b++) {
+    TraceBlockInfo info = traceBlock(r, b);
+    if (info.timestampUs > to) break;
+    if (traceDecodeBlock(r, b, samples.data()) != info.count) {
+      fprintf(stderr, "Block %u is corrupt\n", b);
+      traceClose(r);
+      return 1;
+    }
+    for (uint32_t i = 0; i < info.count; i++) {
+      uint64_t t = info.timestampUs + uint64_t(i) * 1000000 / r.sampleRateHz;
+      if (t < from) continue;
+      if (t > to) break;
+      if (timestamps) printf("%llu,%u\n", (unsigned long long)t, samples[i]);
+      else printf("%u\n", samples[i]);
+    }
+  }
+  traceClose(r);
+  return 0;
+}
+
+/*********************************** INFO *************************************/
+static int info(const char *path) {
+  TraceReader r;
+  if (!traceOpen(r, path)) {
+    fprintf(stderr, "Cannot open trace %s\n", path);
+    return 1;
+  }
+  TraceBlockInfo last = traceBlock(r, r.blockCount ? r.blockCount - 1 : 0);
+  uint32_t segments = 0;
+  uint64_t expected = 0;
+  for (uint32_t b = 0; b < r.blockCount; b++) {
+    TraceBlockInfo blk = traceBlock(r, b);
+    if (b == 0 || blk.timestampUs != expected) segments++;
+    expected = blk.timestampUs + uint64_t(blk.count) * 1000000 / r.sampleRateHz;
+  }
+  printf("Sample Rate:   %u Hz\n", r.sampleRateHz);
+  printf("Samples:       %llu\n", (unsigned long long)r.sampleCount);
+  printf("Blocks:        %u x %u samples\n", r.blockCount, r.blockSamples);
+  printf("Segments:      %u\n", segments);
+  printf("Span:          %.3f s\n", r.blockCount ?
+         (last.timestampUs + double(last.count) * 1e6 / r.sampleRateHz) / 1e6 :
+         0.0);
+  printf("File Size:     %zu bytes (%.2f bits/sample)\n", r.size,
+         r.sampleCount ? 8.0 * r.size / r.sampleCount : 0.0);
+  traceClose(r);
+  return 0;
+}
+
+/*********************************** BENCH ************************************/
+static int bench(const char *path) {
+  TraceReader r;
+  if (!traceOpen(r, path)) {
+    fprintf(stderr, "Cannot open trace %s\n", path);
+    return 1;
+  }
+  std::vector<uint16_t> samples(r.blockSamples);
+  uint64_t decoded = 0, checksum = 0;
+  auto started = std::chrono::steady_clock::now();
+  double wall;
+  do {
+    for (uint32_t b = 0; b < r.blockCount; b++) {
+      uint32_t n = traceDecodeBlock(r, b, samples.data());
+      for (uint32_t i = 0; i < n; i++) checksum += samples[i];
+      decoded += n;
+    }
+    wall = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - started).count();
+  } while (wall < 1.0 && decoded > 0);
+
+  double rate = decoded / wall;
+  printf("Decoded %llu samples in %.3f s: %.1f M samples/s, "
+         "%.0fx real time (checksum %llu)\n",
+         (unsigned long long)decoded, wall, rate / 1e6,
+         rate / r.sampleRateHz, (unsigned long long)checksum);
+  traceClose(r);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) return usage();
+  if (strcmp(argv[1], "encode") == 0) return encode(argc - 2, argv + 2);
+  if (strcmp(argv[1], "decode") == 0) return decode(argc - 2, argv + 2);
+  if (strcmp(argv[1], "info") == 0) return info(argv[2]);
+  if (strcmp(argv[1], "bench") == 0) return bench(argv[2]);
+  return usage();
+}